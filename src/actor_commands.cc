@@ -22,7 +22,11 @@
 /// actor_commands - actor commands
 
 #include "actor_commands.h"
+#include "capture.h"
+#include "converter.h"
 #include "fty_metric_store_server.h"
+#include "retention.h"
+#include "trace.h"
 #include <fty_log.h>
 #include <malamute.h>
 #include <stdexcept>
@@ -124,8 +128,57 @@ int actor_commands(mlm_client_t* client, zmsg_t** message_p)
 
         zstr_free(&config_file);
     }
+    else if (streq(cmd, "CAPTURE")) {
+        char* file = zmsg_popstr(message);
+        if (file && *file) {
+            capture_start(file);
+        } else {
+            capture_stop();
+        }
+        zstr_free(&file);
+    }
+    else if (streq(cmd, "TRACE")) {
+        char* action = zmsg_popstr(message);
+        char* file   = zmsg_popstr(message);
+
+        if (action && streq(action, "ON")) {
+            trace_enable(true);
+        } else if (action && streq(action, "OFF")) {
+            trace_enable(false);
+        } else if (action && streq(action, "DUMP") && file) {
+            trace_dump(file);
+        } else if (action && streq(action, "CLEAR")) {
+            trace_clear();
+        } else {
+            log_error(
+                "Expected multipart string format: TRACE/ON|OFF|CLEAR or TRACE/DUMP/file. "
+                "Received TRACE/%s/%s", action ? action : "nullptr", file ? file : "nullptr");
+        }
+
+        zstr_free(&file);
+        zstr_free(&action);
+    }
     else if (streq(cmd, FTY_METRIC_STORE_CONF_PREFIX)) {
-        log_debug("%s is not yet implemented!", FTY_METRIC_STORE_CONF_PREFIX);
+        char* step = zmsg_popstr(message);
+        char* days = zmsg_popstr(message);
+
+        if (!step || !days) {
+            log_error(
+                "Expected multipart string format: %s/step/days. "
+                "Received %s/%s/%s", FTY_METRIC_STORE_CONF_PREFIX, FTY_METRIC_STORE_CONF_PREFIX,
+                step ? step : "nullptr", days ? days : "nullptr");
+        } else {
+            int64_t age = string_to_int64(days);
+            if (errno != 0 || age < 0 || age > INT32_MAX) {
+                errno = 0;
+                log_error("%s: storage age '%s' of step '%s' is not valid", FTY_METRIC_STORE_CONF_PREFIX, days, step);
+            } else {
+                retention_set_age(step, int(age));
+            }
+        }
+
+        zstr_free(&days);
+        zstr_free(&step);
     }
     else {
         log_warning("Command '%s' is unknown or not implemented", cmd);
@@ -43,6 +43,19 @@
 //      configure actor, where
 //      config_file - full path to mapping file
 //  ^^^ NOT IMPLEMETED YET - command logic is empty
+//
+//  CAPTURE/file
+//      capture the incoming stream and mailbox messages to 'file' (see capture.h),
+//      stop capturing if 'file' is empty or missing
+//
+//  TRACE/ON, TRACE/OFF, TRACE/CLEAR
+//      start/stop recording the trace spans of the hot paths, drop the recorded spans
+//
+//  TRACE/DUMP/file
+//      write the recorded spans to 'file' in the Chrome trace event format (see trace.h)
+//
+//  FTY_METRIC_STORE_AGE/step/days
+//      set the storage age of the metrics with 'step' (RT, 15m, ...) to 'days'
 
 // Performs the actor commands logic
 // Destroys the message
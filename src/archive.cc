@@ -0,0 +1,668 @@
+/*  =========================================================================
+    archive - Cold tier of old measurements in compressed segment files
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    archive - Cold tier of old measurements in compressed segment files
+@discuss
+    Measurements older than the archive age are moved out of t_bios_measurement
+    to one segment file per topic and per month:
+
+        <archive dir>/<topic>/<YYYYMM>.seg
+
+    Segment layout (little endian):
+
+        "FMSA" | version (1 byte) | reserved (3 bytes) | count (4 bytes)
+        | size of timestamps column (4 bytes) | size of values column (4 bytes)
+        | size of scales column (4 bytes) | timestamps | values | scales
+
+    Each column is a sequence of zigzag encoded varints: timestamps are stored
+    as delta-of-delta, values and scales as delta from the previous point.
+
+    Segments are rewritten to a temporary file renamed over the old one, so
+    readers mapping the old file are never affected.
+@end
+*/
+
+#include "archive.h"
+#include "converter.h"
+#include "retention.h"
+#include "trace.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fty_log.h>
+#include <inttypes.h>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tntdb.h>
+#include <unistd.h>
+
+#define SECONDS_PER_DAY (24 * 3600)
+
+#define SEGMENT_MAGIC       "FMSA"
+#define SEGMENT_VERSION     1
+#define SEGMENT_HEADER_SIZE 24
+#define SEGMENT_SUFFIX      ".seg"
+
+struct ArchiveConfig
+{
+    int         age = 0; // days, 0 means disabled
+    std::string dir = ARCHIVE_DIR_DEFAULT;
+};
+
+static const ArchiveConfig& s_config()
+{
+    static const ArchiveConfig config = [] {
+        ArchiveConfig c;
+
+        const char* env_age = getenv(EV_DBSTORE_ARCHIVE_AGE);
+        if (env_age) {
+            int age = atoi(env_age);
+            if (age > 0)
+                c.age = age;
+        }
+        const char* env_dir = getenv(EV_DBSTORE_ARCHIVE_DIR);
+        if (env_dir && env_dir[0]) {
+            c.dir = env_dir;
+        }
+
+        if (c.age > 0) {
+            log_info("use %s %d days, archive in '%s'", EV_DBSTORE_ARCHIVE_AGE, c.age, c.dir.c_str());
+        }
+        return c;
+    }();
+    return config;
+}
+
+bool archive_enabled()
+{
+    return s_config().age > 0;
+}
+
+//
+// encoding
+//
+
+static void s_put_varint(std::string& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+static bool s_get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+{
+    v         = 0;
+    int shift = 0;
+    while (p < end && shift < 64) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+static uint64_t s_zigzag(int64_t v)
+{
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+static int64_t s_unzigzag(uint64_t v)
+{
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+static void s_put_u32(std::string& out, uint32_t v)
+{
+    for (int i = 0; i != 4; i++) {
+        out.push_back(char((v >> (8 * i)) & 0xff));
+    }
+}
+
+static uint32_t s_get_u32(const uint8_t* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+std::string archive_encode(const std::vector<ArchivePoint>& points)
+{
+    std::string ts_column, value_column, scale_column;
+
+    int64_t prev_ts = 0, prev_delta = 0, prev_value = 0, prev_scale = 0;
+    for (size_t i = 0; i != points.size(); i++) {
+        const ArchivePoint& p = points[i];
+        if (i == 0) {
+            s_put_varint(ts_column, s_zigzag(p.timestamp));
+        } else {
+            int64_t delta = p.timestamp - prev_ts;
+            s_put_varint(ts_column, s_zigzag(i == 1 ? delta : delta - prev_delta));
+            prev_delta = delta;
+        }
+        prev_ts = p.timestamp;
+
+        s_put_varint(value_column, s_zigzag(int64_t(p.value) - prev_value));
+        prev_value = p.value;
+        s_put_varint(scale_column, s_zigzag(int64_t(p.scale) - prev_scale));
+        prev_scale = p.scale;
+    }
+
+    std::string out(SEGMENT_MAGIC);
+    out.push_back(char(SEGMENT_VERSION));
+    out.append(3, '\0');
+    s_put_u32(out, uint32_t(points.size()));
+    s_put_u32(out, uint32_t(ts_column.size()));
+    s_put_u32(out, uint32_t(value_column.size()));
+    s_put_u32(out, uint32_t(scale_column.size()));
+    out += ts_column;
+    out += value_column;
+    out += scale_column;
+    return out;
+}
+
+bool archive_decode(const uint8_t* data, size_t size, int64_t start, int64_t end, std::vector<ArchivePoint>& points)
+{
+    if (size < SEGMENT_HEADER_SIZE || memcmp(data, SEGMENT_MAGIC, 4) != 0 || data[4] != SEGMENT_VERSION) {
+        return false;
+    }
+    uint32_t count      = s_get_u32(data + 8);
+    uint32_t ts_size    = s_get_u32(data + 12);
+    uint32_t value_size = s_get_u32(data + 16);
+    uint32_t scale_size = s_get_u32(data + 20);
+    if (uint64_t(SEGMENT_HEADER_SIZE) + ts_size + value_size + scale_size != size) {
+        return false;
+    }
+
+    const uint8_t* p_ts      = data + SEGMENT_HEADER_SIZE;
+    const uint8_t* p_value   = p_ts + ts_size;
+    const uint8_t* p_scale   = p_value + value_size;
+    const uint8_t* end_ts    = p_value;
+    const uint8_t* end_value = p_scale;
+    const uint8_t* end_scale = data + size;
+
+    int64_t ts = 0, delta = 0, value = 0, scale = 0;
+    for (uint32_t i = 0; i != count; i++) {
+        uint64_t v_ts, v_value, v_scale;
+        if (!s_get_varint(p_ts, end_ts, v_ts) || !s_get_varint(p_value, end_value, v_value) ||
+            !s_get_varint(p_scale, end_scale, v_scale)) {
+            return false;
+        }
+        if (i == 0) {
+            ts = s_unzigzag(v_ts);
+        } else if (i == 1) {
+            delta = s_unzigzag(v_ts);
+            ts += delta;
+        } else {
+            delta += s_unzigzag(v_ts);
+            ts += delta;
+        }
+        value += s_unzigzag(v_value);
+        scale += s_unzigzag(v_scale);
+
+        if (ts > end) {
+            break; // sorted by timestamp
+        }
+        if (ts >= start) {
+            points.push_back({ts, m_msrmnt_value_t(value), m_msrmnt_scale_t(scale)});
+        }
+    }
+    return true;
+}
+
+//
+// files
+//
+
+// YYYYMM of the timestamp (UTC)
+static int s_month(int64_t timestamp)
+{
+    time_t    t = time_t(timestamp);
+    struct tm tm_info;
+    gmtime_r(&t, &tm_info);
+    return (tm_info.tm_year + 1900) * 100 + tm_info.tm_mon + 1;
+}
+
+// first second of the month YYYYMM (UTC)
+static int64_t s_month_start(int month)
+{
+    struct tm tm_info = {};
+    tm_info.tm_year   = month / 100 - 1900;
+    tm_info.tm_mon    = month % 100 - 1;
+    tm_info.tm_mday   = 1;
+    return int64_t(timegm(&tm_info));
+}
+
+static int64_t s_month_end(int month)
+{
+    int next = (month % 100 == 12) ? (month / 100 + 1) * 100 + 1 : month + 1;
+    return s_month_start(next) - 1;
+}
+
+// months of the segments in the topic directory, sorted
+static std::vector<int> s_list_segments(const std::string& topic_dir)
+{
+    std::vector<int> months;
+    DIR*             dir = opendir(topic_dir.c_str());
+    if (!dir) {
+        return months;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        int  month = 0;
+        char suffix[8];
+        if (sscanf(entry->d_name, "%6d%7s", &month, suffix) == 2 && streq(suffix, SEGMENT_SUFFIX)) {
+            months.push_back(month);
+        }
+    }
+    closedir(dir);
+    std::sort(months.begin(), months.end());
+    return months;
+}
+
+static std::string s_segment_path(const std::string& topic_dir, int month)
+{
+    return topic_dir + "/" + std::to_string(month) + SEGMENT_SUFFIX;
+}
+
+// missing or zero length segment (e.g. crash before its write) is an empty one
+static bool s_read_segment(const std::string& path, int64_t start, int64_t end, std::vector<ArchivePoint>& points)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    size_t size = size_t(st.st_size);
+    void*  data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    bool ok = archive_decode(static_cast<const uint8_t*>(data), size, start, end, points);
+    munmap(data, size);
+    return ok;
+}
+
+// merge points (sorted) into the segment, new points override the archived ones
+static bool s_write_segment(const std::string& topic_dir, int month, const std::vector<ArchivePoint>& points)
+{
+    std::string path = s_segment_path(topic_dir, month);
+
+    std::vector<ArchivePoint> archived;
+    if (!s_read_segment(path, INT64_MIN, INT64_MAX, archived)) {
+        log_error("archive segment '%s' is corrupted", path.c_str());
+        return false;
+    }
+
+    std::vector<ArchivePoint> merged;
+    merged.reserve(archived.size() + points.size());
+    auto a = archived.begin();
+    auto p = points.begin();
+    while (a != archived.end() || p != points.end()) {
+        if (p == points.end() || (a != archived.end() && a->timestamp < p->timestamp)) {
+            merged.push_back(*a++);
+        } else {
+            if (a != archived.end() && a->timestamp == p->timestamp) {
+                ++a;
+            }
+            merged.push_back(*p++);
+        }
+    }
+
+    std::string data = archive_encode(merged);
+    std::string tmp  = path + ".tmp";
+    FILE*       f    = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        log_error("can't create '%s': %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size() && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok      = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        log_error("can't write '%s': %s", path.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static void s_remove_dir(const std::string& path)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (!streq(entry->d_name, ".") && !streq(entry->d_name, "..")) {
+                unlink((path + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+}
+
+int archive_select(const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, int64_t& last)
+{
+    last = INT64_MIN;
+    if (!archive_enabled()) {
+        return 0;
+    }
+
+    std::string topic_dir = s_config().dir + "/" + topic_to_filename(topic);
+    for (int month : s_list_segments(topic_dir)) {
+        if (s_month_end(month) < start || s_month_start(month) > end) {
+            continue;
+        }
+        std::vector<ArchivePoint> points;
+        if (!s_read_segment(s_segment_path(topic_dir, month), start, end, points)) {
+            log_error("archive segment %d of topic '%s' is corrupted", month, topic.c_str());
+            return -1;
+        }
+        for (const auto& p : points) {
+            cb(p.timestamp, p.value, p.scale);
+            last = p.timestamp;
+        }
+    }
+    return 0;
+}
+
+void archive_delete_asset(const std::string& asset_name)
+{
+    if (!archive_enabled()) {
+        return;
+    }
+
+    std::string suffix = topic_to_filename("@" + asset_name);
+    DIR*        dir    = opendir(s_config().dir.c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<std::string> topics;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name(entry->d_name);
+        if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            topics.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    for (const auto& topic : topics) {
+        s_remove_dir(s_config().dir + "/" + topic);
+    }
+    log_debug("archive of %zu topic(s) of asset '%s' removed", topics.size(), asset_name.c_str());
+}
+
+// archive measurements of the topic within [start, end) (one month at most), returns
+// number of archived rows or -1
+static int64_t s_archive_month(tntdb::Connection& conn, m_msrmnt_tpc_id_t topic_id, const std::string& topic,
+    int64_t start, int64_t end, const std::function<bool()>& keep_going)
+{
+    tntdb::Statement st = conn.prepareCached(
+        " SELECT timestamp, value, scale "
+        " FROM t_bios_measurement "
+        " WHERE "
+        "   topic_id = :topic_id AND "
+        "   timestamp >= :start AND "
+        "   timestamp < :end "
+        " ORDER BY timestamp ASC ");
+
+    std::vector<ArchivePoint> points;
+    for (const auto& row : st.set("topic_id", topic_id).set("start", start).set("end", end).select()) {
+        ArchivePoint p;
+        row["timestamp"].get(p.timestamp);
+        row["value"].get(p.value);
+        row["scale"].get(p.scale);
+        points.push_back(p);
+    }
+    if (points.empty()) {
+        return 0;
+    }
+
+    std::string topic_dir = s_config().dir + "/" + topic_to_filename(topic);
+    if (zsys_dir_create("%s", topic_dir.c_str()) != 0) {
+        log_error("can't create '%s'", topic_dir.c_str());
+        return -1;
+    }
+    if (!s_write_segment(topic_dir, s_month(start), points)) {
+        return -1;
+    }
+
+    // only rows which are archived: late ones inserted meanwhile leave the month to the
+    // next run, which merges it again into the segment
+    tntdb::Statement st_count = conn.prepareCached(
+        " SELECT COUNT(*) "
+        " FROM t_bios_measurement "
+        " WHERE "
+        "   topic_id = :topic_id AND "
+        "   timestamp >= :start AND "
+        "   timestamp < :end ");
+    int64_t count = 0;
+    st_count.set("topic_id", topic_id).set("start", start).set("end", end).selectValue().get(count);
+    if (count != int64_t(points.size())) {
+        log_debug("measurements of topic '%s' inserted while archived -> month %d is kept in DB", topic.c_str(),
+            s_month(start));
+        return 0;
+    }
+
+    tntdb::Statement st_delete = conn.prepareCached(
+        " DELETE FROM t_bios_measurement "
+        " WHERE "
+        "   topic_id = :topic_id AND "
+        "   timestamp >= :start AND "
+        "   timestamp < :end "
+        " LIMIT :chunk ");
+    while (st_delete.set("topic_id", topic_id)
+               .set("start", start)
+               .set("end", end)
+               .set("chunk", DELETE_CHUNK_DEFAULT)
+               .execute() == DELETE_CHUNK_DEFAULT) {
+        // the rest is deleted by the next run
+        if (!keep_going()) {
+            break;
+        }
+    }
+    return int64_t(points.size());
+}
+
+// archive measurements of the topic older than horizon month by month, returns number
+// of archived rows or -1
+static int64_t s_archive_topic(tntdb::Connection& conn, m_msrmnt_tpc_id_t topic_id, const std::string& topic,
+    int64_t horizon, const std::function<bool()>& keep_going)
+{
+    tntdb::Statement st = conn.prepareCached(
+        " SELECT MIN(timestamp) "
+        " FROM t_bios_measurement "
+        " WHERE "
+        "   topic_id = :topic_id AND "
+        "   timestamp < :horizon ");
+    tntdb::Value oldest = st.set("topic_id", topic_id).set("horizon", horizon).selectValue();
+    if (oldest.isNull()) {
+        return 0;
+    }
+    int64_t start = 0;
+    oldest.get(start);
+
+    int64_t rows = 0;
+    while (start < horizon && keep_going()) {
+        int64_t end = std::min(s_month_end(s_month(start)) + 1, horizon);
+        int64_t r   = s_archive_month(conn, topic_id, topic, start, end, keep_going);
+        if (r < 0) {
+            return -1;
+        }
+        rows += r;
+        start = end;
+    }
+    return rows;
+}
+
+// remove segments older than the storage age of the step of the topic
+static void s_expire_segments(int64_t now)
+{
+    DIR* dir = opendir(s_config().dir.c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<std::string> topics;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            topics.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    for (const auto& escaped : topics) {
+        int age = retention_get_age(retention_topic_step(filename_to_topic(escaped).c_str()));
+        if (age < 0) {
+            continue; // unknown, keep it
+        }
+        std::string topic_dir = s_config().dir + "/" + escaped;
+        int64_t     limit     = now - int64_t(age) * SECONDS_PER_DAY;
+        for (int month : s_list_segments(topic_dir)) {
+            if (s_month_end(month) < limit) {
+                unlink(s_segment_path(topic_dir, month).c_str());
+                log_debug("archive segment %d of topic '%s' expired", month, escaped.c_str());
+            }
+        }
+    }
+}
+
+int archive_run(const std::string& url, int64_t now, const std::function<bool()>& keep_going)
+{
+    if (!archive_enabled()) {
+        return 0;
+    }
+
+    tntdb::Connection conn;
+    try {
+        conn = tntdb::connectCached(url);
+        conn.ping();
+    } catch (const std::exception& e) {
+        log_error("Can't connect to the database");
+        return -1;
+    }
+
+    const int64_t horizon = now - int64_t(s_config().age) * SECONDS_PER_DAY;
+    int64_t       rows    = 0;
+    int           rv      = 0;
+    try {
+        std::vector<std::pair<m_msrmnt_tpc_id_t, std::string>> topics;
+        tntdb::Statement                                       st = conn.prepareCached(
+            " SELECT id, topic "
+            " FROM t_bios_measurement_topic ");
+        for (const auto& row : st.select()) {
+            std::pair<m_msrmnt_tpc_id_t, std::string> topic;
+            row["id"].get(topic.first);
+            row["topic"].get(topic.second);
+            topics.push_back(topic);
+        }
+
+        for (const auto& topic : topics) {
+            if (!keep_going()) {
+                log_warning("interrupted while archiving measurements");
+                break;
+            }
+            int64_t r = s_archive_topic(conn, topic.first, topic.second, horizon, keep_going);
+            if (r < 0) {
+                log_error("measurements of topic '%s' are not archived", topic.second.c_str());
+                rv = -1;
+                continue;
+            }
+            rows += r;
+        }
+    } catch (const std::exception& e) {
+        log_error("Archive of measurements failed: %s", e.what());
+        rv = -1;
+    }
+    log_info("%" PRIi64 " measurements older than %" PRIi64 " archived", rows, horizon);
+
+    s_expire_segments(now);
+    return rv;
+}
+
+// reads the pipe, returns false on $TERM
+static bool s_pipe_recv(zsock_t* pipe)
+{
+    zmsg_t* message = zmsg_recv(pipe);
+    char*   cmd     = message ? zmsg_popstr(message) : nullptr;
+    bool    term    = !message || (cmd && streq(cmd, "$TERM"));
+    zstr_free(&cmd);
+    zmsg_destroy(&message);
+    return !term;
+}
+
+void fty_metric_store_archiver(zsock_t* pipe, void* args)
+{
+    assert(pipe);
+    assert(args);
+    const std::string& url = *static_cast<const std::string*>(args);
+
+    zpoller_t* poller = zpoller_new(pipe, nullptr);
+    assert(poller);
+
+    trace_thread_name("fty_metric_store_archiver");
+    log_info("fty_metric_store_archiver started");
+    zsock_signal(pipe, 0);
+
+    int timeout = ARCHIVE_START_DELAY;
+    while (!zsys_interrupted) {
+        void* which = zpoller_wait(poller, timeout);
+
+        if (which == pipe) {
+            if (!s_pipe_recv(pipe)) {
+                break;
+            }
+            continue;
+        }
+        if (zpoller_terminated(poller) || zsys_interrupted) {
+            break;
+        }
+
+        if (zpoller_expired(poller)) {
+            TraceSpan span("archive.run");
+            bool      term = false;
+            archive_run(url, int64_t(time(nullptr)), [pipe, &term]() {
+                while (!term && (zsock_events(pipe) & ZMQ_POLLIN)) {
+                    term = !s_pipe_recv(pipe);
+                }
+                return !term && !zsys_interrupted;
+            });
+            if (term) {
+                break;
+            }
+            timeout = ARCHIVE_INTERVAL;
+        }
+    }
+
+    zpoller_destroy(&poller);
+    log_info("fty_metric_store_archiver stopped");
+}
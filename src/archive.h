@@ -0,0 +1,71 @@
+/*  =========================================================================
+    archive - Cold tier of old measurements in compressed segment files
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "persistance.h"
+#include <czmq.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Measurements older than this age (in days) are moved from DB to the archive,
+// archive is disabled if unset or 0
+#define EV_DBSTORE_ARCHIVE_AGE "BIOS_DBSTORE_ARCHIVE_AGE"
+// Directory of the archive
+#define EV_DBSTORE_ARCHIVE_DIR "BIOS_DBSTORE_ARCHIVE_DIR"
+
+#define ARCHIVE_DIR_DEFAULT "/var/lib/fty/fty-metric-store/archive"
+#define ARCHIVE_START_DELAY (60 * 1000)       // ms
+#define ARCHIVE_INTERVAL    (6 * 3600 * 1000) // ms
+
+struct ArchivePoint
+{
+    int64_t          timestamp;
+    m_msrmnt_value_t value;
+    m_msrmnt_scale_t scale;
+};
+
+// Returns true if the archive is enabled
+bool archive_enabled();
+
+// Encodes points sorted by timestamp to a segment: header followed by columns of
+// delta-of-delta timestamps, delta values and delta scales (zigzag varints)
+std::string archive_encode(const std::vector<ArchivePoint>& points);
+
+// Decodes points of a segment with timestamp in [start, end], returns false on corrupted segment
+bool archive_decode(const uint8_t* data, size_t size, int64_t start, int64_t end, std::vector<ArchivePoint>& points);
+
+// Calls 'cb' on archived points of the topic within [start, end] ordered by timestamp,
+// sets 'last' to the timestamp of the last archived point (or to INT64_MIN).
+// Returns 0 on success, -1 otherwise
+int archive_select(const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, int64_t& last);
+
+// Removes archived points of all topics of the asset
+void archive_delete_asset(const std::string& asset_name);
+
+// Moves measurements older than the archive age from DB to the archive, one month of a
+// topic at a time, removes segments older than the storage age of their step. Stops
+// between months and delete chunks when 'keep_going' returns false, the rest is
+// archived by the next run
+int archive_run(const std::string& url, int64_t now, const std::function<bool()>& keep_going);
+
+//  Archive actor, runs archive_run() periodically, 'args' is the DB url (const std::string*)
+void fty_metric_store_archiver(zsock_t* pipe, void* args);
@@ -0,0 +1,152 @@
+/*  =========================================================================
+    asset_delete - Background deletion of the measurements of deleted assets
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    asset_delete - Background deletion of the measurements of deleted assets
+@discuss
+    Deleting measurements of an asset may take long on big tables, so it is
+    done out of the main actor. Assets deleted in a burst (e.g. a whole rack)
+    are coalesced and deleted from every storage backend together. In MySQL
+    their topics are looked up with one indexed query, their measurements are
+    deleted in bounded chunks by topic_id, then the topics are deleted.
+@end
+*/
+
+#include "asset_delete.h"
+#include "memory_account.h"
+#include "persistance.h"
+#include "trace.h"
+#include <fty_log.h>
+#include <set>
+
+// accounted to "pending_deletes", over the cap new deletes are not coalesced and the ones
+// received during a deletion are dropped (the server never blocks on the pipe)
+static MemoryAccount& g_memory = memory_account("pending_deletes");
+
+static size_t s_pending_bytes(const std::string& name)
+{
+    return MEMORY_TREE_NODE + sizeof(std::string) + memory_string(name);
+}
+
+static void s_pending_clear(std::set<std::string>& pending)
+{
+    for (const auto& name : pending) {
+        g_memory.sub(s_pending_bytes(name));
+    }
+    pending.clear();
+}
+
+// reads the pipe without blocking, returns false on $TERM. Over the cap, stops reading
+// to delete the pending assets, or drops the new deletes during a deletion.
+static bool s_pipe_recv(zsock_t* pipe, std::set<std::string>& pending, bool deleting)
+{
+    while ((deleting || !g_memory.over_cap()) && (zsock_events(pipe) & ZMQ_POLLIN)) {
+        zmsg_t* message = zmsg_recv(pipe);
+        if (!message) {
+            return false;
+        }
+        char* cmd  = zmsg_popstr(message);
+        bool  term = cmd && streq(cmd, "$TERM");
+        if (cmd && streq(cmd, "DELETE")) {
+            char* name = zmsg_popstr(message);
+            if (name && g_memory.over_cap() && pending.count(name) == 0) {
+                log_error("pending deletes are over the memory cap -> measurements of '%s' are not deleted", name);
+                g_memory.evicted();
+            } else if (name) {
+                if (pending.insert(name).second) {
+                    g_memory.add(s_pending_bytes(name));
+                }
+            } else {
+                log_error("Expected multipart string format: DELETE/asset_name. Received DELETE/nullptr");
+            }
+            zstr_free(&name);
+        } else if (!term) {
+            log_warning("Command '%s' is unknown or not implemented", cmd ? cmd : "nullptr");
+        }
+        zstr_free(&cmd);
+        zmsg_destroy(&message);
+        if (term) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns false on $TERM
+static bool s_delete_assets(
+    zsock_t* pipe, const std::string& url, const std::vector<std::string>& assets, std::set<std::string>& pending)
+{
+    TraceSpan span("asset.delete");
+    bool      term = false;
+    delete_measurements(url, assets, [pipe, &pending, &term]() {
+        // stay responsive, new deletes are coalesced in the next round
+        term = zsys_interrupted || !s_pipe_recv(pipe, pending, true);
+        return !term;
+    });
+    return !term;
+}
+
+void fty_metric_store_asset_delete(zsock_t* pipe, void* args)
+{
+    assert(pipe);
+    assert(args);
+    const std::string& url = *static_cast<const std::string*>(args);
+
+    zpoller_t* poller = zpoller_new(pipe, nullptr);
+    assert(poller);
+
+    trace_thread_name("fty_metric_store_asset_delete");
+    log_info("fty_metric_store_asset_delete started");
+    zsock_signal(pipe, 0);
+
+    std::set<std::string> pending;
+    while (!zsys_interrupted) {
+        void* which = zpoller_wait(poller, pending.empty() ? -1 : DELETE_COALESCE_DELAY);
+
+        if (which == pipe) {
+            if (!s_pipe_recv(pipe, pending, false)) {
+                break;
+            }
+            if (pending.size() < DELETE_COALESCE_MAX && !g_memory.over_cap()) {
+                continue;
+            }
+        } else if (zpoller_terminated(poller) || zsys_interrupted) {
+            break;
+        }
+
+        if (!pending.empty()) {
+            std::vector<std::string> assets(pending.begin(), pending.end());
+            s_pending_clear(pending);
+            if (!s_delete_assets(pipe, url, assets, pending)) {
+                break;
+            }
+        }
+    }
+
+    if (!pending.empty()) {
+        log_warning("%zu asset(s) not deleted", pending.size());
+        s_pending_clear(pending);
+    }
+
+    zpoller_destroy(&poller);
+    log_info("fty_metric_store_asset_delete stopped");
+}
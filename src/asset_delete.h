@@ -0,0 +1,38 @@
+/*  =========================================================================
+    asset_delete - Background deletion of the measurements of deleted assets
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <czmq.h>
+
+// deletes received within this delay are processed together
+#define DELETE_COALESCE_DELAY 1000 // ms
+// ... unless there are already so many pending ones
+#define DELETE_COALESCE_MAX 500
+
+//  Asset delete actor, 'args' is the DB url (const std::string*)
+//
+//  Supported actor commands:
+//  $TERM
+//      terminate
+//
+//  DELETE/asset_name
+//      delete all topics and measurements of the asset
+void fty_metric_store_asset_delete(zsock_t* pipe, void* args);
@@ -0,0 +1,97 @@
+/*  =========================================================================
+    bench_util - Helpers shared by the benchmark tools
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// bench_util - Helpers shared by the benchmark tools
+
+#include "bench_util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+uint64_t BenchRandom::next()
+{
+    uint64_t z = (_state += 0x9e3779b97f4a7c15ULL);
+    z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z          = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+double BenchRandom::uniform()
+{
+    return double(next() >> 11) / double(1ULL << 53);
+}
+
+uint64_t BenchRandom::below(uint64_t n)
+{
+    return n == 0 ? 0 : next() % n;
+}
+
+void BenchLatency::add(std::chrono::steady_clock::duration duration)
+{
+    _samples.push_back(std::chrono::duration<double, std::micro>(duration).count());
+    _sorted = false;
+}
+
+void BenchLatency::merge(const BenchLatency& other)
+{
+    _samples.insert(_samples.end(), other._samples.begin(), other._samples.end());
+    _sorted = false;
+}
+
+double BenchLatency::percentile(double p)
+{
+    if (_samples.empty()) {
+        return 0;
+    }
+    if (!_sorted) {
+        std::sort(_samples.begin(), _samples.end());
+        _sorted = true;
+    }
+    // nearest rank
+    size_t rank = size_t(std::ceil(p * double(_samples.size())));
+    return _samples[std::min(std::max(rank, size_t(1)), _samples.size()) - 1];
+}
+
+std::string BenchLatency::json()
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "{\"count\":%zu,\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}",
+        _samples.size(), percentile(0.5), percentile(0.99), percentile(0.999), percentile(1));
+    return buffer;
+}
+
+std::string bench_json_string(const std::string& string)
+{
+    std::string quoted = "\"";
+    for (char c : string) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (uint8_t(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
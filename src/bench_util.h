@@ -0,0 +1,68 @@
+/*  =========================================================================
+    bench_util - Helpers shared by the benchmark tools
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Deterministic pseudo random generator (splitmix64), same seed gives the same workload
+class BenchRandom
+{
+public:
+    explicit BenchRandom(uint64_t seed)
+        : _state(seed)
+    {
+    }
+
+    uint64_t next();
+    // uniform in [0, 1)
+    double uniform();
+    // uniform in [0, n)
+    uint64_t below(uint64_t n);
+
+private:
+    uint64_t _state;
+};
+
+// Latency samples, in microseconds
+class BenchLatency
+{
+public:
+    void add(std::chrono::steady_clock::duration duration);
+    void merge(const BenchLatency& other);
+    size_t count() const
+    {
+        return _samples.size();
+    }
+    // p in [0, 1], e.g. 0.999
+    double percentile(double p);
+    // {"count":..,"p50":..,"p99":..,"p999":..,"max":..}
+    std::string json();
+
+private:
+    std::vector<double> _samples;
+    bool                _sorted = true;
+};
+
+// Quotes and escapes a string for JSON
+std::string bench_json_string(const std::string& string);
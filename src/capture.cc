@@ -0,0 +1,284 @@
+/*  =========================================================================
+    capture - Capture of the incoming traffic to a binary log
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// capture - Capture of the incoming traffic to a binary log
+
+#include "capture.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fty_log.h>
+#include <mutex>
+
+#define CAPTURE_HEADER_SIZE 8
+#define CAPTURE_RECORD_MAX  (64 * 1024 * 1024) // bytes, larger sizes are corrupted records
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+int CaptureWriter::open(const std::string& path)
+{
+    close();
+    _file = fopen(path.c_str(), "wb");
+    if (!_file) {
+        log_error("can't create capture file '%s': %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+    uint32_t version = CAPTURE_VERSION;
+    if (fwrite(CAPTURE_MAGIC, 4, 1, _file) != 1 || fwrite(&version, sizeof(version), 1, _file) != 1) {
+        log_error("can't write capture file '%s': %s", path.c_str(), strerror(errno));
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+int CaptureWriter::write(const CaptureRecord& record)
+{
+    if (!_file) {
+        return -1;
+    }
+    if (record.address.size() > UINT16_MAX || record.subject.size() > UINT16_MAX) {
+        log_error("capture: address or subject too long, record dropped");
+        return -1;
+    }
+
+    uint8_t  kind         = uint8_t(record.kind);
+    uint16_t address_size = uint16_t(record.address.size());
+    uint16_t subject_size = uint16_t(record.subject.size());
+    uint32_t size         = uint32_t(sizeof(kind) + sizeof(record.time_us) + sizeof(address_size) +
+                             record.address.size() + sizeof(subject_size) + record.subject.size() +
+                             record.payload.size());
+
+    bool ok = fwrite(&size, sizeof(size), 1, _file) == 1 && fwrite(&kind, sizeof(kind), 1, _file) == 1 &&
+              fwrite(&record.time_us, sizeof(record.time_us), 1, _file) == 1 &&
+              fwrite(&address_size, sizeof(address_size), 1, _file) == 1 &&
+              fwrite(record.address.data(), 1, record.address.size(), _file) == record.address.size() &&
+              fwrite(&subject_size, sizeof(subject_size), 1, _file) == 1 &&
+              fwrite(record.subject.data(), 1, record.subject.size(), _file) == record.subject.size() &&
+              fwrite(record.payload.data(), 1, record.payload.size(), _file) == record.payload.size();
+    if (!ok) {
+        log_error("capture: write failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void CaptureWriter::close()
+{
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+CaptureReader::~CaptureReader()
+{
+    close();
+}
+
+int CaptureReader::open(const std::string& path)
+{
+    close();
+    _file = fopen(path.c_str(), "rb");
+    if (!_file) {
+        log_error("can't open capture file '%s': %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+    char     magic[4];
+    uint32_t version = 0;
+    if (fread(magic, 4, 1, _file) != 1 || memcmp(magic, CAPTURE_MAGIC, 4) != 0 ||
+        fread(&version, sizeof(version), 1, _file) != 1 || version != CAPTURE_VERSION) {
+        log_error("'%s' is not a capture file of version %d", path.c_str(), CAPTURE_VERSION);
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+// reads a u16 sized string out of 'data', advances 'pos'
+static bool s_read_string(const std::string& data, size_t& pos, std::string& value)
+{
+    uint16_t size;
+    if (pos + sizeof(size) > data.size()) {
+        return false;
+    }
+    memcpy(&size, data.data() + pos, sizeof(size));
+    pos += sizeof(size);
+    if (pos + size > data.size()) {
+        return false;
+    }
+    value.assign(data, pos, size);
+    pos += size;
+    return true;
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+    if (!_file) {
+        return false;
+    }
+    uint32_t size;
+    if (fread(&size, sizeof(size), 1, _file) != 1) {
+        return false;
+    }
+    if (size > CAPTURE_RECORD_MAX) {
+        log_error("capture: corrupted record of %u bytes", size);
+        return false;
+    }
+    std::string data(size, '\0');
+    if (fread(&data[0], 1, size, _file) != size) {
+        log_warning("capture: truncated record at the end of the file");
+        return false;
+    }
+
+    uint8_t kind;
+    size_t  pos = 0;
+    if (size < sizeof(kind) + sizeof(record.time_us)) {
+        return false;
+    }
+    memcpy(&kind, data.data(), sizeof(kind));
+    pos += sizeof(kind);
+    memcpy(&record.time_us, data.data() + pos, sizeof(record.time_us));
+    pos += sizeof(record.time_us);
+    record.kind = kind;
+    if (!s_read_string(data, pos, record.address) || !s_read_string(data, pos, record.subject)) {
+        log_error("capture: corrupted record");
+        return false;
+    }
+    record.payload.assign(data, pos, std::string::npos);
+    return true;
+}
+
+void CaptureReader::close()
+{
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+//
+// capture of the server
+//
+
+// written by the server and the pull actors, 'g_capturing' avoids the lock when not capturing
+static std::mutex        g_capture_mutex;
+static CaptureWriter     g_capture;
+static std::atomic<bool> g_capturing(false);
+
+int capture_start(const char* path)
+{
+    std::lock_guard<std::mutex> lock(g_capture_mutex);
+    if (g_capture.open(path) != 0) {
+        g_capturing = false;
+        return -1;
+    }
+    g_capturing = true;
+    log_info("capture the incoming traffic to %s", path);
+    return 0;
+}
+
+static void s_capture_stop()
+{
+    if (g_capture.is_open()) {
+        g_capture.close();
+        log_info("capture stopped");
+    }
+    g_capturing = false;
+}
+
+void capture_stop()
+{
+    std::lock_guard<std::mutex> lock(g_capture_mutex);
+    s_capture_stop();
+}
+
+static int64_t s_now_us()
+{
+    return int64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+static void s_encode(zmsg_t* message, std::string& payload)
+{
+    zframe_t* frame = zmsg_encode(message);
+    if (frame) {
+        payload.assign(reinterpret_cast<const char*>(zframe_data(frame)), zframe_size(frame));
+        zframe_destroy(&frame);
+    }
+}
+
+static void s_write(const CaptureRecord& record)
+{
+    if (g_capture.write(record) != 0) {
+        // disk full or so, don't retry each message
+        s_capture_stop();
+    }
+}
+
+void capture_message(CaptureKind kind, const char* address, const char* subject, zmsg_t* message)
+{
+    if (!g_capturing || !message) {
+        return;
+    }
+
+    CaptureRecord record;
+    record.kind    = kind;
+    record.time_us = s_now_us();
+    record.address = address ? address : "";
+    record.subject = subject ? subject : "";
+    s_encode(message, record.payload);
+
+    std::lock_guard<std::mutex> lock(g_capture_mutex);
+    s_write(record);
+}
+
+void capture_shm_metrics(const std::vector<fty_proto_t*>& metrics)
+{
+    if (!g_capturing) {
+        return;
+    }
+
+    std::vector<CaptureRecord> records(metrics.size());
+    int64_t                    now = s_now_us();
+    for (size_t i = 0; i != metrics.size(); i++) {
+        records[i].kind    = CAPTURE_SHM;
+        records[i].time_us = now;
+        records[i].subject = std::string(fty_proto_type(metrics[i])) + "@" + fty_proto_name(metrics[i]);
+        fty_proto_t* copy  = fty_proto_dup(metrics[i]);
+        zmsg_t*      msg   = fty_proto_encode(&copy);
+        if (msg) {
+            s_encode(msg, records[i].payload);
+            zmsg_destroy(&msg);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(g_capture_mutex);
+    for (const auto& record : records) {
+        if (!g_capture.is_open()) {
+            break;
+        }
+        s_write(record);
+    }
+}
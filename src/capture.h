@@ -0,0 +1,101 @@
+/*  =========================================================================
+    capture - Capture of the incoming traffic to a binary log
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <czmq.h>
+#include <fty_proto.h>
+#include <string>
+#include <vector>
+
+// Captures the incoming traffic of the agent to this file when set
+#define EV_DBSTORE_CAPTURE "BIOS_DBSTORE_CAPTURE"
+
+#define CAPTURE_MAGIC   "FMSC"
+#define CAPTURE_VERSION 1
+
+enum CaptureKind
+{
+    CAPTURE_STREAM  = 1, // address is the stream
+    CAPTURE_MAILBOX = 2, // address is the sender
+    CAPTURE_SHM     = 3, // metric read from shm, subject is its topic (type@name)
+};
+
+// One received message, payload is the encoded zmsg (zmsg_encode), of the encoded
+// fty_proto metric for the ones read from shm
+struct CaptureRecord
+{
+    int         kind    = 0;
+    int64_t     time_us = 0; // arrival time (wall clock)
+    std::string address;
+    std::string subject;
+    std::string payload;
+};
+
+// Log file: magic and version, then records
+//   u32 size of the record, u8 kind, i64 time_us,
+//   u16 size + address, u16 size + subject, payload
+class CaptureWriter
+{
+public:
+    ~CaptureWriter();
+
+    // Creates the file, returns 0 on success, -1 otherwise
+    int  open(const std::string& path);
+    int  write(const CaptureRecord& record);
+    void close();
+    bool is_open() const
+    {
+        return _file != nullptr;
+    }
+
+private:
+    FILE* _file = nullptr;
+};
+
+class CaptureReader
+{
+public:
+    ~CaptureReader();
+
+    // Opens the file and checks the header, returns 0 on success, -1 otherwise
+    int open(const std::string& path);
+    // Reads the next record, returns false at the end of the file or on a truncated record
+    bool next(CaptureRecord& record);
+    void close();
+
+private:
+    FILE* _file = nullptr;
+};
+
+// Capture of the agent, called from the server and the pull actors
+
+// Starts capturing to the file (replaces the current capture), returns 0 on success, -1 otherwise
+int capture_start(const char* path);
+
+// Stops capturing, flushes the file
+void capture_stop();
+
+// Writes the message to the capture if started, the message is not modified
+void capture_message(CaptureKind kind, const char* address, const char* subject, zmsg_t* message);
+
+// Writes the metrics read from shm (kept by the filter) to the capture if started,
+// the metrics are not modified
+void capture_shm_metrics(const std::vector<fty_proto_t*>& metrics);
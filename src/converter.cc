@@ -28,6 +28,7 @@
 
 #include "converter.h"
 #include <cmath>
+#include <cstring>
 #include <fty_log.h>
 #include <inttypes.h>
 #include <stdexcept>
@@ -171,3 +172,58 @@ bool stobiosf_wrapper(const std::string& string, int32_t& integer, int8_t& scale
     }
     return stobiosf(stripped, integer, scale);
 }
+
+bool string_to_measurement(const char* value, int32_t& integer, int16_t& scale)
+{
+    if (!strchr(value, '.')) {
+        int64_t result = string_to_int64(value);
+        if (errno != 0) {
+            errno = 0;
+            log_error("value '%s' of the metric is not integer", value);
+            return false;
+        }
+        integer = int32_t(result);
+        scale   = 0;
+        return true;
+    }
+
+    int8_t lscale = 0;
+    if (!stobiosf_wrapper(value, integer, lscale)) {
+        log_error("value '%s' of the metric is not double", value);
+        return false;
+    }
+    scale = lscale;
+    return true;
+}
+
+std::string topic_to_filename(const std::string& name)
+{
+    std::string escaped;
+    for (char c : name) {
+        if (c == '/') {
+            escaped += "%2F";
+        } else if (c == '%') {
+            escaped += "%25";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string filename_to_topic(const std::string& escaped)
+{
+    std::string name;
+    for (size_t i = 0; i < escaped.size(); i++) {
+        if (escaped[i] == '%' && escaped.compare(i, 3, "%2F") == 0) {
+            name += '/';
+            i += 2;
+        } else if (escaped[i] == '%' && escaped.compare(i, 3, "%25") == 0) {
+            name += '%';
+            i += 2;
+        } else {
+            name += escaped[i];
+        }
+    }
+    return name;
+}
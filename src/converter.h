@@ -30,3 +30,12 @@
 bool stobiosf(const std::string& string, int32_t& integer, int8_t& scale);
 int64_t string_to_int64(const char* value);
 bool stobiosf_wrapper(const std::string& string, int32_t& integer, int8_t& scale);
+
+// Parses the value of a metric (integer or decimal) to integer x 10^scale,
+// returns false (and logs) if the value can't be stored
+bool string_to_measurement(const char* value, int32_t& integer, int16_t& scale);
+
+// Escapes '/' and '%' of the topic, so it can be used as a file name
+std::string topic_to_filename(const std::string& topic);
+// Reverse of topic_to_filename()
+std::string filename_to_topic(const std::string& filename);
@@ -0,0 +1,205 @@
+/*  =========================================================================
+    db_io - Database requests of the server actor run by I/O threads
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    db_io - Database requests of the server actor run by I/O threads
+@discuss
+    The owner sends RUN/<request> to the I/O actor, which runs the work and
+    sends the request back on its pipe. The owner keeps the requests until they
+    come back: a request timed out is completed by the owner, but freed only
+    once the I/O thread is done with it.
+@end
+*/
+
+#include "db_io.h"
+#include "stats.h"
+#include "trace.h"
+#include <chrono>
+#include <fty_log.h>
+#include <inttypes.h>
+
+static StatsGauge&     g_in_flight = stats_gauge("db_io.in_flight");
+static StatsCounter&   g_timeouts  = stats_counter("db_io.timeouts");
+static StatsHistogram& g_duration  = stats_histogram("db_io.duration_us");
+
+struct DbIoRequest
+{
+    const char*                           name;
+    db_io_work_t                          work;
+    db_io_done_t                          done;
+    std::chrono::steady_clock::time_point submitted;
+    uint64_t                              deadline  = 0; // zclock_mono(), 0 for none
+    bool                                  timed_out = false;
+};
+
+static uint64_t s_elapsed_us(const DbIoRequest& request)
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - request.submitted).count());
+}
+
+// 'args' is the stopping flag of the owner: queued requests are dropped once it is set
+static void s_db_io_actor(zsock_t* pipe, void* args)
+{
+    const std::atomic<bool>& stopping = *static_cast<const std::atomic<bool>*>(args);
+
+    trace_thread_name("fty_metric_store_db_io");
+    zsock_signal(pipe, 0);
+
+    while (!zsys_interrupted) {
+        char*        cmd     = nullptr;
+        DbIoRequest* request = nullptr;
+        if (zsock_recv(pipe, "sp", &cmd, &request) != 0 || !cmd) {
+            break;
+        }
+        bool term = streq(cmd, "$TERM");
+        zstr_free(&cmd);
+        if (term) {
+            break;
+        }
+        if (!request || stopping) {
+            continue;
+        }
+        {
+            TraceSpan span(request->name);
+            request->work();
+        }
+        zsock_send(pipe, "p", request);
+    }
+}
+
+DbIo::DbIo(int threads)
+{
+    for (int i = 0; i < threads; i++) {
+        Thread thread;
+        thread.actor = zactor_new(s_db_io_actor, &_stopping);
+        if (!thread.actor) {
+            log_error("zactor_new () failed");
+            continue;
+        }
+        _threads.push_back(thread);
+    }
+}
+
+DbIo::~DbIo()
+{
+    _stopping = true;
+    for (auto& thread : _threads) {
+        zactor_destroy(&thread.actor);
+    }
+    g_in_flight.add(-int64_t(_requests.size()));
+}
+
+void DbIo::submit(const char* name, db_io_work_t work, db_io_done_t done, int timeout)
+{
+    if (_threads.empty()) {
+        // no I/O thread, blocks the owner
+        work();
+        done(false);
+        return;
+    }
+
+    size_t thread = 0;
+    for (size_t i = 1; i < _threads.size(); i++) {
+        if (_threads[i].pending < _threads[thread].pending) {
+            thread = i;
+        }
+    }
+
+    std::unique_ptr<DbIoRequest> request(new DbIoRequest());
+    request->name      = name;
+    request->work      = std::move(work);
+    request->done      = std::move(done);
+    request->submitted = std::chrono::steady_clock::now();
+    request->deadline  = timeout > 0 ? uint64_t(zclock_mono()) + uint64_t(timeout) : 0;
+
+    DbIoRequest* r = request.get();
+    _requests.emplace(r, std::move(request));
+    _threads[thread].pending++;
+    g_in_flight.add(1);
+    zsock_send(_threads[thread].actor, "sp", "RUN", r);
+}
+
+void DbIo::add_to(zpoller_t* poller)
+{
+    for (auto& thread : _threads) {
+        zpoller_add(poller, thread.actor);
+    }
+}
+
+bool DbIo::dispatch(void* which)
+{
+    for (auto& thread : _threads) {
+        if (which != thread.actor) {
+            continue;
+        }
+        DbIoRequest* r = nullptr;
+        if (zsock_recv(thread.actor, "p", &r) != 0 || !r) {
+            return true;
+        }
+        auto it = _requests.find(r);
+        if (it == _requests.end()) {
+            log_error("unknown completion of a DB request");
+            return true;
+        }
+        std::unique_ptr<DbIoRequest> request = std::move(it->second);
+        _requests.erase(it);
+        thread.pending--;
+        g_in_flight.add(-1);
+
+        uint64_t duration = s_elapsed_us(*request);
+        g_duration.add(duration);
+        if (request->timed_out) {
+            log_info("%s completed after its timeout (%" PRIu64 " ms)", request->name, duration / 1000);
+        } else {
+            request->done(false);
+        }
+        return true;
+    }
+    return false;
+}
+
+int DbIo::expire(int max)
+{
+    uint64_t                   now  = uint64_t(zclock_mono());
+    uint64_t                   next = now + uint64_t(max);
+    std::vector<DbIoRequest*> expired;
+    for (auto& it : _requests) {
+        DbIoRequest& request = *it.second;
+        if (!request.deadline || request.timed_out) {
+            continue;
+        }
+        if (request.deadline <= now) {
+            expired.push_back(&request);
+        } else if (request.deadline < next) {
+            next = request.deadline;
+        }
+    }
+    // completions may submit requests
+    for (auto request : expired) {
+        log_warning("%s timed out after %" PRIu64 " ms", request->name, s_elapsed_us(*request) / 1000);
+        request->timed_out = true;
+        g_timeouts.add();
+        request->done(true);
+    }
+    return int(next - now);
+}
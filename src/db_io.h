@@ -0,0 +1,88 @@
+/*  =========================================================================
+    db_io - Database requests of the server actor run by I/O threads
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <atomic>
+#include <czmq.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Number of DB I/O threads of the server actor [2], each one with its own connection
+#define EV_DBSTORE_DB_IO_THREADS "BIOS_DBSTORE_DB_IO_THREADS"
+// Timeout (in ms) of the GET requests [30000], 0 disables it
+#define EV_DBSTORE_DB_IO_TIMEOUT "BIOS_DBSTORE_DB_IO_TIMEOUT"
+
+#define DB_IO_THREADS_DEFAULT 2
+#define DB_IO_THREADS_MAX     16
+#define DB_IO_TIMEOUT_DEFAULT 30000 // ms
+
+// Blocking database calls, run by an I/O thread
+typedef std::function<void()> db_io_work_t;
+// Completion, called by the owner thread once the work is done, or with 'timed_out' when
+// the work did not complete in time (its completion is then dropped)
+typedef std::function<void(bool timed_out)> db_io_done_t;
+
+struct DbIoRequest;
+
+// Runs the database requests of an actor on I/O threads, so its zpoller loop does not block
+// on the database. Several requests are in flight at once (one running per thread, the other
+// ones queued to the least busy thread). The completions are signalled by the pipes of the
+// I/O threads, watched by the zpoller of the owner, which calls dispatch() then.
+class DbIo
+{
+public:
+    explicit DbIo(int threads);
+    // drops the queued requests and waits for the running ones, their completions are not called
+    ~DbIo();
+    DbIo(const DbIo&) = delete;
+    DbIo& operator=(const DbIo&) = delete;
+
+    // Queues the work, 'timeout' in ms (0 for none). Owner thread only
+    void submit(const char* name, db_io_work_t work, db_io_done_t done, int timeout);
+
+    // Adds the pipes of the I/O threads to the poller
+    void add_to(zpoller_t* poller);
+
+    // If 'which' is the pipe of an I/O thread, calls the completion of its request and returns true
+    bool dispatch(void* which);
+
+    // Calls the completions of the requests past their timeout, returns the ms until the next
+    // timeout (at most 'max')
+    int expire(int max);
+
+    size_t in_flight() const
+    {
+        return _requests.size();
+    }
+
+private:
+    struct Thread
+    {
+        zactor_t* actor   = nullptr;
+        size_t    pending = 0; // requests queued or running
+    };
+
+    std::atomic<bool>                                    _stopping{false};
+    std::vector<Thread>                                  _threads;
+    std::map<DbIoRequest*, std::unique_ptr<DbIoRequest>> _requests;
+};
@@ -22,12 +22,18 @@
  * \file dbstore_bench.cc
  * \author Gerald Guillaume <GeraldGuillaume@Eaton.com>
  * \brief do intensive and endurance insertion job
+ *
+ * Drives the ingest path (value parsing, topic resolution, multi row cache,
+ * flush) with a deterministic workload and reports rows/s and latencies.
  */
+#include "bench_util.h"
+#include "converter.h"
+#include "persistance.h"
+#include <czmq.h>
+#include <fty_log.h>
 #include <getopt.h>
-#include <ctime>
-#include "fty_metric_store_classes.h"
-
-using namespace std;
+#include <inttypes.h>
+#include <sstream>
 
 /**
  *  \brief A connection string to the database
@@ -42,121 +48,248 @@ static std::string url =
     ((getenv("DB_PASSWD") == NULL) ? ""     :
     std::string(";password=") + getenv("DB_PASSWD"));
 
-long get_clock_ms(){
-    struct timeval time;
-    gettimeofday(&time, NULL); // Get Time
-    return (time.tv_sec * 1000) + (time.tv_usec / 1000);
+typedef std::chrono::steady_clock bench_clock;
+
+struct Workload
+{
+    int                      assets           = 100;
+    int                      topics_per_asset = 10;
+    std::vector<std::string> steps            = {"15m"};
+    std::string              values           = "walk"; // constant, uniform, walk or integer
+    double                   duplicates       = 0;      // ratio of rows reusing the last timestamp of the topic
+    int64_t                  rows             = 100000;
+    int                      batch            = 1000; // rows between flushes
+    uint64_t                 seed             = 1;
+    int64_t                  start            = 1600000000;
+    int                      delay            = 0;  // ms between rows
+    int                      periodic         = 10; // s between progress lines
+    int                      minutes          = -1; // duration limit
+};
+
+struct BenchTopic
+{
+    std::string topic;
+    std::string device_name;
+    int64_t     interval;
+    int64_t     next_ts;
+    int64_t     last_ts;
+    double      last_value;
+};
+
+// step length in seconds, RT is sampled every 5 seconds
+static int64_t s_step_seconds(const std::string& step)
+{
+    if (step == "RT") {
+        return 5;
+    }
+    int64_t n    = atoll(step.c_str());
+    char    unit = step.empty() ? 'm' : step.back();
+    switch (unit) {
+        case 'm':
+            return n * 60;
+        case 'h':
+            return n * 3600;
+        case 'd':
+            return n * 24 * 3600;
+        default:
+            return n;
+    }
 }
 
-char clock_fmt[26];
-char *get_clock_fmt(){
-    time_t timer;
-    struct tm* tm_info;
-    time(&timer);
-    tm_info = localtime(&timer);
-    strftime(clock_fmt, 26, "%Y-%m-%d %H:%M:%S", tm_info);
-    return clock_fmt; // ZZZ global ref
+static std::vector<BenchTopic> s_topics(const Workload& w)
+{
+    std::vector<BenchTopic> topics;
+    for (int a = 0; a < w.assets; a++) {
+        std::string device_name = "bench.asset" + std::to_string(a);
+        for (int t = 0; t < w.topics_per_asset; t++) {
+            for (const auto& step : w.steps) {
+                BenchTopic bt;
+                bt.topic = "bench.topic" + std::to_string(t);
+                if (step != "RT") {
+                    bt.topic += "_avg_" + step;
+                }
+                bt.topic += "@" + device_name;
+                bt.device_name = device_name;
+                bt.interval    = s_step_seconds(step);
+                bt.next_ts     = w.start;
+                bt.last_ts     = -1;
+                bt.last_value  = 100;
+                topics.push_back(bt);
+            }
+        }
+    }
+    return topics;
 }
 
-/* Insert one measurement on a random device, a random topic and a random value
- */
-void insert_new_measurement(
-        int device_id,
-        int topic_id,
-        tntdb::Connection conn
-        //persist::TopicCache &cache,
-        //persist::MultiRowCache &multi_row
-){
-    char topic_name[32];
-    char device_name[32];
-
-    snprintf(device_name,32,"bench.asset%d",device_id);
-    snprintf(topic_name,32,"bench.topic%d@%s",topic_id,device_name);
-
-    insert_into_measurement(
-            conn, topic_name, rand() % 999999, 0, time(NULL),
-            "%", device_name);
+static std::string s_next_value(const Workload& w, BenchRandom& random, BenchTopic& topic)
+{
+    char value[32];
+    if (w.values == "constant") {
+        return "42.5";
+    } else if (w.values == "uniform") {
+        snprintf(value, sizeof(value), "%.2f", random.uniform() * 1000);
+    } else if (w.values == "integer") {
+        snprintf(value, sizeof(value), "%" PRIu64, random.below(1000000));
+    } else {
+        topic.last_value += (random.uniform() - 0.5) * 2;
+        snprintf(value, sizeof(value), "%.2f", topic.last_value);
+    }
+    return value;
+}
 
+static std::string s_workload_json(const Workload& w)
+{
+    std::string steps;
+    for (const auto& step : w.steps) {
+        steps += (steps.empty() ? "" : ",") + bench_json_string(step);
+    }
+    std::ostringstream json;
+    json << "{\"assets\":" << w.assets << ",\"topics_per_asset\":" << w.topics_per_asset << ",\"steps\":[" << steps
+         << "],\"values\":" << bench_json_string(w.values) << ",\"duplicates\":" << w.duplicates
+         << ",\"rows\":" << w.rows << ",\"batch\":" << w.batch << ",\"seed\":" << w.seed << "}";
+    return json.str();
 }
 
 /*
- * do the bench insertion
- * \param delay       - pause between each insertion (in ms), 0 means no delay
- * \param num_device  - number of simulated device
- * \param topic_per_device  - number of topic per device simulated
- * \param total_duration    - bench duration in minute, -1 means infinite loop
- * \param insertion         - number of maximum row before inserting in multi-row
- * \param periodic_display  - Each periodic_display seconds, output
- *  time; total rows; row over since periodic_display s  ; average since periodic_display s
+ * do the bench insertion, prints JSON results on stdout if 'json' is set
  */
-void bench(
-        int delay=100,
-        int num_device=100,
-        int topic_per_device=100,
-        int periodic_display=10,
-        int total_duration=-1,
-        int insertion=10){
-
-    log_info("delay=%dms periodic=%ds minute=%dm element=%d topic=%d insert_every=%d",
-            delay,periodic_display,total_duration,num_device,topic_per_device,insertion);
-    tntdb::Connection conn;
-    try {
-        conn = tntdb::connectCached(url);
-        conn.ping();
-    } catch (const std::exception &e) {
-        log_error("Can't connect to the database");
+static void bench(const Workload& w, bool json)
+{
+    log_info("url=%s assets=%d topics=%d steps=%zu values=%s duplicates=%.2f rows=%" PRIi64 " batch=%d seed=%" PRIu64,
+        url.c_str(), w.assets, w.topics_per_asset, w.steps.size(), w.values.c_str(), w.duplicates, w.rows, w.batch,
+        w.seed);
+
+    std::vector<BenchTopic> topics = s_topics(w);
+    if (topics.empty()) {
+        log_error("empty workload");
         return;
     }
+    BenchRandom  random(w.seed);
+    BenchLatency insert_latency;
+    BenchLatency flush_latency;
+
+    zsys_catch_interrupts();
 
-    int stat_total_row=0;
-    int stat_periodic_row=0;
+    int64_t               rows = 0;
+    bench_clock::duration busy(0);
+    auto                  begin          = bench_clock::now();
+    auto                  begin_periodic = begin;
+    int64_t               periodic_rows  = 0;
 
-    zsys_catch_interrupts ();
+    log_info("time;total;rows; mean over last %ds (row/s)", w.periodic);
+    while (!zsys_interrupted && rows < w.rows) {
+        BenchTopic& topic = topics[size_t(rows) % topics.size()];
+        int64_t     ts;
+        if (topic.last_ts >= 0 && random.uniform() < w.duplicates) {
+            ts = topic.last_ts;
+        } else {
+            ts = topic.next_ts;
+            topic.next_ts += topic.interval;
+        }
+        topic.last_ts     = ts;
+        std::string value = s_next_value(w, random, topic);
 
-    long begin_overall_ms = get_clock_ms();
-    long begin_periodic_ms = get_clock_ms();
+        auto        t0    = bench_clock::now();
+        std::mutex& mutex = persistance_shard_mutex(persistance_shard(topic.topic));
+        mutex.lock();
+        m_msrmnt_value_t integer = 0;
+        m_msrmnt_scale_t scale   = 0;
+        if (string_to_measurement(value.c_str(), integer, scale)) {
+            insert_into_measurement(url, topic.topic.c_str(), integer, scale, ts, "W", topic.device_name.c_str());
+        }
+        mutex.unlock();
+        auto t1 = bench_clock::now();
+        insert_latency.add(t1 - t0);
+        busy += t1 - t0;
+        rows++;
+        periodic_rows++;
 
-    int dev_by_topic=num_device * topic_per_device;
+        if (rows % w.batch == 0) {
+            {
+                PersistanceShardsLock lock;
+                flush_measurement(url);
+            }
+            auto t2 = bench_clock::now();
+            flush_latency.add(t2 - t1);
+            busy += t2 - t1;
+        }
 
-    log_info("time;total;rows; mean over last %ds (row/s)",periodic_display);
-    while(!zsys_interrupted) {
-        insert_new_measurement(stat_total_row%dev_by_topic/topic_per_device, stat_total_row%topic_per_device,
-                conn);
-        //count stat
-        stat_total_row++;
-        stat_periodic_row++;
-        //time to display stat ?
-        long now_ms = get_clock_ms();
-        long elapsed_periodic_ms = (now_ms - begin_periodic_ms);
         //every period seconds display current total row count and the trend over the last periodic_display second
-        if(elapsed_periodic_ms > periodic_display * 1000 ){
-            log_info("%s;%d;%d;%.2lf",get_clock_fmt(),stat_total_row,stat_periodic_row,stat_periodic_row/(elapsed_periodic_ms/1000.0));
-            stat_periodic_row=0;
-            begin_periodic_ms = now_ms;
+        auto   now              = bench_clock::now();
+        double elapsed_periodic = std::chrono::duration<double>(now - begin_periodic).count();
+        if (elapsed_periodic > w.periodic) {
+            log_info("%" PRIi64 ";%" PRIi64 ";%.2lf", rows, periodic_rows, double(periodic_rows) / elapsed_periodic);
+            periodic_rows  = 0;
+            begin_periodic = now;
+        }
+        if (w.minutes > 0 && now - begin > std::chrono::minutes(w.minutes)) {
+            break;
         }
-        if (total_duration>0 && (now_ms - begin_overall_ms)/1000.0/60.0>total_duration)goto exit;
 
         //sleep before loop
-        if(delay>0)usleep(delay*1000);
+        if (w.delay > 0)
+            zclock_sleep(w.delay);
+    }
+
+    auto t0 = bench_clock::now();
+    {
+        PersistanceShardsLock lock;
+        flush_measurement(url);
     }
+    auto t1 = bench_clock::now();
+    flush_latency.add(t1 - t0);
+    busy += t1 - t0;
+
+    double elapsed    = std::chrono::duration<double>(t1 - begin).count();
+    double busy_s     = std::chrono::duration<double>(busy).count();
+    double rows_per_s = busy_s > 0 ? double(rows) / busy_s : 0;
 
-exit:
-    flush_measurement(url);
-    long elapsed_overall_ms = (get_clock_ms() - begin_overall_ms);
+    log_info("%" PRIi64 " rows inserted in %.2lf seconds (%.2lf s in ingest path), avg=%.2lf row/s", rows, elapsed,
+        busy_s, rows_per_s);
+    log_info("insert latency (us): p50=%.1f p99=%.1f p999=%.1f", insert_latency.percentile(0.5),
+        insert_latency.percentile(0.99), insert_latency.percentile(0.999));
+    log_info("flush latency (us): p50=%.1f p99=%.1f p999=%.1f", flush_latency.percentile(0.5),
+        flush_latency.percentile(0.99), flush_latency.percentile(0.999));
 
-    log_info("%d rows inserted in  %.2lf seconds, overall avg=%.2lf row/s",stat_total_row,elapsed_overall_ms/1000.0,stat_total_row/(elapsed_overall_ms/1000.0));
+    if (json) {
+        printf("{\"bench\":\"dbstore\",\"url\":%s,\"workload\":%s,\"rows\":%" PRIi64
+               ",\"elapsed_s\":%.3f,\"busy_s\":%.3f,\"rows_per_s\":%.1f,\"insert_latency_us\":%s,"
+               "\"flush_latency_us\":%s}\n",
+            bench_json_string(url).c_str(), s_workload_json(w).c_str(), rows, elapsed, busy_s, rows_per_s,
+            insert_latency.json().c_str(), flush_latency.json().c_str());
+    }
+}
+
+static std::vector<std::string> s_split(const char* list)
+{
+    std::vector<std::string> items;
+    std::istringstream       stream(list);
+    std::string              item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
 }
 
 void usage ()
 {
     puts ("dbstore_bench [options] \n"
           "  -u|--url              mysql:db=box_utf8;user=bios;password=test (or set DB_PASSWD and DB_USER env variable)\n"
-          "  -d|--delay            pause between each insertion (in ms), 0 means no delay [100]\n"
+          "                        memory:<name> for the in-memory storage\n"
+          "  -d|--delay            pause between each insertion (in ms), 0 means no delay [0]\n"
           "  -p|--periodic         output time; row; average each periodic_display seconds [10]\n"
-          "  -m|--minute           bench duration in minute, -1 means infinite loop [-1]\n"
+          "  -m|--minute           bench duration in minute, -1 means no limit [-1]\n"
           "  -e|--element          number of simulated elements [100]\n"
-          "  -t|--topic            number of simulated topic per element [100]\n"
-          "  -i|--insert_every     do a multi row insertion on every X measurement[10]\n"
+          "  -t|--topic            number of simulated topic per element [10]\n"
+          "  -s|--steps            comma separated steps of the topics (RT, 15m, 1h, ...) [15m]\n"
+          "  -v|--values           value distribution: constant, uniform, walk, integer [walk]\n"
+          "  -D|--duplicates       ratio of rows reusing the last timestamp of the topic [0]\n"
+          "  -r|--rows             number of inserted rows [100000]\n"
+          "  -i|--insert_every     do a multi row insertion on every X measurement [1000]\n"
+          "  -S|--seed             seed of the workload [1]\n"
+          "  -j|--json             print results as JSON on stdout\n"
           "  -h|--help             print this information");
 }
 
@@ -165,13 +298,9 @@ void usage ()
  */
 int main(int argc, char** argv) {
     // set default
-    int help = 0;
-    int delay=100; //ms
-    int periodic=10; //s
-    int minute=-1; //min
-    int element=100;
-    int topic=100;
-    int insert_every=10;
+    int      help = 0;
+    int      json = 0;
+    Workload w;
 
      // get options
     int c;
@@ -180,17 +309,23 @@ int main(int argc, char** argv) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wwrite-strings"
 #endif
-    static const char *short_options = "h:u:d:p:m:e:t:i:";
+    static const char *short_options = "hju:d:p:m:e:t:s:v:D:r:i:S:";
     static struct option long_options[] =
     {
             {"help",       no_argument,       &help,    1},
+            {"json",       no_argument,       &json,    1},
             {"url",        required_argument, 0,'u'},
             {"delay",      required_argument, 0,'d'},
             {"periodic",   required_argument, 0,'p'},
             {"minute",     required_argument, 0,'m'},
             {"element",    required_argument, 0,'e'},
             {"topic",      required_argument, 0,'t'},
+            {"steps",      required_argument, 0,'s'},
+            {"values",     required_argument, 0,'v'},
+            {"duplicates", required_argument, 0,'D'},
+            {"rows",       required_argument, 0,'r'},
             {"insert_every",  required_argument, 0,'i'},
+            {"seed",       required_argument, 0,'S'},
             {NULL, 0, 0, 0}
     };
 #if defined(__GNUC__) || defined(__GNUG__)
@@ -206,22 +341,40 @@ int main(int argc, char** argv) {
             url = optarg;
             break;
         case 'd':
-            delay = atoi(optarg);
+            w.delay = atoi(optarg);
             break;
         case 'p':
-            periodic = atoi(optarg);
+            w.periodic = atoi(optarg);
             break;
         case 'm':
-            minute = atoi(optarg);
+            w.minutes = atoi(optarg);
             break;
         case 'e':
-            element = atoi(optarg);
+            w.assets = atoi(optarg);
             break;
         case 't':
-            topic = atoi(optarg);
+            w.topics_per_asset = atoi(optarg);
+            break;
+        case 's':
+            w.steps = s_split(optarg);
+            break;
+        case 'v':
+            w.values = optarg;
+            break;
+        case 'D':
+            w.duplicates = atof(optarg);
+            break;
+        case 'r':
+            w.rows = atoll(optarg);
             break;
         case 'i':
-            insert_every = atoi(optarg);
+            w.batch = std::max(atoi(optarg), 1);
+            break;
+        case 'S':
+            w.seed = strtoull(optarg, nullptr, 10);
+            break;
+        case 'j':
+            json = 1;
             break;
         case 0:
             // just now walking trough some long opt
@@ -237,6 +390,6 @@ int main(int argc, char** argv) {
     ManageFtyLog::setInstanceFtylog("dbstore_bench", FTY_COMMON_LOGGING_DEFAULT_CFG);
     log_debug("## bench started ##");
 
-    bench(delay,element, topic,  periodic, minute, insert_every);
+    bench(w, json);
     return 0;
 }
@@ -0,0 +1,87 @@
+/*  =========================================================================
+    freshness - Age of the metrics along the ingest pipeline
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// freshness - Age of the metrics along the ingest pipeline
+
+#include "freshness.h"
+#include "stats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fty_log.h>
+#include <inttypes.h>
+#include <vector>
+
+static const char* STAGE_NAMES[FRESHNESS_STAGES] = {"shm_read", "parsed", "resolved", "buffered", "committed"};
+static const char* CLASS_NAMES[2]                = {"rt", "aggr"};
+
+// histograms by stage and step class (RT, aggregates)
+struct Lags
+{
+    StatsHistogram* histograms[FRESHNESS_STAGES][2];
+
+    Lags()
+    {
+        for (int stage = 0; stage < FRESHNESS_STAGES; stage++) {
+            for (int c = 0; c < 2; c++) {
+                histograms[stage][c] =
+                    &stats_histogram(std::string("lag.") + STAGE_NAMES[stage] + "." + CLASS_NAMES[c] + "_ms");
+            }
+        }
+    }
+};
+
+static Lags g_lags;
+
+void freshness_record(FreshnessStage stage, int step, int64_t timestamp)
+{
+    int64_t now_ms = int64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    int64_t age = now_ms - timestamp * 1000;
+    // metrics from the future (clock skew) are fresh
+    // unknown steps are computed metrics
+    g_lags.histograms[stage][step != 0 ? 1 : 0]->add(age > 0 ? uint64_t(age) : 0);
+}
+
+static uint64_t s_threshold(const char* env, uint64_t dfl)
+{
+    const char* value = getenv(env);
+    if (!value) {
+        return dfl;
+    }
+    log_info("use %s %s", env, value);
+    return uint64_t(std::max(atoll(value), 0ll));
+}
+
+void freshness_check()
+{
+    static const uint64_t thresholds[2] = {
+        s_threshold(EV_DBSTORE_LAG_WARNING, LAG_WARNING_DEFAULT), s_threshold(EV_DBSTORE_LAG_WARNING_AGGR, 0)};
+    static std::vector<uint64_t> last[2];
+
+    for (int c = 0; c < 2; c++) {
+        uint64_t p99 = g_lags.histograms[FRESHNESS_COMMITTED][c]->percentile_since(last[c], 0.99);
+        if (thresholds[c] && p99 > thresholds[c]) {
+            log_warning("p99 of the committed lag of %s metrics is %" PRIu64 " ms (> %" PRIu64 " ms)",
+                c == 0 ? "real time" : "aggregated", p99, thresholds[c]);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*  =========================================================================
+    freshness - Age of the metrics along the ingest pipeline
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <cstdint>
+
+// Warn when the p99 of the committed lag (in ms) of real time metrics exceeds this value
+// over a check interval [60000], 0 disables the warning
+#define EV_DBSTORE_LAG_WARNING "BIOS_DBSTORE_LAG_WARNING"
+// Same for the aggregated metrics [0]
+#define EV_DBSTORE_LAG_WARNING_AGGR "BIOS_DBSTORE_LAG_WARNING_AGGR"
+
+#define LAG_WARNING_DEFAULT      60000       // ms
+#define FRESHNESS_CHECK_INTERVAL (60 * 1000) // ms
+
+// Stages of a metric in the ingest pipeline
+enum FreshnessStage
+{
+    FRESHNESS_SHM_READ = 0, // read from shm by the pull actor
+    FRESHNESS_PARSED,       // value parsed
+    FRESHNESS_RESOLVED,     // topic id resolved (MySQL)
+    FRESHNESS_BUFFERED,     // accepted by the storage backend
+    FRESHNESS_COMMITTED,    // stored (written to DB by a flush, or to the embedded engine)
+    FRESHNESS_STAGES
+};
+
+// Records the age (now - 'timestamp' of the metric, in ms) of a metric of the step
+// (RT or aggregate) at the stage to the histogram lag.<stage>.<rt|aggr>_ms (see stats.h)
+void freshness_record(FreshnessStage stage, int step, int64_t timestamp);
+
+// Logs a warning if the p99 of the committed lag since the previous check exceeds
+// the threshold of its step class, called periodically by the server actor
+void freshness_check();
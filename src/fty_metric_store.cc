@@ -21,7 +21,11 @@
 
 /// fty_metric_store - Metric store agent
 
+#include "capture.h"
 #include "fty_metric_store_server.h"
+#include "stats.h"
+#include "trace.h"
+#include "retention.h"
 #include <fty_log.h>
 #include <fty_proto.h>
 #include <getopt.h>
@@ -29,16 +33,15 @@
 static const char* AGENT_NAME = "fty-metric-store";
 static const char* ENDPOINT   = "ipc://@/malamute";
 
-#define STEPS_SIZE 8
-static const char* STEPS[STEPS_SIZE]    = {"RT", "15m", "30m", "1h", "8h", "1d", "7d", "30d"};
-static const char* DEFAULTS[STEPS_SIZE] = { "0",   "1",   "1",  "7",  "7", "30", "30", "180"};
+// storage age defaults of RETENTION_STEPS
+static const char* DEFAULTS[RETENTION_STEPS_SIZE] = {"0", "1", "1", "7", "7", "30", "30", "180"};
 
 void usage()
 {
     printf(
         "%s [options] ...\n"
         "  --verbose / -v         verbose mode\n"
-        "  --config-file / -c     TODO\n"
+        "  --config-file / -c     path to the configuration file\n"
         "  --help / -h            this information\n", AGENT_NAME);
 }
 
@@ -58,7 +61,8 @@ int main(int argc, char* argv[])
 #pragma GCC diagnostic pop
 #endif
 
-    bool verbose = false;
+    bool        verbose     = false;
+    const char* config_file = nullptr;
     while (true) {
         int option_index = 0;
         int c = getopt_long(argc, argv, short_options, long_options, &option_index);
@@ -70,7 +74,7 @@ int main(int argc, char* argv[])
                 verbose = true;
                 break;
             case 'c':
-                log_warning("%s: --config-file ignored (%s)", AGENT_NAME, optarg);
+                config_file = optarg;
                 break;
             case 'h':
             default:
@@ -79,10 +83,23 @@ int main(int argc, char* argv[])
         }
     }
 
+    // systemd service passes the configuration file as argument
+    if (!config_file && optind < argc) {
+        config_file = argv[optind];
+    }
+
     if (verbose) {
         ManageFtyLog::getInstanceFtylog()->setVerboseMode();
     }
 
+    zconfig_t* config = nullptr;
+    if (config_file) {
+        config = zconfig_load(config_file);
+        if (!config) {
+            log_error("%s: can't load configuration file '%s'", AGENT_NAME, config_file);
+        }
+    }
+
     zactor_t* ms_server = zactor_new(fty_metric_store_server, nullptr);
     if (!ms_server) {
         log_fatal("%s: zactor_new failed", AGENT_NAME);
@@ -92,21 +109,51 @@ int main(int argc, char* argv[])
     zstr_sendx(ms_server, "CONNECT", ENDPOINT, AGENT_NAME, nullptr);
 
     zstr_sendx(ms_server, "CONSUMER", FTY_PROTO_STREAM_ASSETS, ".*", nullptr);
-    //zstr_sendx (ms_server, "CONSUMER", FTY_PROTO_STREAM_METRICS, ".*", nullptr);
+    // metrics are read from shm, the stream is drained by batches when enabled
+    const char* stream_metrics = getenv(EV_DBSTORE_STREAM_METRICS);
+    if (stream_metrics && atoi(stream_metrics) != 0) {
+        log_info("use %s %s", EV_DBSTORE_STREAM_METRICS, stream_metrics);
+        zstr_sendx(ms_server, "CONSUMER", FTY_PROTO_STREAM_METRICS, ".*", nullptr);
+    }
+
+    // statistics are published on METRICS
+    const char* stats_interval = getenv(EV_DBSTORE_STATS_INTERVAL);
+    if (stats_interval && atoi(stats_interval) > 0) {
+        zstr_sendx(ms_server, "PRODUCER", FTY_PROTO_STREAM_METRICS, nullptr);
+    }
 
-    // setup the storage age
-    for (int i = 0; i != STEPS_SIZE; i++) {
+    const char* trace_file = getenv(EV_DBSTORE_TRACE);
+    if (trace_file && *trace_file) {
+        zstr_sendx(ms_server, "TRACE", "ON", nullptr);
+    }
+
+    const char* capture_file = getenv(EV_DBSTORE_CAPTURE);
+    if (capture_file && *capture_file) {
+        zstr_sendx(ms_server, "CAPTURE", capture_file, nullptr);
+    }
+
+    // setup the storage age: environment, then store section of the configuration file, then defaults
+    for (int i = 0; i != RETENTION_STEPS_SIZE; i++) {
         const char* dfl = DEFAULTS[i];
 
+        if (config) {
+            std::string key = std::string("store/") + RETENTION_STEPS[i];
+            if (i == 0) {
+                key = "store/rt";
+            }
+            dfl = zconfig_get(config, key.c_str(), dfl);
+        }
+
         char* var_name = nullptr;
-        asprintf(&var_name, "%s_%s", FTY_METRIC_STORE_CONF_PREFIX, STEPS[i]);
+        asprintf(&var_name, "%s_%s", FTY_METRIC_STORE_CONF_PREFIX, RETENTION_STEPS[i]);
         if (var_name && getenv(var_name)) {
             dfl = getenv(var_name);
         }
         zstr_free(&var_name);
 
-        zstr_sendx(ms_server, FTY_METRIC_STORE_CONF_PREFIX, STEPS[i], dfl, nullptr);
+        zstr_sendx(ms_server, FTY_METRIC_STORE_CONF_PREFIX, RETENTION_STEPS[i], dfl, nullptr);
     }
+    zconfig_destroy(&config);
 
     log_info("%s started", AGENT_NAME);
 
@@ -121,6 +168,9 @@ int main(int argc, char* argv[])
         zstr_free(&msg);
     }
 
+    if (trace_file && *trace_file) {
+        zstr_sendx(ms_server, "TRACE", "DUMP", trace_file, nullptr);
+    }
     zactor_destroy(&ms_server);
     log_info("%s ended", AGENT_NAME);
 
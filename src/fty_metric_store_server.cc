@@ -40,6 +40,13 @@
             "BAD_REQUEST" requested information is not monitored by the system
                     (missing record in the t_bios_measurement_table)
             "BAD_ORDERED" when parameter 'ordering_flag' does not have allowed value
+            "TIMEOUT" when the database did not answer within BIOS_DBSTORE_DB_IO_TIMEOUT ms
+
+== Runtime statistics (subject "STATS")
+    Example request:
+                "8CB3E9A9649B"
+    Example reply:
+                "8CB3E9A9649B"/"OK"/"get.latency_us.p50"/"812"/"get.requests"/"42"/...
 
     If the request message does not include <uuid>, behaviour is undefined.
     If the subject is incorrect, fty-metric-store server responds with ERROR/UNSUPPORTED_SUBJECT.
@@ -49,18 +56,27 @@
 
 #include "fty_metric_store_server.h"
 #include "actor_commands.h"
+#include "archive.h"
+#include "asset_delete.h"
+#include "capture.h"
 #include "converter.h"
+#include "db_io.h"
+#include "freshness.h"
+#include "ingest_pipeline.h"
 #include "multi_row.h"
+#include "partition.h"
 #include "persistance.h"
+#include "retention.h"
+#include "shm_scan.h"
+#include "stats.h"
+#include "trace.h"
+#include <chrono>
 #include <fty_log.h>
 #include <fty_proto.h>
 #include <fty_shm.h>
 #include <malamute.h>
-#include <mutex>
-#include <tntdb.h>
 #include <stdexcept>
-
-static std::mutex g_row_mutex;
+#include <vector>
 
 /**
  *  \brief A connection string to the database
@@ -73,6 +89,26 @@ static std::string DB_URL = std::string("mysql:db=box_utf8;user=") +
                          ((getenv("DB_USER") == nullptr) ? "root" : getenv("DB_USER")) +
                          ((getenv("DB_PASSWD") == nullptr) ? "" : std::string(";password=") + getenv("DB_PASSWD"));
 
+// runtime statistics, see stats.h
+static StatsCounter&   g_metrics_no_cm_type   = stats_counter("metrics.filtered.cm_type");
+static StatsCounter&   g_metrics_flagged      = stats_counter("metrics.filtered.flag");
+static StatsCounter&   g_metrics_not_stored   = stats_counter("metrics.filtered.age");
+static StatsCounter&   g_shm_metrics          = stats_counter("shm.metrics");
+static StatsHistogram& g_shm_cycle            = stats_histogram("shm.cycle_us");
+static StatsHistogram& g_stream_batch         = stats_histogram("stream.batch");
+static StatsCounter&   g_assets_deleted       = stats_counter("assets.deleted");
+static StatsCounter&   g_get_requests         = stats_counter("get.requests");
+static StatsCounter&   g_get_errors           = stats_counter("get.errors");
+static StatsHistogram& g_get_latency          = stats_histogram("get.latency_us");
+
+void reply_add_measurement(zmsg_t* reply, int64_t timestamp, m_msrmnt_value_t value, m_msrmnt_scale_t scale)
+{
+    double real_value = value * std::pow(10, scale);
+
+    zmsg_addstr(reply, std::to_string(timestamp).c_str());
+    zmsg_addstr(reply, std::to_string(real_value).c_str());
+}
+
 static zmsg_t* s_process_mailbox_aggregate(mlm_client_t* /*client*/, zmsg_t** message_p)
 {
     assert(message_p && *message_p);
@@ -192,9 +228,7 @@ static zmsg_t* s_process_mailbox_aggregate(mlm_client_t* /*client*/, zmsg_t** me
         topic += asset_name;
 
         std::string units;
-        int rv = select_topic(DB_URL, topic, [&units](const tntdb::Row& r) {
-            r["units"].get(units);
-        });
+        int rv = select_topic(DB_URL, topic, units);
 
         log_debug("select topic (rv: %d, topic: '%s', units: '%s')", rv, topic.c_str(), units.c_str());
 
@@ -221,20 +255,8 @@ static zmsg_t* s_process_mailbox_aggregate(mlm_client_t* /*client*/, zmsg_t** me
         zmsg_addstr(msg_out, ordered);
         zmsg_addstr(msg_out, units.c_str());
 
-        std::function<void(const tntdb::Row&)> add_measurement;
-        add_measurement = [&msg_out](const tntdb::Row& r) {
-            m_msrmnt_value_t value = 0;
-            r["value"].get(value);
-
-            m_msrmnt_scale_t scale = 0;
-            r["scale"].get(scale);
-            double real_value = value * std::pow(10, scale);
-
-            int64_t timestamp = 0;
-            r["timestamp"].get(timestamp);
-
-            zmsg_addstr(msg_out, std::to_string(timestamp).c_str());
-            zmsg_addstr(msg_out, std::to_string(real_value).c_str());
+        msrmnt_cb_t add_measurement = [&msg_out](int64_t timestamp, m_msrmnt_value_t value, m_msrmnt_scale_t scale) {
+            reply_add_measurement(msg_out, timestamp, value, scale);
         };
 
         bool is_ordered = streq(ordered, "1");
@@ -265,11 +287,92 @@ static zmsg_t* s_process_mailbox_aggregate(mlm_client_t* /*client*/, zmsg_t** me
     return msg_out;
 }
 
+static zmsg_t* s_process_mailbox_stats()
+{
+    zmsg_t* msg_out = zmsg_new();
+    zmsg_addstr(msg_out, "OK");
+    stats_foreach([msg_out](const std::string& name, int64_t value) {
+        zmsg_addstr(msg_out, name.c_str());
+        zmsg_addstr(msg_out, std::to_string(value).c_str());
+    });
+    return msg_out;
+}
+
+// publishes the statistics as metrics "store.<name>" of the agent
+static void s_publish_stats(mlm_client_t* client, uint32_t ttl)
+{
+    uint64_t now = uint64_t(time(nullptr));
+    stats_foreach([client, ttl, now](const std::string& name, int64_t value) {
+        std::string type    = "store." + name;
+        zmsg_t*     msg     = fty_proto_encode_metric(
+            nullptr, now, ttl, type.c_str(), STATS_ASSET, std::to_string(value).c_str(), "");
+        std::string subject = type + "@" + STATS_ASSET;
+        if (mlm_client_send(client, subject.c_str(), &msg) != 0) {
+            log_error("can't publish %s (PRODUCER not set?)", subject.c_str());
+            zmsg_destroy(&msg);
+        }
+    });
+}
+
 //
 // MAILBOX DELIVER processing
 //
 
-static void s_handle_mailbox(mlm_client_t* client, zmsg_t** message_p)
+// GET request, run by a DB I/O thread and replied by the server actor
+struct GetRequest
+{
+    zmsg_t*                               message = nullptr;
+    zmsg_t*                               reply   = nullptr;
+    std::string                           sender;
+    std::string                           subject;
+    std::string                           uuid;
+    std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+
+    ~GetRequest()
+    {
+        zmsg_destroy(&message);
+        zmsg_destroy(&reply);
+    }
+};
+
+static void s_submit_get(mlm_client_t* client, zmsg_t** message_p, const char* uuid, DbIo& db_io, int timeout)
+{
+    std::shared_ptr<GetRequest> request(new GetRequest());
+    request->message = *message_p;
+    *message_p       = nullptr;
+    request->sender  = mlm_client_sender(client);
+    request->subject = mlm_client_subject(client);
+    request->uuid    = uuid ? uuid : "";
+
+    auto work = [request]() {
+        request->reply = s_process_mailbox_aggregate(nullptr, &request->message);
+    };
+    auto done = [client, request](bool timed_out) {
+        zmsg_t* reply = nullptr;
+        if (timed_out) {
+            // the I/O thread still owns request->reply
+            reply = zmsg_new();
+            zmsg_addstr(reply, "ERROR");
+            zmsg_addstr(reply, "TIMEOUT");
+        } else {
+            reply          = request->reply;
+            request->reply = nullptr;
+        }
+        g_get_latency.add(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - request->received).count()));
+        if (!reply || (zmsg_first(reply) && zframe_streq(zmsg_first(reply), "ERROR"))) {
+            g_get_errors.add();
+        }
+        if (reply) {
+            zmsg_pushstr(reply, request->uuid.c_str());
+            mlm_client_sendto(client, request->sender.c_str(), request->subject.c_str(), nullptr, 1000, &reply);
+        }
+        zmsg_destroy(&reply);
+    };
+    db_io.submit("mailbox.get", work, done, timeout);
+}
+
+static void s_handle_mailbox(mlm_client_t* client, zmsg_t** message_p, DbIo& db_io, int get_timeout)
 {
     assert(client);
     assert(message_p && *message_p);
@@ -278,6 +381,7 @@ static void s_handle_mailbox(mlm_client_t* client, zmsg_t** message_p)
     const char* subject = mlm_client_subject(client);
 
     log_trace("IN handle MAILBOX DELIVER (subject %s from %s)", subject, sender);
+    capture_message(CAPTURE_MAILBOX, sender, subject, *message_p);
 
     if (zmsg_size(*message_p) == 0) {
         log_error("Empty message with subject %s from %s, ignoring", subject, sender);
@@ -289,7 +393,12 @@ static void s_handle_mailbox(mlm_client_t* client, zmsg_t** message_p)
 
     zmsg_t* msg_out = nullptr;
     if (streq(subject, AVG_GRAPH)) {
-        msg_out = s_process_mailbox_aggregate(client, message_p);
+        // replied once selected, without blocking the actor
+        g_get_requests.add();
+        s_submit_get(client, message_p, uuid, db_io, get_timeout);
+    }
+    else if (streq(subject, STATS_SUBJECT)) {
+        msg_out = s_process_mailbox_stats();
     }
     else {
         log_error("Bad subject %s from %s, ignoring", subject, sender);
@@ -312,92 +421,44 @@ static void s_handle_mailbox(mlm_client_t* client, zmsg_t** message_p)
 // STREAM DELIVER processing
 //
 
-static void s_process_stream_proto_metric(fty_proto_t* m)
-{
-    assert(m);
-    assert(fty_proto_id(m) == FTY_PROTO_METRIC);
-
-    // TODO: implement FTY_STORE_AGE_ support
-    // ignore the stuff not coming from computation module
-    if (!fty_proto_aux_string(m, "x-cm-type", nullptr)) {
-        return;
-    }
-
-    std::string db_topic = std::string(fty_proto_type(m)) + "@" + std::string(fty_proto_name(m));
-
-    m_msrmnt_value_t value = 0;
-    m_msrmnt_scale_t scale = 0;
-    if (!strstr(fty_proto_value(m), ".")) {
-        value = m_msrmnt_value_t(string_to_int64(fty_proto_value(m)));
-        if (errno != 0) {
-            errno = 0;
-            log_error("value '%s' of the metric is not integer", fty_proto_value(m));
-            return;
-        }
-    } else {
-        int8_t  lscale  = 0;
-        int32_t integer = 0;
-        if (!stobiosf_wrapper(fty_proto_value(m), integer, lscale)) {
-            log_error("value '%s' of the metric is not double", fty_proto_value(m));
-            return;
-        }
-        value = integer;
-        scale = lscale;
-    }
-
-    // connect & test db
-    tntdb::Connection conn;
-    try {
-        conn = tntdb::connectCached(DB_URL);
-        conn.ping();
-    } catch (const std::exception& e) {
-        log_error("Can't connect to the database");
-        return;
-    }
-
-    // time is a time when message was received
-    uint64_t _time = fty_proto_time(m);
-    insert_into_measurement(conn, db_topic.c_str(), value, scale, int64_t(_time), fty_proto_unit(m), fty_proto_name(m));
-}
-
-static void s_process_stream_proto_asset(fty_proto_t* m)
+static void s_process_stream_proto_asset(fty_proto_t* m, zactor_t* asset_delete)
 {
     assert(m);
     assert(fty_proto_id(m) == FTY_PROTO_ASSET);
 
     if (streq(fty_proto_operation(m), "delete")) {
         log_debug("Asset '%s' is deleted -> delete all it measurements", fty_proto_name(m));
-
-        tntdb::Connection conn;
-        try {
-            conn = tntdb::connectCached(DB_URL);
-            conn.ping();
-        } catch (const std::exception& e) {
-            log_error("Can't connect to the database");
-            return;
-        }
-
-        delete_measurements(conn, fty_proto_name(m));
+        g_assets_deleted.add();
+        // may take long, done by the asset delete actor
+        zstr_sendx(asset_delete, "DELETE", fty_proto_name(m), nullptr);
     } else {
         log_debug("Ignore operation '%s' on the asset '%s'", fty_proto_operation(m), fty_proto_name(m));
     }
 }
 
-static void s_handle_stream(mlm_client_t* /*client*/, zmsg_t** message_p)
+static void s_handle_stream(
+    mlm_client_t* client, zmsg_t** message_p, zactor_t* asset_delete, IngestPipeline& pipeline, IngestQueues& queues)
 {
     assert(message_p && *message_p);
     log_trace("IN handle STREAM DELIVER");
+    capture_message(CAPTURE_STREAM, mlm_client_address(client), mlm_client_subject(client), *message_p);
+
+    // decoded by the parsers
+    if (streq(mlm_client_address(client), FTY_PROTO_STREAM_METRICS)) {
+        TraceSpan span("stream.metric");
+        pipeline.push(message_p, mlm_client_subject(client));
+        return;
+    }
 
     fty_proto_t* m = fty_proto_decode(message_p);
 
     if (!m) {
         log_error("Can't decode the fty_proto message, ignore it");
     } else if (fty_proto_id(m) == FTY_PROTO_METRIC) {
-        g_row_mutex.lock();
-        s_process_stream_proto_metric(m);
-        g_row_mutex.unlock();
+        TraceSpan span("stream.metric");
+        ingest_stream_metric(m, queues);
     } else if (fty_proto_id(m) == FTY_PROTO_ASSET) {
-        s_process_stream_proto_asset(m);
+        s_process_stream_proto_asset(m, asset_delete);
     } else {
         log_error("Unsupported fty_proto message with id = '%d'", fty_proto_id(m));
     }
@@ -410,72 +471,95 @@ static void s_handle_stream(mlm_client_t* /*client*/, zmsg_t** message_p)
 // fty_metric_store pull actor, to store metrics from shm to db
 //
 
-static void s_process_pull_store_shm_metrics(fty::shm::shmMetrics& metrics)
+// filter of the metrics of shm, called by the scanner threads: keeps the metrics to store
+// and flags the expired ones, they are written back once handed over
+static ShmFilter s_pull_shm_metric_filter(fty_proto_t* m)
 {
-    for (auto& m : metrics) {
-        assert(m);
-        // TODO: implement FTY_STORE_AGE_ support
+    assert(m);
 
-        // ignore stuff not coming from computation module
-        if (!fty_proto_aux_string(m, "x-cm-type", nullptr))
-            continue;
-        // ignore flagged metric
-        if (fty_proto_aux_string(m, "x-ms-flag", nullptr))
-            continue;
+    g_shm_metrics.add();
 
-        std::string db_topic = std::string(fty_proto_type(m)) + "@" + std::string(fty_proto_name(m));
+    // ignore stuff not coming from computation module, unless raw metrics are stored
+    if (!fty_proto_aux_string(m, "x-cm-type", nullptr) && !is_raw_measurement_stored()) {
+        g_metrics_no_cm_type.add();
+        return SHM_DROP;
+    }
+    // ignore flagged metric
+    if (fty_proto_aux_string(m, "x-ms-flag", nullptr)) {
+        g_metrics_flagged.add();
+        return SHM_DROP;
+    }
 
-        m_msrmnt_value_t value = 0;
-        m_msrmnt_scale_t scale = 0;
-        if (!strstr(fty_proto_value(m), ".")) {
-            value = m_msrmnt_value_t(string_to_int64(fty_proto_value(m)));
-            if (errno != 0) {
-                errno = 0;
-                log_error("value '%s' of the metric is not integer", fty_proto_value(m));
-                continue;
-            }
-        } else {
-            int8_t  lscale = 0;
-            int32_t lvalue = 0;
-            if (!stobiosf_wrapper(fty_proto_value(m), lvalue, lscale)) {
-                log_error("value '%s' of the metric is not double", fty_proto_value(m));
-                continue;
-            }
-            value = lvalue;
-            scale = lscale;
-        }
+    // ignore steps with storage age 0, the step is the suffix of the type
+    int step = retention_topic_step(fty_proto_type(m));
+    if (!retention_is_stored(step)) {
+        g_metrics_not_stored.add();
+        return SHM_DROP;
+    }
 
-        // connect & test db
-        tntdb::Connection conn;
-        try {
-            conn = tntdb::connectCached(DB_URL);
-            conn.ping();
-        } catch (const std::exception& e) {
-            log_error("Can't connect to the database");
-            continue;
-        }
+    // time is a time when message was received
+    freshness_record(FRESHNESS_SHM_READ, step, int64_t(fty_proto_time(m)));
+
+    // handed over to be stored, flag this metric
+    if ((fty_proto_time(m) + fty_proto_ttl(m)) < uint64_t(time(nullptr))) {
+        uint32_t new_ttl = uint32_t(fty_proto_ttl(m) - (uint64_t(time(nullptr)) - fty_proto_time(m)));
+        fty_proto_set_ttl(m, new_ttl);
+        fty_proto_aux_insert(m, "x-ms-flag", "1");
+        return SHM_KEEP_WRITE_BACK;
+    }
+    return SHM_KEEP;
+}
+
+// receive stage of the metrics of shm: reads and filters them by partitions of the assets,
+// then hands the batches over to the parsers
+static void s_process_pull_store_shm_metrics(ShmScanner& scanner, IngestPipeline& pipeline)
+{
+    StatsTimer timer(g_shm_cycle);
+    // only the metrics of the computation module are stored, unless raw metrics are: read
+    // the types of the stored aggregated steps, ages may change at runtime
+    std::string types = is_raw_measurement_stored() ? ".*" : retention_stored_types_regex();
+
+    std::vector<ShmBatch> batches;
+    {
+        TraceSpan span("shm.scan");
+        batches = scanner.scan(types, s_pull_shm_metric_filter);
+    }
 
-        // time is a time when message was received
-        uint64_t _time = fty_proto_time(m);
-        insert_into_measurement(
-            conn, db_topic.c_str(), value, scale, int64_t(_time), fty_proto_unit(m), fty_proto_name(m));
-
-        // inserted, flag this metric
-        if ((fty_proto_time(m) + fty_proto_ttl(m)) < uint64_t(time(nullptr))) {
-            uint32_t new_ttl = uint32_t(fty_proto_ttl(m) - (uint64_t(time(nullptr)) - fty_proto_time(m)));
-            fty_proto_set_ttl(m, new_ttl);
-            fty_proto_aux_insert(m, "x-ms-flag", "1");
-            fty::shm::write_metric(m);
+    size_t count = 0;
+    {
+        TraceSpan span("shm.store");
+        for (auto& batch : batches) {
+            capture_shm_metrics(batch.metrics);
+            for (auto& m : batch.metrics) {
+                pipeline.push(&m);
+            }
+            count += batch.metrics.size();
         }
     }
+    log_debug("metrics kept from shm : %zu", count);
+
+    // flags of the expired metrics, once the metrics are handed over
+    shm_write_back(batches);
 }
 
-void fty_metric_store_metric_pull(zsock_t* pipe, void* /*args*/)
+void fty_metric_store_metric_pull(zsock_t* pipe, void* args)
 {
     assert(pipe);
+    assert(args);
+    IngestPipeline& pipeline = *static_cast<IngestPipeline*>(args);
     zpoller_t* poller = zpoller_new(pipe, nullptr);
     assert(poller);
 
+    int         scanners     = 1;
+    const char* env_scanners = getenv(EV_DBSTORE_SHM_SCANNERS);
+    if (env_scanners) {
+        scanners = std::min(std::max(atoi(env_scanners), 1), SHM_SCANNERS_MAX);
+        log_info("use %s %s", EV_DBSTORE_SHM_SCANNERS, env_scanners);
+    }
+    // reused by each poll cycle
+    ShmScanner scanner(scanners);
+
+    trace_thread_name("fty_metric_store_metric_pull");
     log_info("fty_metric_store_metric_pull started");
     zsock_signal(pipe, 0);
 
@@ -490,13 +574,7 @@ void fty_metric_store_metric_pull(zsock_t* pipe, void* /*args*/)
 
             if (zpoller_expired(poller)) {
                 log_debug("read metrics from shm");
-                fty::shm::shmMetrics result;
-                fty::shm::read_metrics(".*", ".*", result);
-                log_debug("metric reads : %d", result.size());
-
-                g_row_mutex.lock();
-                s_process_pull_store_shm_metrics(result);
-                g_row_mutex.unlock();
+                s_process_pull_store_shm_metrics(scanner, pipeline);
             }
             timeout = uint64_t(fty_get_polling_interval() * 1000);
             continue;
@@ -526,8 +604,12 @@ void fty_metric_store_metric_pull(zsock_t* pipe, void* /*args*/)
 // fty_metric_store main actor
 //
 
-void fty_metric_store_server(zsock_t* pipe, void* /*args*/)
+void fty_metric_store_server(zsock_t* pipe, void* args)
 {
+    if (args) {
+        DB_URL = static_cast<const char*>(args);
+    }
+
     mlm_client_t* client = mlm_client_new();
     if (!client) {
         log_error("mlm_client_new () failed");
@@ -541,31 +623,140 @@ void fty_metric_store_server(zsock_t* pipe, void* /*args*/)
         return;
     }
 
-    zactor_t* store_metrics_pull = zactor_new(fty_metric_store_metric_pull, nullptr);
+    size_t      queue_capacity = INGEST_QUEUE_DEFAULT;
+    const char* env_queue      = getenv(EV_DBSTORE_INGEST_QUEUE);
+    if (env_queue && atoi(env_queue) > 0) {
+        queue_capacity = size_t(atoi(env_queue));
+        log_info("use %s %s", EV_DBSTORE_INGEST_QUEUE, env_queue);
+    }
+    int         parsers     = INGEST_PARSERS_DEFAULT;
+    const char* env_parsers = getenv(EV_DBSTORE_INGEST_PARSERS);
+    if (env_parsers) {
+        parsers = std::max(atoi(env_parsers), 0);
+        log_info("use %s %s", EV_DBSTORE_INGEST_PARSERS, env_parsers);
+    }
+    // one writer per shard, each one with its own DB connection
+    IngestQueues                  queues(queue_capacity);
+    std::vector<IngestWriterArgs> writer_args;
+    std::vector<zactor_t*>        ingest_writers;
+    auto                          destroy_writers = [&ingest_writers]() {
+        for (auto& writer : ingest_writers) {
+            zactor_destroy(&writer);
+        }
+    };
+    for (int shard = 0; shard < queues.size(); shard++) {
+        writer_args.push_back({DB_URL, queues[shard], shard});
+    }
+    for (auto& args : writer_args) {
+        zactor_t* writer = zactor_new(fty_metric_store_ingest_writer, &args);
+        if (!writer) {
+            log_error("zactor_new () failed");
+            destroy_writers();
+            zpoller_destroy(&poller);
+            mlm_client_destroy(&client);
+            return;
+        }
+        ingest_writers.push_back(writer);
+    }
+
+    std::unique_ptr<IngestPipeline> pipeline(new IngestPipeline(queues, parsers));
+
+    zactor_t* store_metrics_pull = zactor_new(fty_metric_store_metric_pull, pipeline.get());
     if (!store_metrics_pull) {
         log_error("zactor_new () failed");
+        pipeline.reset();
+        destroy_writers();
+        zpoller_destroy(&poller);
+        mlm_client_destroy(&client);
+        return;
+    }
+
+    zactor_t* asset_delete = zactor_new(fty_metric_store_asset_delete, &DB_URL);
+    if (!asset_delete) {
+        log_error("zactor_new () failed");
+        zactor_destroy(&store_metrics_pull);
+        pipeline.reset();
+        destroy_writers();
         zpoller_destroy(&poller);
         mlm_client_destroy(&client);
         return;
     }
 
+    zactor_t* archiver = nullptr;
+    if (archive_enabled()) {
+        archiver = zactor_new(fty_metric_store_archiver, &DB_URL);
+        if (!archiver) {
+            log_error("zactor_new () failed, measurements are not archived");
+        }
+    }
+
+    // GET requests and the partition maintenance, out of the loop
+    int         db_io_threads = DB_IO_THREADS_DEFAULT;
+    const char* env_threads   = getenv(EV_DBSTORE_DB_IO_THREADS);
+    if (env_threads) {
+        db_io_threads = std::min(std::max(atoi(env_threads), 0), DB_IO_THREADS_MAX);
+        log_info("use %s %s", EV_DBSTORE_DB_IO_THREADS, env_threads);
+    }
+    int         get_timeout = DB_IO_TIMEOUT_DEFAULT;
+    const char* env_timeout = getenv(EV_DBSTORE_DB_IO_TIMEOUT);
+    if (env_timeout) {
+        get_timeout = std::max(atoi(env_timeout), 0);
+        log_info("use %s %s", EV_DBSTORE_DB_IO_TIMEOUT, env_timeout);
+    }
+    std::unique_ptr<DbIo> db_io(new DbIo(db_io_threads));
+    db_io->add_to(poller);
+    bool partition_running = false;
+
+    trace_thread_name("fty_metric_store_server");
     log_info("fty_metric_store_server started");
     zsock_signal(pipe, 0);
 
-    const uint64_t timeout = uint64_t(POLL_INTERVAL);
-    uint64_t       last    = uint64_t(zclock_mono());
+    const uint64_t timeout        = uint64_t(POLL_INTERVAL);
+    const uint64_t start          = uint64_t(zclock_mono());
+    uint64_t       last_partition = 0;
+    uint64_t       last_stats     = start;
+    uint64_t       last_freshness = start;
+
+    size_t      stream_batch = STREAM_BATCH_DEFAULT;
+    const char* env_batch    = getenv(EV_DBSTORE_STREAM_BATCH);
+    if (env_batch && atoi(env_batch) > 0) {
+        stream_batch = size_t(atoi(env_batch));
+        log_info("use %s %s", EV_DBSTORE_STREAM_BATCH, env_batch);
+    }
+
+    const char* env_stats      = getenv(EV_DBSTORE_STATS_INTERVAL);
+    uint64_t    stats_interval = env_stats ? uint64_t(std::max(atoi(env_stats), 0)) * 1000 : 0;
+    if (stats_interval) {
+        log_info("use %s %s", EV_DBSTORE_STATS_INTERVAL, env_stats);
+    }
 
     while (!zsys_interrupted) {
+        // the periodic flush is done by the ingest writer
         uint64_t now = uint64_t(zclock_mono());
-        if ((now - last) >= timeout) {
-            last = now;
-            // do a periodic flush
-            g_row_mutex.lock();
-            flush_measurement_when_needed(DB_URL);
-            g_row_mutex.unlock();
+        if ((now - last_freshness) >= FRESHNESS_CHECK_INTERVAL) {
+            last_freshness = now;
+            freshness_check();
+        }
+        if (stats_interval && (now - last_stats) >= stats_interval) {
+            last_stats = now;
+            s_publish_stats(client, uint32_t(2 * stats_interval / 1000));
+        }
+        if (partition_enabled() && !partition_running &&
+            (last_partition == 0 || (now - last_partition) >= PARTITION_CHECK_INTERVAL)) {
+            last_partition    = now;
+            partition_running = true;
+            // create partitions ahead and drop the expired ones, no timeout: never twice at once
+            db_io->submit("partition.maintenance",
+                []() {
+                    partition_maintenance(DB_URL, int64_t(time(nullptr)));
+                },
+                [&partition_running](bool) {
+                    partition_running = false;
+                },
+                0);
         }
 
-        void* which = zpoller_wait(poller, int(timeout));
+        void* which = zpoller_wait(poller, db_io->expire(int(timeout)));
 
         if (which == nullptr) {
             if (zpoller_expired(poller) && !zsys_interrupted) {
@@ -593,38 +784,59 @@ void fty_metric_store_server(zsock_t* pipe, void* /*args*/)
             continue;
         }
 
-        if (which == mlm_client_msgpipe(client)) {
-            zmsg_t*     message = mlm_client_recv(client);
-            const char* command = mlm_client_command(client);
-
-            if (!message) {
-                log_error("mlm_client_recv () returns nullptr");
-            }
-            else if (!command) {
-                log_error("mlm_client_command () returns nullptr");
-            }
-            else {
-                log_debug("received command '%s'", command);
+        if (db_io->dispatch(which)) {
+            continue;
+        }
 
-                if (streq(command, "STREAM DELIVER")) {
-                    s_handle_stream(client, &message);
+        if (which == mlm_client_msgpipe(client)) {
+            // drains the pending deliveries up to the batch limit, the stream metrics are
+            // handed over to the parsers without waking up the poller for each one
+            TraceSpan span("stream.batch");
+            size_t    count = 0;
+            do {
+                zmsg_t*     message = mlm_client_recv(client);
+                const char* command = mlm_client_command(client);
+
+                if (!message) {
+                    log_error("mlm_client_recv () returns nullptr");
                 }
-                else if (streq(command, "MAILBOX DELIVER")) {
-                    s_handle_mailbox(client, &message);
+                else if (!command) {
+                    log_error("mlm_client_command () returns nullptr");
                 }
                 else {
-                    log_error("Unrecognized mlm_client_command () = '%s'", command);
+                    log_debug("received command '%s'", command);
+
+                    if (streq(command, "STREAM DELIVER")) {
+                        s_handle_stream(client, &message, asset_delete, *pipeline, queues);
+                    }
+                    else if (streq(command, "MAILBOX DELIVER")) {
+                        s_handle_mailbox(client, &message, *db_io, get_timeout);
+                    }
+                    else {
+                        log_error("Unrecognized mlm_client_command () = '%s'", command);
+                    }
                 }
-            }
 
-            zmsg_destroy(&message);
+                zmsg_destroy(&message);
+                count++;
+            } while (count < stream_batch && !zsys_interrupted &&
+                     (zsock_events(mlm_client_msgpipe(client)) & ZMQ_POLLIN));
+            g_stream_batch.add(count);
             continue;
         }
     } // while
 
-    flush_measurement(DB_URL);
-
+    // the pending GET requests are not replied
+    db_io.reset();
+    zactor_destroy(&archiver);
+    zactor_destroy(&asset_delete);
     zactor_destroy(&store_metrics_pull);
+    // parses the queued metrics
+    pipeline.reset();
+    // stores the queued measurements and flushes
+    destroy_writers();
+
+    capture_stop();
     zpoller_destroy(&poller);
     mlm_client_destroy(&client);
 
@@ -20,11 +20,22 @@
 */
 
 #pragma once
+#include "persistance.h"
 #include <czmq.h>
 
 #define FTY_METRIC_STORE_CONF_PREFIX "FTY_METRIC_STORE_AGE"
 #define POLL_INTERVAL                1000
 #define AVG_GRAPH                    "aggregated data"
 
-//  Metric store actor
+// Consume the METRICS stream besides the metrics of shm when set to a non zero value [0]
+#define EV_DBSTORE_STREAM_METRICS "BIOS_DBSTORE_STREAM_METRICS"
+// Deliveries of the malamute client handled per wakeup of the server actor [256]
+#define EV_DBSTORE_STREAM_BATCH "BIOS_DBSTORE_STREAM_BATCH"
+#define STREAM_BATCH_DEFAULT    256
+
+//  Metric store actor, 'args' is the storage url (const char*), nullptr for the MySQL
+//  database of DB_USER/DB_PASSWD. "memory:<name>" stores measurements in memory.
 void fty_metric_store_server(zsock_t* pipe, void* args);
+
+//  Appends the timestamp and value frames of one measurement to the reply of a GET request
+void reply_add_measurement(zmsg_t* reply, int64_t timestamp, m_msrmnt_value_t value, m_msrmnt_scale_t scale);
@@ -0,0 +1,509 @@
+/*  =========================================================================
+    ingest_loadgen - End to end ingest load generator
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    ingest_loadgen - End to end ingest load generator
+@discuss
+    Runs the metric store server against an in process malamute broker (as
+    the unit test does), publishes fty_proto METRIC messages with x-cm-type
+    at a target rate on the METRICS stream, ASSET delete messages on the
+    ASSETS stream, and optionally writes metrics to a local fty_shm directory
+    read by the pull actor.
+
+    Each metric is tracked until the storage reports it committed (see
+    persistance_set_commit_cb()), which gives the end to end lag from the
+    publication and from fty_proto_time.
+
+    With --ramp, the rate is multiplied by the factor at each stage until the
+    backlog (published but not committed metrics) grows during a stage. The
+    last rate without growing backlog is the sustained maximum rate.
+@end
+*/
+
+#include "bench_util.h"
+#include "fty_metric_store_server.h"
+#include "persistance.h"
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <fty_log.h>
+#include <fty_proto.h>
+#include <fty_shm.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <malamute.h>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#define LOADGEN_ENDPOINT "inproc://fty-metric-store-loadgen"
+#define LOADGEN_AGENT    "fty-metric-store"
+#define STREAM_PREFIX    "bench.topic"
+#define SHM_PREFIX       "bench.shm"
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct LoadWorkload
+{
+    std::string url              = "memory:loadgen";
+    int         assets           = 100;
+    int         topics_per_asset = 10;
+    std::string step             = "15m";
+    double      rate             = 1000; // metrics/s
+    int         stage_seconds    = 10;
+    double      ramp             = 0; // rate factor between stages, 0 means one stage
+    int         max_stages       = 20;
+    double      deletes          = 0; // ASSET delete messages/s
+    std::string shm_dir;              // fty_shm test directory, none if empty
+    int         shm_topics       = 0; // topics written to shm per asset
+    int         shm_interval     = 1; // s
+    int         drain_seconds    = 10;
+    uint64_t    seed             = 1;
+};
+
+// metrics published but not yet committed
+class Tracker
+{
+public:
+    void published(const std::string& topic, int64_t time)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending[key(topic, time)].push_back(bench_clock::now());
+        _published++;
+    }
+
+    void committed(const std::string& topic, int64_t time)
+    {
+        auto                        now = bench_clock::now();
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto                        it = _pending.find(key(topic, time));
+        if (it == _pending.end()) {
+            _unmatched++;
+            return;
+        }
+        _lag.add(now - it->second.front());
+        int64_t wall_ms = int64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        _lag_from_time.add(std::chrono::milliseconds(wall_ms - time * 1000));
+        it->second.pop_front();
+        if (it->second.empty()) {
+            _pending.erase(it);
+        }
+        _committed++;
+    }
+
+    int64_t backlog()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _published - _committed;
+    }
+
+    int64_t published()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _published;
+    }
+
+    int64_t committed()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _committed;
+    }
+
+    int64_t unmatched()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _unmatched;
+    }
+
+    std::string json()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::ostringstream          json;
+        json << "{\"published\":" << _published << ",\"committed\":" << _committed
+             << ",\"unmatched\":" << _unmatched << ",\"lag_us\":" << _lag.json()
+             << ",\"lag_from_time_us\":" << _lag_from_time.json() << "}";
+        return json.str();
+    }
+
+    void log(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        log_info("%s: published=%" PRIi64 " committed=%" PRIi64 " lag (us) p50=%.1f p99=%.1f p999=%.1f", name,
+            _published, _committed, _lag.percentile(0.5), _lag.percentile(0.99), _lag.percentile(0.999));
+    }
+
+private:
+    static std::string key(const std::string& topic, int64_t time)
+    {
+        return topic + "/" + std::to_string(time);
+    }
+
+    std::mutex                                                         _mutex;
+    std::unordered_map<std::string, std::deque<bench_clock::time_point>> _pending;
+    int64_t                                                            _published = 0;
+    int64_t                                                            _committed = 0;
+    int64_t                                                            _unmatched = 0;
+    BenchLatency                                                       _lag;
+    BenchLatency                                                       _lag_from_time;
+};
+
+static Tracker g_stream;
+static Tracker g_shm;
+
+struct Stage
+{
+    double  target_rate;
+    double  achieved_rate;
+    int64_t backlog_start;
+    int64_t backlog_end;
+    bool    saturated;
+};
+
+static std::string s_asset(int a)
+{
+    return "bench.asset" + std::to_string(a);
+}
+
+static std::string s_type(const char* prefix, int t, const std::string& step)
+{
+    return prefix + std::to_string(t) + "_avg_" + step;
+}
+
+static void s_commit(const std::string& topic, int64_t timestamp)
+{
+    if (topic.compare(0, strlen(SHM_PREFIX), SHM_PREFIX) == 0) {
+        g_shm.committed(topic, timestamp);
+    } else {
+        g_stream.committed(topic, timestamp);
+    }
+}
+
+// writes shm metrics every interval until 'stop'
+static void s_shm_writer(const LoadWorkload& w, std::atomic<bool>& stop)
+{
+    BenchRandom random(w.seed + 1000);
+    while (!stop && !zsys_interrupted) {
+        uint64_t now = uint64_t(time(nullptr));
+        for (int a = 0; a < w.assets; a++) {
+            for (int t = 0; t < w.shm_topics; t++) {
+                std::string  type = s_type(SHM_PREFIX, t, w.step);
+                fty_proto_t* m    = fty_proto_new(FTY_PROTO_METRIC);
+                fty_proto_set_name(m, "%s", s_asset(a).c_str());
+                fty_proto_set_type(m, "%s", type.c_str());
+                fty_proto_set_value(m, "%.2f", random.uniform() * 1000);
+                fty_proto_set_unit(m, "%s", "W");
+                fty_proto_set_time(m, now);
+                fty_proto_set_ttl(m, uint32_t(w.shm_interval * 3));
+                fty_proto_aux_insert(m, "x-cm-type", "%s", "avg");
+                if (fty::shm::write_metric(m) == 0) {
+                    g_shm.published(type + "@" + s_asset(a), int64_t(now));
+                }
+                fty_proto_destroy(&m);
+            }
+        }
+        for (int i = 0; i < w.shm_interval * 100 && !stop && !zsys_interrupted; i++) {
+            zclock_sleep(10);
+        }
+    }
+}
+
+// publishes metrics (and asset deletes) at the rate for the duration, returns achieved rate
+static double s_publish(const LoadWorkload& w, mlm_client_t* metrics, mlm_client_t* assets, double rate,
+    BenchRandom& random, int64_t& sequence)
+{
+    const int64_t topics   = int64_t(w.assets) * w.topics_per_asset;
+    auto          begin    = bench_clock::now();
+    auto          end      = begin + std::chrono::seconds(w.stage_seconds);
+    int64_t       sent     = 0;
+    int64_t       deletes  = 0;
+    zhash_t*      aux      = zhash_new();
+    zhash_autofree(aux);
+    zhash_insert(aux, "x-cm-type", const_cast<char*>("avg"));
+
+    while (!zsys_interrupted) {
+        auto now = bench_clock::now();
+        if (now >= end) {
+            break;
+        }
+        double elapsed = std::chrono::duration<double>(now - begin).count();
+
+        // catch up the target, then yield
+        int64_t due = int64_t(rate * elapsed) + 1;
+        for (; sent < due; sent++, sequence++) {
+            int64_t     index = sequence % topics;
+            std::string name  = s_asset(int(index / w.topics_per_asset));
+            std::string type  = s_type(STREAM_PREFIX, int(index % w.topics_per_asset), w.step);
+            uint64_t    t     = uint64_t(time(nullptr));
+            char        value[32];
+            snprintf(value, sizeof(value), "%.2f", random.uniform() * 1000);
+
+            zmsg_t*     msg     = fty_proto_encode_metric(aux, t, 300, type.c_str(), name.c_str(), value, "W");
+            std::string subject = type + "@" + name;
+            g_stream.published(subject, int64_t(t));
+            if (mlm_client_send(metrics, subject.c_str(), &msg) != 0) {
+                zmsg_destroy(&msg);
+                log_error("can't publish %s", subject.c_str());
+            }
+        }
+
+        int64_t due_deletes = int64_t(w.deletes * elapsed);
+        for (; deletes < due_deletes; deletes++) {
+            // assets without metrics, exercise the delete path only
+            std::string name = "bench.deleted" + std::to_string(random.below(1000));
+            zmsg_t*     msg  = fty_proto_encode_asset(nullptr, name.c_str(), FTY_PROTO_ASSET_OP_DELETE, nullptr);
+            mlm_client_send(assets, ("device@" + name).c_str(), &msg);
+            zmsg_destroy(&msg);
+        }
+        zclock_sleep(1);
+    }
+    zhash_destroy(&aux);
+
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - begin).count();
+    return elapsed > 0 ? double(sent) / elapsed : 0;
+}
+
+static std::string s_workload_json(const LoadWorkload& w)
+{
+    std::ostringstream json;
+    json << "{\"assets\":" << w.assets << ",\"topics_per_asset\":" << w.topics_per_asset
+         << ",\"step\":" << bench_json_string(w.step) << ",\"rate\":" << w.rate
+         << ",\"stage_seconds\":" << w.stage_seconds << ",\"ramp\":" << w.ramp << ",\"deletes\":" << w.deletes
+         << ",\"shm_topics\":" << (w.shm_dir.empty() ? 0 : w.shm_topics) << ",\"seed\":" << w.seed << "}";
+    return json.str();
+}
+
+static int s_loadgen(const LoadWorkload& w, bool json)
+{
+    bool shm = !w.shm_dir.empty() && w.shm_topics > 0;
+    if (shm) {
+        fty_shm_set_test_dir(w.shm_dir.c_str());
+        fty_shm_set_default_polling_interval(w.shm_interval);
+    }
+    persistance_set_commit_cb(s_commit);
+
+    zactor_t* broker = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+    zstr_sendx(broker, "BIND", LOADGEN_ENDPOINT, nullptr);
+
+    zactor_t* server = zactor_new(fty_metric_store_server, const_cast<char*>(w.url.c_str()));
+    zstr_sendx(server, "CONNECT", LOADGEN_ENDPOINT, LOADGEN_AGENT, nullptr);
+    zstr_sendx(server, "CONSUMER", FTY_PROTO_STREAM_METRICS, ".*", nullptr);
+    zstr_sendx(server, "CONSUMER", FTY_PROTO_STREAM_ASSETS, ".*", nullptr);
+
+    mlm_client_t* metrics = mlm_client_new();
+    mlm_client_connect(metrics, LOADGEN_ENDPOINT, 5000, "loadgen-metrics");
+    mlm_client_set_producer(metrics, FTY_PROTO_STREAM_METRICS);
+    mlm_client_t* assets = mlm_client_new();
+    mlm_client_connect(assets, LOADGEN_ENDPOINT, 5000, "loadgen-assets");
+    mlm_client_set_producer(assets, FTY_PROTO_STREAM_ASSETS);
+    // let the server subscribe
+    zclock_sleep(500);
+
+    std::atomic<bool> stop(false);
+    std::thread       shm_writer;
+    if (shm) {
+        shm_writer = std::thread(s_shm_writer, std::cref(w), std::ref(stop));
+    }
+
+    BenchRandom        random(w.seed);
+    int64_t            sequence      = 0;
+    double             max_sustained = 0;
+    std::vector<Stage> stages;
+    for (int k = 0; k < (w.ramp > 1 ? w.max_stages : 1) && !zsys_interrupted; k++) {
+        Stage stage;
+        stage.target_rate   = w.rate * std::pow(w.ramp > 1 ? w.ramp : 1, k);
+        stage.backlog_start = g_stream.backlog();
+        stage.achieved_rate = s_publish(w, metrics, assets, stage.target_rate, random, sequence);
+        stage.backlog_end   = g_stream.backlog();
+        // backlog grew by more than one second of traffic (or 5% of the stage)
+        double tolerance = std::max(stage.achieved_rate, 0.05 * stage.achieved_rate * w.stage_seconds);
+        stage.saturated  = double(stage.backlog_end - stage.backlog_start) > tolerance;
+        stages.push_back(stage);
+
+        log_info("stage %d: target=%.0f/s achieved=%.0f/s backlog %" PRIi64 " -> %" PRIi64 "%s", k,
+            stage.target_rate, stage.achieved_rate, stage.backlog_start, stage.backlog_end,
+            stage.saturated ? " (saturated)" : "");
+        if (stage.saturated) {
+            break;
+        }
+        max_sustained = stage.achieved_rate;
+        if (stage.achieved_rate < 0.9 * stage.target_rate) {
+            log_warning("generator can't reach %.0f/s, stop ramping", stage.target_rate);
+            break;
+        }
+    }
+
+    // drain
+    auto drain_end = bench_clock::now() + std::chrono::seconds(w.drain_seconds);
+    while (g_stream.backlog() > 0 && bench_clock::now() < drain_end && !zsys_interrupted) {
+        zclock_sleep(100);
+    }
+    stop = true;
+    if (shm_writer.joinable()) {
+        shm_writer.join();
+    }
+
+    mlm_client_destroy(&assets);
+    mlm_client_destroy(&metrics);
+    zactor_destroy(&server);
+    zactor_destroy(&broker);
+    persistance_set_commit_cb(nullptr);
+    if (shm) {
+        fty_shm_delete_test_dir();
+    }
+
+    g_stream.log("stream");
+    if (shm) {
+        g_shm.log("shm");
+    }
+    log_info("max sustained rate: %.0f metrics/s, %" PRIi64 " metrics not committed", max_sustained,
+        g_stream.backlog());
+
+    if (json) {
+        std::string stages_json;
+        for (const auto& s : stages) {
+            char buffer[256];
+            snprintf(buffer, sizeof(buffer),
+                "{\"target_rate\":%.1f,\"achieved_rate\":%.1f,\"backlog_start\":%" PRIi64 ",\"backlog_end\":%" PRIi64
+                ",\"saturated\":%s}",
+                s.target_rate, s.achieved_rate, s.backlog_start, s.backlog_end, s.saturated ? "true" : "false");
+            stages_json += (stages_json.empty() ? "" : ",") + std::string(buffer);
+        }
+        printf("{\"bench\":\"ingest\",\"url\":%s,\"workload\":%s,\"stages\":[%s],\"max_sustained_rate\":%.1f,"
+               "\"stream\":%s,\"shm\":%s}\n",
+            bench_json_string(w.url).c_str(), s_workload_json(w).c_str(), stages_json.c_str(), max_sustained,
+            g_stream.json().c_str(), g_shm.json().c_str());
+    }
+    return 0;
+}
+
+static void s_usage()
+{
+    puts("fty-metric-store-ingest-loadgen [options]\n"
+         "  -u|--url              storage url, memory:<name> or mysql:... [memory:loadgen]\n"
+         "  -e|--element          number of assets [100]\n"
+         "  -t|--topic            number of topics per asset [10]\n"
+         "  -s|--step             step of the topics [15m]\n"
+         "  -r|--rate             published metrics per second [1000]\n"
+         "  -d|--duration         duration of a stage in seconds [10]\n"
+         "  -R|--ramp             rate factor between stages, until backlog grows (e.g. 1.5) [no ramp]\n"
+         "  -D|--deletes          ASSET delete messages per second [0]\n"
+         "  -m|--shm-dir          fty_shm directory written for the pull actor [none]\n"
+         "  -M|--shm-topics       topics per asset written to shm [0]\n"
+         "  -S|--seed             seed of the workload [1]\n"
+         "  -j|--json             print results as JSON on stdout\n"
+         "  -h|--help             print this information");
+}
+
+int main(int argc, char** argv)
+{
+    LoadWorkload w;
+    int          help = 0;
+    int          json = 0;
+
+// Some systems define struct option with non-"const" "char *"
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wwrite-strings"
+#endif
+    static const char*   short_options  = "hju:e:t:s:r:d:R:D:m:M:S:";
+    static struct option long_options[] = {
+        {"help", no_argument, &help, 1},
+        {"json", no_argument, &json, 1},
+        {"url", required_argument, 0, 'u'},
+        {"element", required_argument, 0, 'e'},
+        {"topic", required_argument, 0, 't'},
+        {"step", required_argument, 0, 's'},
+        {"rate", required_argument, 0, 'r'},
+        {"duration", required_argument, 0, 'd'},
+        {"ramp", required_argument, 0, 'R'},
+        {"deletes", required_argument, 0, 'D'},
+        {"shm-dir", required_argument, 0, 'm'},
+        {"shm-topics", required_argument, 0, 'M'},
+        {"seed", required_argument, 0, 'S'},
+        {NULL, 0, 0, 0}};
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic pop
+#endif
+
+    while (true) {
+        int option_index = 0;
+        int c            = getopt_long(argc, argv, short_options, long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'u':
+                w.url = optarg;
+                break;
+            case 'e':
+                w.assets = std::max(atoi(optarg), 1);
+                break;
+            case 't':
+                w.topics_per_asset = std::max(atoi(optarg), 1);
+                break;
+            case 's':
+                w.step = optarg;
+                break;
+            case 'r':
+                w.rate = std::max(atof(optarg), 1.0);
+                break;
+            case 'd':
+                w.stage_seconds = std::max(atoi(optarg), 1);
+                break;
+            case 'R':
+                w.ramp = atof(optarg);
+                break;
+            case 'D':
+                w.deletes = atof(optarg);
+                break;
+            case 'm':
+                w.shm_dir = optarg;
+                break;
+            case 'M':
+                w.shm_topics = std::max(atoi(optarg), 0);
+                break;
+            case 'S':
+                w.seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'j':
+                json = 1;
+                break;
+            case 0:
+                // just now walking trough some long opt
+                break;
+            case 'h':
+            default:
+                help = 1;
+                break;
+        }
+    }
+    if (help) {
+        s_usage();
+        return 1;
+    }
+
+    ManageFtyLog::setInstanceFtylog("ingest_loadgen", FTY_COMMON_LOGGING_DEFAULT_CFG);
+    zsys_catch_interrupts();
+
+    return s_loadgen(w, json);
+}
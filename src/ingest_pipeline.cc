@@ -0,0 +1,379 @@
+/*  =========================================================================
+    ingest_pipeline - Parse stage of the ingest pipeline
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    ingest_pipeline - Parse stage of the ingest pipeline
+@discuss
+    Ingest runs in stages connected by bounded lock-free queues:
+      receive (server actor: METRICS stream, pull actor: shm read and filter)
+        -> SPSC queues -> parse (N parser actors: decode, filter, value, topic)
+        -> MPSC ingest queues -> resolve, batch and write (ingest writer actor per shard)
+    Metrics of a topic always go to the same parser and to the same writer, so the
+    writer receives the measurements of a topic in order.
+@end
+*/
+
+#include "ingest_pipeline.h"
+#include "converter.h"
+#include "freshness.h"
+#include "intern.h"
+#include "memory_account.h"
+#include "retention.h"
+#include "stats.h"
+#include "trace.h"
+#include <cstring>
+#include <fty_log.h>
+#include <memory_resource>
+#include <thread>
+
+static StatsCounter& g_metrics_received     = stats_counter("metrics.received");
+static StatsCounter& g_metrics_no_cm_type   = stats_counter("metrics.filtered.cm_type");
+static StatsCounter& g_metrics_not_stored   = stats_counter("metrics.filtered.age");
+static StatsCounter& g_metrics_parse_errors = stats_counter("metrics.parse_errors");
+static StatsCounter& g_parse_queue_full     = stats_counter("ingest.parse_queue_full");
+static StatsCounter& g_dropped              = stats_counter("ingest.dropped");
+static StatsCounter& g_decodes_avoided      = stats_counter("metrics.decodes_avoided");
+static MemoryAccount& g_memory              = memory_account("ingest_queue");
+
+//
+// parse
+//
+
+static void s_parse(fty_proto_t* m, IngestQueues& output)
+{
+    // the topic is only looked up in the interned ones, built in an arena on the stack
+    char                                buffer[INGEST_TOPIC_ARENA];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+    std::pmr::string                    db_topic(&arena);
+    const char*                         type = fty_proto_type(m);
+    const char*                         name = fty_proto_name(m);
+    db_topic.reserve(strlen(type) + 1 + strlen(name));
+    db_topic.append(type).append(1, '@').append(name);
+
+    // ignore steps with storage age 0
+    int step = retention_topic_step(db_topic.c_str());
+    if (!retention_is_stored(step)) {
+        g_metrics_not_stored.add();
+        return;
+    }
+
+    IngestRecord record;
+    if (!string_to_measurement(fty_proto_value(m), record.value, record.scale)) {
+        g_metrics_parse_errors.add();
+        return;
+    }
+
+    // time is a time when message was received
+    record.time = int64_t(fty_proto_time(m));
+    record.step = step;
+    freshness_record(FRESHNESS_PARSED, step, record.time);
+    record.topic       = &intern(db_topic);
+    record.units       = &intern(fty_proto_unit(m));
+    record.device_name = &intern(name);
+    output.push(std::move(record));
+}
+
+void ingest_stream_metric(fty_proto_t* metric, IngestQueues& output)
+{
+    assert(metric);
+    assert(fty_proto_id(metric) == FTY_PROTO_METRIC);
+
+    g_metrics_received.add();
+
+    // ignore the stuff not coming from computation module, unless raw metrics are stored
+    if (!fty_proto_aux_string(metric, "x-cm-type", nullptr) && !is_raw_measurement_stored()) {
+        g_metrics_no_cm_type.add();
+        return;
+    }
+    s_parse(metric, output);
+}
+
+bool ingest_stream_prefilter(zmsg_t* message, const char* subject)
+{
+    assert(message);
+
+    // the subject of a metric is its topic (type@name): ignore steps with storage age 0
+    if (subject && strchr(subject, '@') && !retention_is_stored(retention_topic_step(subject))) {
+        g_metrics_received.add();
+        g_metrics_not_stored.add();
+        g_decodes_avoided.add();
+        return false;
+    }
+    // the aux keys are plain strings of the encoded frame: without "x-cm-type", the metric
+    // did not come from the computation module
+    zframe_t* frame = zmsg_first(message);
+    if (frame && !is_raw_measurement_stored() &&
+        !memmem(zframe_data(frame), zframe_size(frame), "x-cm-type", strlen("x-cm-type"))) {
+        g_metrics_received.add();
+        g_metrics_no_cm_type.add();
+        g_decodes_avoided.add();
+        return false;
+    }
+    return true;
+}
+
+void ingest_stream_message(zmsg_t** message, IngestQueues& output)
+{
+    fty_proto_t* m = fty_proto_decode(message);
+    if (!m) {
+        log_error("Can't decode the fty_proto message, ignore it");
+    } else if (fty_proto_id(m) != FTY_PROTO_METRIC) {
+        log_error("Unsupported fty_proto message with id = '%d' on the METRICS stream", fty_proto_id(m));
+    } else {
+        ingest_stream_metric(m, output);
+    }
+    fty_proto_destroy(&m);
+    zmsg_destroy(message);
+}
+
+void ingest_shm_metric(fty_proto_t* metric, IngestQueues& output)
+{
+    assert(metric);
+    s_parse(metric, output);
+}
+
+//
+// queues between the stages
+//
+
+IngestSpscQueue::IngestSpscQueue(size_t capacity, IngestSignal& signal)
+    : _signal(signal)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    _items.reset(new IngestItem[size]);
+    _mask = size - 1;
+    g_memory.add(size * sizeof(IngestItem));
+}
+
+IngestSpscQueue::~IngestSpscQueue()
+{
+    IngestItem item;
+    while (pop(item)) {
+        zmsg_destroy(&item.message);
+        fty_proto_destroy(&item.metric);
+    }
+    g_memory.sub((_mask + 1) * sizeof(IngestItem));
+}
+
+bool IngestSpscQueue::push(const IngestItem& item)
+{
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) > _mask) {
+        return false;
+    }
+    _items[tail & _mask] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    _signal.notify();
+    return true;
+}
+
+bool IngestSpscQueue::pop(IngestItem& item)
+{
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    item = _items[head & _mask];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool IngestSpscQueue::empty() const
+{
+    return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+}
+
+//
+// parser actors
+//
+
+struct IngestParser
+{
+    IngestSignal                                  signal;
+    std::vector<std::unique_ptr<IngestSpscQueue>> inputs; // by producer
+    IngestQueues*                                 output = nullptr;
+    zactor_t*                                     actor  = nullptr;
+};
+
+// parses the queued items, returns their number
+static size_t s_parse_items(IngestParser& parser)
+{
+    size_t     count = 0;
+    IngestItem item;
+    for (auto& input : parser.inputs) {
+        while (input->pop(item)) {
+            if (item.message) {
+                ingest_stream_message(&item.message, *parser.output);
+            } else {
+                ingest_shm_metric(item.metric, *parser.output);
+                fty_proto_destroy(&item.metric);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool s_pipe_term(zsock_t* pipe)
+{
+    bool term = false;
+    while (!term && (zsock_events(pipe) & ZMQ_POLLIN)) {
+        zmsg_t* message = zmsg_recv(pipe);
+        if (!message) {
+            return true;
+        }
+        char* cmd = zmsg_popstr(message);
+        term      = cmd && streq(cmd, "$TERM");
+        zstr_free(&cmd);
+        zmsg_destroy(&message);
+    }
+    return term;
+}
+
+static void s_parser_actor(zsock_t* pipe, void* args)
+{
+    IngestParser& parser = *static_cast<IngestParser*>(args);
+
+    trace_thread_name("fty_metric_store_ingest_parser");
+    zsock_signal(pipe, 0);
+
+    auto ready = [&parser]() {
+        for (const auto& input : parser.inputs) {
+            if (!input->empty()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    // the producers may still push until the pipeline is destroyed, even when interrupted
+    while (!s_pipe_term(pipe)) {
+        parser.signal.wait(INGEST_IDLE_WAIT, ready);
+        TraceSpan span("ingest.parse");
+        s_parse_items(parser);
+    }
+    // metrics queued before the producers stopped
+    s_parse_items(parser);
+}
+
+IngestPipeline::IngestPipeline(IngestQueues& output, int parsers)
+    : _output(output)
+{
+    parsers = std::min(parsers, INGEST_PARSERS_MAX);
+    for (int i = 0; i < parsers; i++) {
+        std::unique_ptr<IngestParser> parser(new IngestParser());
+        for (int producer = 0; producer < INGEST_PRODUCERS; producer++) {
+            parser->inputs.emplace_back(new IngestSpscQueue(INGEST_STAGE_QUEUE, parser->signal));
+        }
+        parser->output = &output;
+        parser->actor  = zactor_new(s_parser_actor, parser.get());
+        if (!parser->actor) {
+            log_error("zactor_new () failed, %d parser(s) started", i);
+            break;
+        }
+        _parsers.push_back(std::move(parser));
+    }
+    log_info("ingest pipeline with %zu parser(s)", _parsers.size());
+}
+
+IngestPipeline::~IngestPipeline()
+{
+    stop();
+    for (auto& parser : _parsers) {
+        zactor_destroy(&parser->actor);
+    }
+}
+
+void IngestPipeline::stop()
+{
+    _stopping.store(true, std::memory_order_relaxed);
+}
+
+static void s_drop(IngestItem item)
+{
+    zmsg_destroy(&item.message);
+    fty_proto_destroy(&item.metric);
+    g_dropped.add();
+}
+
+void IngestPipeline::push(IngestProducer producer, uint64_t hash, const IngestItem& item)
+{
+    if (_stopping.load(std::memory_order_relaxed)) {
+        s_drop(item);
+        return;
+    }
+    IngestSpscQueue& input = *_parsers[hash % _parsers.size()]->inputs[size_t(producer)];
+    if (!input.push(item)) {
+        // back pressure, wait for the parser
+        g_parse_queue_full.add();
+        while (!input.push(item)) {
+            if (_stopping.load(std::memory_order_relaxed)) {
+                s_drop(item);
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+// FNV-1a
+static uint64_t s_hash(uint64_t hash, const char* s)
+{
+    for (; s && *s; s++) {
+        hash = (hash ^ uint8_t(*s)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static const uint64_t HASH_SEED = 14695981039346656037ull;
+
+void IngestPipeline::push(zmsg_t** message, const char* subject)
+{
+    assert(message && *message);
+    if (!ingest_stream_prefilter(*message, subject)) {
+        zmsg_destroy(message);
+        return;
+    }
+    if (_parsers.empty()) {
+        ingest_stream_message(message, _output);
+        return;
+    }
+    // the subject of a metric is its topic (type@name)
+    push(INGEST_STREAM, s_hash(HASH_SEED, subject), {*message, nullptr});
+    *message = nullptr;
+}
+
+void IngestPipeline::push(fty_proto_t** metric)
+{
+    assert(metric && *metric);
+    if (_parsers.empty()) {
+        ingest_shm_metric(*metric, _output);
+        fty_proto_destroy(metric);
+        return;
+    }
+    // same parser as the topic received from the stream
+    uint64_t hash = s_hash(s_hash(s_hash(HASH_SEED, fty_proto_type(*metric)), "@"), fty_proto_name(*metric));
+    push(INGEST_SHM, hash, {nullptr, *metric});
+    *metric = nullptr;
+}
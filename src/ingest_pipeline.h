@@ -0,0 +1,130 @@
+/*  =========================================================================
+    ingest_pipeline - Parse stage of the ingest pipeline
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "ingest_queue.h"
+#include <czmq.h>
+#include <fty_proto.h>
+#include <memory>
+#include <vector>
+
+// Number of parser threads [1], 0 parses the metrics in the threads receiving them
+#define EV_DBSTORE_INGEST_PARSERS "BIOS_DBSTORE_INGEST_PARSERS"
+
+#define INGEST_PARSERS_DEFAULT 1
+#define INGEST_PARSERS_MAX     16
+#define INGEST_STAGE_QUEUE     4096 // metrics, capacity of the queue from a producer to a parser
+#define INGEST_TOPIC_ARENA     256  // bytes on the stack for the topic being parsed, longer ones use the heap
+
+// Threads handing metrics to the parsers, each one has its own queue to each parser
+enum IngestProducer
+{
+    INGEST_STREAM = 0, // server actor, messages of the METRICS stream
+    INGEST_SHM,        // pull actor, metrics read from shm
+    INGEST_PRODUCERS
+};
+
+// Metric handed to a parser: an encoded message of the METRICS stream, or a metric
+// read from shm and filtered by the pull actor
+struct IngestItem
+{
+    zmsg_t*      message = nullptr;
+    fty_proto_t* metric  = nullptr;
+};
+
+// Bounded lock-free single-producer single-consumer queue of the items
+class IngestSpscQueue
+{
+public:
+    IngestSpscQueue(size_t capacity, IngestSignal& signal);
+    // destroys the items left
+    ~IngestSpscQueue();
+    IngestSpscQueue(const IngestSpscQueue&) = delete;
+    IngestSpscQueue& operator=(const IngestSpscQueue&) = delete;
+
+    // Returns false if the queue is full. Producer only
+    bool push(const IngestItem& item);
+    // Returns false if the queue is empty. Consumer only
+    bool pop(IngestItem& item);
+    bool empty() const;
+
+private:
+    std::unique_ptr<IngestItem[]>    _items;
+    size_t                           _mask;
+    alignas(64) std::atomic<size_t> _head{0}; // written by the consumer
+    alignas(64) std::atomic<size_t> _tail{0}; // written by the producer
+    IngestSignal&                    _signal;
+};
+
+struct IngestParser;
+
+// Decode/filter -> parse stages of the ingest. The producers hand metrics to the parser
+// threads by hash of the topic, so the measurements of a topic keep their order. Parsers
+// push the measurements to the ingest queue of the writer of their shard (resolve, batch and write).
+class IngestPipeline
+{
+public:
+    IngestPipeline(IngestQueues& output, int parsers);
+    // stops the parsers once they parsed the queued metrics, the producers must be stopped
+    // (a producer still pushing gives up, see stop())
+    ~IngestPipeline();
+    IngestPipeline(const IngestPipeline&) = delete;
+    IngestPipeline& operator=(const IngestPipeline&) = delete;
+
+    // Hands over a message of the METRICS stream (decoded by the parser) passing the
+    // pre-filter, waits while the queue of the parser is full. Called by the server actor only
+    void push(zmsg_t** message, const char* subject);
+
+    // Hands over a metric read from shm (filtered already). Called by the pull actor only
+    void push(fty_proto_t** metric);
+
+    // New metrics are dropped (ingest.dropped), producers waiting on a full queue give up.
+    // The parsers still parse the queued metrics
+    void stop();
+
+    int parsers() const
+    {
+        return int(_parsers.size());
+    }
+
+private:
+    void push(IngestProducer producer, uint64_t hash, const IngestItem& item);
+
+    IngestQueues&                              _output;
+    std::vector<std::unique_ptr<IngestParser>> _parsers;
+    std::atomic<bool>                          _stopping{false};
+};
+
+// Decodes and filters a message of the METRICS stream, parses the metric and pushes
+// the measurement to 'output'. Destroys the message
+void ingest_stream_message(zmsg_t** message, IngestQueues& output);
+
+// Returns false if the message of the METRICS stream is surely not stored, without decoding it:
+// the step of the subject (type@name) is not stored, or its frame has no x-cm-type aux key
+// (unless raw metrics are stored). Messages passing it are checked again once decoded.
+// Avoided decodes are counted by metrics.decodes_avoided
+bool ingest_stream_prefilter(zmsg_t* message, const char* subject);
+
+// Filters a metric received from the METRICS stream, parses it and pushes the measurement to 'output'
+void ingest_stream_metric(fty_proto_t* metric, IngestQueues& output);
+
+// Parses a metric read from shm (filtered by the pull actor) and pushes the measurement to 'output'
+void ingest_shm_metric(fty_proto_t* metric, IngestQueues& output);
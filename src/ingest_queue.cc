@@ -0,0 +1,248 @@
+/*  =========================================================================
+    ingest_queue - Queue of the measurements to store and its writer actor
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    ingest_queue - Queue of the measurements to store and its writer actor
+@discuss
+    The stream handler of the server and the shm pull actor parse metrics and push
+    them to the queue without lock. One writer drains it, so the inserts, topic
+    resolution and flushes of one thread overlap with the parsing of the others.
+@end
+*/
+
+#include "ingest_queue.h"
+#include "fty_metric_store_server.h"
+#include "memory_account.h"
+#include "stats.h"
+#include "trace.h"
+#include <fty_log.h>
+#include <thread>
+
+static StatsCounter&   g_queue_full  = stats_counter("ingest.queue_full");
+static StatsCounter&   g_dropped     = stats_counter("ingest.dropped");
+static StatsGauge&     g_queue_depth = stats_gauge("ingest.queue");
+static StatsHistogram& g_batch       = stats_histogram("ingest.batch");
+static MemoryAccount&  g_memory      = memory_account("ingest_queue");
+
+void IngestSignal::notify()
+{
+    // pairs with the fence of wait(): either the consumer sees the element or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cond.notify_one();
+    }
+}
+
+void IngestSignal::wait(int timeout, const std::function<bool()>& ready)
+{
+    if (ready()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    _waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+        _cond.wait_for(lock, std::chrono::milliseconds(timeout), ready);
+    }
+    _waiting.store(false, std::memory_order_relaxed);
+}
+
+IngestQueue::IngestQueue(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    _cells.reset(new Cell[size]);
+    _mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    g_memory.add(size * sizeof(Cell));
+}
+
+IngestQueue::~IngestQueue()
+{
+    g_memory.sub(capacity() * sizeof(Cell));
+}
+
+bool IngestQueue::push(IngestRecord&& record)
+{
+    size_t pos  = _tail.load(std::memory_order_relaxed);
+    bool   full = false;
+    Cell*  cell;
+    for (;;) {
+        if (_stopped.load(std::memory_order_relaxed)) {
+            g_dropped.add();
+            return false;
+        }
+        cell          = &_cells[pos & _mask];
+        size_t   seq  = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+            if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // full, the consumer has not popped the cell of the previous lap yet
+            if (!full) {
+                full = true;
+                g_queue_full.add();
+            }
+            std::this_thread::yield();
+            pos = _tail.load(std::memory_order_relaxed);
+        } else {
+            pos = _tail.load(std::memory_order_relaxed);
+        }
+    }
+    cell->record = std::move(record);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    _signal.notify();
+    return true;
+}
+
+bool IngestQueue::ready() const
+{
+    return _cells[_head & _mask].sequence.load(std::memory_order_acquire) == _head + 1;
+}
+
+bool IngestQueue::pop(IngestRecord& record)
+{
+    if (!ready()) {
+        return false;
+    }
+    Cell& cell = _cells[_head & _mask];
+    record     = std::move(cell.record);
+    cell.sequence.store(_head + _mask + 1, std::memory_order_release);
+    _head++;
+    return true;
+}
+
+void IngestQueue::wait(int timeout)
+{
+    _signal.wait(timeout, [this]() {
+        return ready();
+    });
+}
+
+void IngestQueue::stop()
+{
+    _stopped.store(true, std::memory_order_relaxed);
+}
+
+IngestQueues::IngestQueues(size_t capacity)
+{
+    for (int i = 0; i < persistance_shards(); i++) {
+        _queues.emplace_back(new IngestQueue(capacity));
+    }
+}
+
+bool IngestQueues::push(IngestRecord&& record)
+{
+    int shard = _queues.size() > 1 ? persistance_shard(*record.topic) : 0;
+    return _queues[size_t(shard)]->push(std::move(record));
+}
+
+// stores at most 'max' queued measurements, caller must hold the mutex of the shard
+static size_t s_store(const std::string& url, IngestQueue& queue, IngestRecord& record, size_t max)
+{
+    size_t count = 0;
+    while (count < max && queue.pop(record)) {
+        insert_into_measurement(url, *record.topic, record.value, record.scale, record.time,
+            record.units->c_str(), record.device_name->c_str(), record.step);
+        count++;
+    }
+    return count;
+}
+
+// reads the pipe without blocking, returns true on $TERM
+static bool s_pipe_term(zsock_t* pipe)
+{
+    bool term = false;
+    while (!term && (zsock_events(pipe) & ZMQ_POLLIN)) {
+        zmsg_t* message = zmsg_recv(pipe);
+        if (!message) {
+            return true;
+        }
+        char* cmd = zmsg_popstr(message);
+        term      = cmd && streq(cmd, "$TERM");
+        if (!term) {
+            log_warning("Command '%s' is unknown or not implemented", cmd ? cmd : "nullptr");
+        }
+        zstr_free(&cmd);
+        zmsg_destroy(&message);
+    }
+    return term;
+}
+
+void fty_metric_store_ingest_writer(zsock_t* pipe, void* args)
+{
+    assert(pipe);
+    assert(args);
+    const IngestWriterArgs& writer = *static_cast<const IngestWriterArgs*>(args);
+
+    trace_thread_name("fty_metric_store_ingest_writer");
+    log_info("fty_metric_store_ingest_writer started");
+    zsock_signal(pipe, 0);
+
+    std::mutex&  mutex = persistance_shard_mutex(writer.shard);
+    IngestRecord record;
+    uint64_t     last_flush = uint64_t(zclock_mono());
+    int64_t      depth      = 0; // share of the queue depth gauge
+    // the producers may still push until the server sends $TERM, even when interrupted
+    while (!s_pipe_term(pipe)) {
+        writer.queue.wait(INGEST_IDLE_WAIT);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t                      count = 0;
+        {
+            TraceSpan span("ingest.store");
+            count = s_store(writer.url, writer.queue, record, INGEST_BATCH_MAX);
+        }
+        if (count) {
+            g_batch.add(count);
+        }
+        uint64_t now = uint64_t(zclock_mono());
+        if (now - last_flush >= POLL_INTERVAL) {
+            last_flush = now;
+            // do a periodic flush
+            TraceSpan span("flush");
+            flush_measurement_when_needed(writer.url, writer.shard);
+        }
+        int64_t size = int64_t(writer.queue.size());
+        g_queue_depth.add(size - depth);
+        depth = size;
+    }
+    g_queue_depth.add(-depth);
+
+    // measurements pushed before the producers stopped
+    writer.queue.stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t                      count = s_store(writer.url, writer.queue, record, SIZE_MAX);
+        flush_measurement(writer.url, writer.shard);
+        log_debug("%zu queued measurement(s) stored at exit", count);
+    }
+
+    log_info("fty_metric_store_ingest_writer stopped");
+}
@@ -0,0 +1,161 @@
+/*  =========================================================================
+    ingest_queue - Queue of the measurements to store and its writer actor
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "persistance.h"
+#include <atomic>
+#include <condition_variable>
+#include <czmq.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Capacity of the ingest queue (measurements), rounded up to a power of two [65536]
+#define EV_DBSTORE_INGEST_QUEUE "BIOS_DBSTORE_INGEST_QUEUE"
+
+#define INGEST_QUEUE_DEFAULT 65536
+#define INGEST_IDLE_WAIT     100  // ms, the writer checks its pipe and the flush at least this often
+#define INGEST_BATCH_MAX     1024 // measurements stored by the writer under one lock of its shard mutex
+
+// Wakes the consumer of lock-free queues up: the consumer waits only when its queues are
+// empty, producers take the mutex only when it waits
+class IngestSignal
+{
+public:
+    // Called by the producers after they published an element
+    void notify();
+    // Waits until 'ready' returns true, at most 'timeout' ms. Consumer only
+    void wait(int timeout, const std::function<bool()>& ready);
+
+private:
+    std::atomic<bool>       _waiting{false};
+    std::mutex              _mutex;
+    std::condition_variable _cond;
+};
+
+// Measurement parsed by a producer, stored by the writer. Strings are interned (see intern.h)
+struct IngestRecord
+{
+    const std::string* topic       = nullptr;
+    const std::string* units       = nullptr;
+    const std::string* device_name = nullptr;
+    m_msrmnt_value_t value = 0;
+    m_msrmnt_scale_t scale = 0;
+    int64_t          time  = 0;
+    int              step  = 0; // see retention_topic_step()
+};
+
+// Bounded lock-free multi-producer single-consumer queue (a sequence number per cell,
+// producers reserve cells with a CAS on the tail). A full queue makes the producers wait,
+// until the consumer stops.
+class IngestQueue
+{
+public:
+    explicit IngestQueue(size_t capacity);
+    ~IngestQueue();
+    IngestQueue(const IngestQueue&) = delete;
+    IngestQueue& operator=(const IngestQueue&) = delete;
+
+    // Pushes the record, yields while the queue is full, wakes the consumer up if it waits.
+    // Returns false if the record is dropped because the consumer stopped (ingest.dropped)
+    bool push(IngestRecord&& record);
+
+    // Pops the oldest record, returns false if the queue is empty. Consumer only
+    bool pop(IngestRecord& record);
+
+    // Waits until the queue is not empty, at most 'timeout' ms. Consumer only
+    void wait(int timeout);
+
+    // The consumer stops reading: new records are dropped, producers waiting on the full
+    // queue give up. Consumer only, before its last pops
+    void stop();
+
+    size_t capacity() const
+    {
+        return _mask + 1;
+    }
+    // Number of queued records (approximative). Consumer only
+    size_t size() const
+    {
+        return _tail.load(std::memory_order_relaxed) - _head;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        IngestRecord        record;
+    };
+
+    bool ready() const;
+
+    std::unique_ptr<Cell[]>          _cells;
+    size_t                           _mask;
+    alignas(64) std::atomic<size_t> _tail{0}; // next cell to reserve by the producers
+    alignas(64) size_t _head = 0;             // next cell to pop by the consumer
+    IngestSignal                     _signal;
+    std::atomic<bool>                _stopped{false};
+};
+
+// Ingest queues of the writers, one per writer shard (see persistance_shard())
+class IngestQueues
+{
+public:
+    // persistance_shards() queues of the capacity
+    explicit IngestQueues(size_t capacity);
+
+    // Pushes the record to the queue of the shard of its topic, so the measurements
+    // of a topic keep their order. Returns false if the record is dropped
+    bool push(IngestRecord&& record);
+
+    IngestQueue& operator[](int shard)
+    {
+        return *_queues[size_t(shard)];
+    }
+    int size() const
+    {
+        return int(_queues.size());
+    }
+
+private:
+    std::vector<std::unique_ptr<IngestQueue>> _queues;
+};
+
+// Arguments of the ingest writer actor
+struct IngestWriterArgs
+{
+    const std::string& url;
+    IngestQueue&       queue;
+    int                shard; // the topics of the queue are those of the shard
+};
+
+//  Ingest writer actor, 'args' is IngestWriterArgs*. Single consumer of the queue: stores
+//  the measurements and flushes the shard of the backends periodically, holding the mutex
+//  of the shard by batches (it only serializes the writer with the asset deletes). Runs
+//  until $TERM, to be sent once the producers are destroyed: stops the queue, stores the
+//  remaining measurements and flushes the shard before it terminates.
+//
+//  Supported actor commands:
+//  $TERM
+//      terminate
+void fty_metric_store_ingest_writer(zsock_t* pipe, void* args);
@@ -0,0 +1,62 @@
+/*  =========================================================================
+    intern - Table of the interned strings (topics, asset names, units)
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// intern - Table of the interned strings (topics, asset names, units)
+
+#include "intern.h"
+#include "memory_account.h"
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+// keys are views of the owned strings, which never move
+static std::shared_mutex                                                  g_intern_mutex;
+static std::unordered_map<std::string_view, std::unique_ptr<std::string>> g_interned;
+static MemoryAccount&                                                     g_intern_memory = memory_account("interned");
+
+const std::string& intern(std::string_view s)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(g_intern_mutex);
+        auto                                it = g_interned.find(s);
+        if (it != g_interned.end()) {
+            return *it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(g_intern_mutex);
+    auto                                it = g_interned.find(s);
+    if (it == g_interned.end()) {
+        std::unique_ptr<std::string> copy(new std::string(s));
+        std::string_view             key(*copy);
+        g_intern_memory.add(MEMORY_HASH_NODE + sizeof(std::string_view) + sizeof(void*) + sizeof(std::string) +
+                            memory_string(*copy));
+        it = g_interned.emplace(key, std::move(copy)).first;
+    }
+    return *it->second;
+}
+
+size_t intern_size()
+{
+    std::shared_lock<std::shared_mutex> lock(g_intern_mutex);
+    return g_interned.size();
+}
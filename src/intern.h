@@ -0,0 +1,36 @@
+/*  =========================================================================
+    intern - Table of the interned strings (topics, asset names, units)
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+
+// Returns the interned copy of the string: each distinct string is allocated once and
+// kept until exit, so the measurements of a topic share it. Thread safe, lookups of
+// known strings take a shared lock and do not allocate. Accounted to "interned" (see
+// memory_account.h), not capped: the strings are referenced from the queues. The pool
+// is bounded by the distinct topics, asset names and units received since start, the
+// strings of deleted assets are kept (queued measurements may still reference them)
+// and reused if an asset of the same name comes back.
+const std::string& intern(std::string_view s);
+
+// Number of interned strings
+size_t intern_size();
@@ -0,0 +1,68 @@
+/*  =========================================================================
+    memory_account - Memory accounting of the in-process caches
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// memory_account - Memory accounting of the in-process caches
+
+#include "memory_account.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fty_log.h>
+#include <map>
+#include <memory>
+#include <mutex>
+
+static uint64_t s_cap(const std::string& name)
+{
+    std::string env = EV_DBSTORE_MEMORY_CAP_PREFIX;
+    for (char c : name) {
+        env += char(toupper(c));
+    }
+    const char* value = getenv(env.c_str());
+    if (!value) {
+        return 0;
+    }
+    uint64_t cap = uint64_t(std::max(atoll(value), 0ll));
+    log_info("use %s %s as max bytes of %s", env.c_str(), value, name.c_str());
+    return cap;
+}
+
+MemoryAccount::MemoryAccount(const std::string& name)
+    : _cap(s_cap(name))
+    , _bytes_gauge(stats_gauge("memory." + name + ".bytes"))
+    , _cap_gauge(stats_gauge("memory." + name + ".cap"))
+    , _evictions(stats_counter("memory." + name + ".evictions"))
+{
+    _cap_gauge.set(int64_t(cap()));
+}
+
+MemoryAccount& memory_account(const std::string& name)
+{
+    static std::mutex                                           mutex;
+    static std::map<std::string, std::unique_ptr<MemoryAccount>> accounts;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto&                       account = accounts[name];
+    if (!account) {
+        account.reset(new MemoryAccount(name));
+    }
+    return *account;
+}
@@ -0,0 +1,97 @@
+/*  =========================================================================
+    memory_account - Memory accounting of the in-process caches
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "stats.h"
+#include <atomic>
+#include <string>
+
+// Cap (in bytes) of the memory of a component, BIOS_DBSTORE_MEMORY_CAP_<COMPONENT>
+// (e.g. BIOS_DBSTORE_MEMORY_CAP_ROW_CACHE), unlimited if unset or 0
+#define EV_DBSTORE_MEMORY_CAP_PREFIX "BIOS_DBSTORE_MEMORY_CAP_"
+
+// Estimated size of the nodes of the standard containers, without their value:
+// links, cached hash of the unordered ones and the malloc chunk header
+#define MEMORY_LIST_NODE (2 * sizeof(void*) + 8)
+#define MEMORY_HASH_NODE (3 * sizeof(void*) + 8)
+#define MEMORY_TREE_NODE (4 * sizeof(void*) + 8)
+
+// Heap bytes of the string, 0 when it fits the small string buffer
+inline size_t memory_string(const std::string& s)
+{
+    static const size_t sso_capacity = std::string().capacity();
+    return s.capacity() > sso_capacity ? s.capacity() + 1 : 0;
+}
+
+// Bytes used by a component, counted explicitly by its owner where it allocates and frees,
+// updated without lock. Reported as the gauges memory.<name>.bytes and memory.<name>.cap,
+// and the counter memory.<name>.evictions (entries evicted or rejected, early flushes or
+// dropped requests because of the cap).
+class MemoryAccount
+{
+public:
+    explicit MemoryAccount(const std::string& name);
+
+    void add(size_t bytes)
+    {
+        _bytes_gauge.set(_bytes.fetch_add(int64_t(bytes), std::memory_order_relaxed) + int64_t(bytes));
+    }
+    void sub(size_t bytes)
+    {
+        _bytes_gauge.set(_bytes.fetch_sub(int64_t(bytes), std::memory_order_relaxed) - int64_t(bytes));
+    }
+    int64_t bytes() const
+    {
+        return _bytes.load(std::memory_order_relaxed);
+    }
+    // 0 if unlimited
+    uint64_t cap() const
+    {
+        return _cap.load(std::memory_order_relaxed);
+    }
+    // Overrides the cap read from the environment (e.g. by tests)
+    void set_cap(uint64_t cap)
+    {
+        _cap.store(cap, std::memory_order_relaxed);
+        _cap_gauge.set(int64_t(cap));
+    }
+    bool over_cap() const
+    {
+        uint64_t cap = this->cap();
+        return cap && bytes() > int64_t(cap);
+    }
+    void evicted(uint64_t n = 1)
+    {
+        _evictions.add(n);
+    }
+
+private:
+    std::atomic<int64_t>  _bytes{0};
+    std::atomic<uint64_t> _cap;
+    StatsGauge&           _bytes_gauge;
+    StatsGauge&           _cap_gauge;
+    StatsCounter&         _evictions;
+};
+
+// Account of the component, created at first call with the cap read from the environment.
+// Callers keep the returned reference (valid until exit), e.g.
+//     static MemoryAccount& memory = memory_account("row_cache");
+MemoryAccount& memory_account(const std::string& name);
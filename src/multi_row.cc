@@ -25,11 +25,14 @@
  */
 
 #include "multi_row.h"
+#include "memory_account.h"
 #include <ctime>
 #include <fty_log.h>
 #include <inttypes.h>
 #include <sys/time.h>
 
+static MemoryAccount& g_memory = memory_account("row_cache");
+
 MultiRowCache::MultiRowCache()
 {
     _max_row     = MAX_ROW_DEFAULT;
@@ -58,6 +61,9 @@ void MultiRowCache::push_back(int64_t time, m_msrmnt_value_t value, m_msrmnt_sca
     char val[50];
     snprintf(val, sizeof(val), "(%" PRIu64 ",%" PRIi32 ",%" PRIi16 ",%" PRIi16 ")", time, value, scale, topic_id);
     _row_cache.push_back(val);
+    size_t bytes = MEMORY_LIST_NODE + sizeof(std::string) + memory_string(_row_cache.back());
+    _bytes += bytes;
+    g_memory.add(bytes);
     // check if it is the first one => if yes, memory the timestamp
     if (_row_cache.size() == 1) {
         _first_ms = get_clock_ms();
@@ -73,6 +79,12 @@ bool MultiRowCache::is_ready_for_insert()
     if (_row_cache.size() >= _max_row)
         return true;
 
+    // memory of the row caches over the cap ?
+    if (g_memory.over_cap()) {
+        g_memory.evicted();
+        return true;
+    }
+
     // time to flush measurement ?
     long now_ms              = get_clock_ms();
     long elapsed_periodic_ms = now_ms - _first_ms;
@@ -83,6 +95,19 @@ bool MultiRowCache::is_ready_for_insert()
     // return (_row_cache.size()>=_max_row || elapsed_periodic_ms >= (long)_max_delay_s * 1000 );
 }
 
+MultiRowCache::~MultiRowCache()
+{
+    g_memory.sub(_bytes);
+}
+
+void MultiRowCache::clear()
+{
+    _row_cache.clear();
+    g_memory.sub(_bytes);
+    _bytes = 0;
+    reset_clock();
+}
+
 // return INSERT query or empty string if no value in cache available
 std::string MultiRowCache::get_insert_query()
 {
@@ -42,21 +42,26 @@ public:
         _max_row     = max_row;
         _max_delay_s = max_delay_s;
     }
+    ~MultiRowCache();
+    MultiRowCache(const MultiRowCache&) = delete;
+    MultiRowCache& operator=(const MultiRowCache&) = delete;
 
     void push_back(int64_t time, m_msrmnt_value_t value, m_msrmnt_scale_t scale, m_msrmnt_tpc_id_t topic_id);
 
     /// check one of those conditions :
     ///  number of values > _max_row
     /// or delay between first value and now > _max_delay_s
+    /// or memory of the row caches over the cap of "row_cache" (see memory_account.h)
     bool is_ready_for_insert();
 
     std::string get_insert_query();
 
-    void clear()
+    size_t size() const
     {
-        _row_cache.clear();
-        reset_clock();
+        return _row_cache.size();
     }
+
+    void clear();
     void reset_clock()
     {
         _first_ms = get_clock_ms();
@@ -73,6 +78,7 @@ public:
 
 private:
     std::list<std::string> _row_cache;
+    size_t                 _bytes = 0; // accounted to "row_cache"
     uint32_t               _max_delay_s;
     uint32_t               _max_row;
 
@@ -0,0 +1,241 @@
+/*  =========================================================================
+    partition - Time partitioned layout of the measurement table
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// partition - Time partitioned layout of the measurement table
+
+#include "partition.h"
+#include "retention.h"
+#include <atomic>
+#include <ctime>
+#include <fty_log.h>
+#include <inttypes.h>
+#include <tntdb.h>
+#include <vector>
+
+#define SECONDS_PER_DAY (24 * 3600)
+
+struct PartitionConfig
+{
+    int64_t interval = 0; // seconds, 0 means disabled
+    int     ahead    = PARTITION_AHEAD_DEFAULT;
+};
+
+static const PartitionConfig& s_config()
+{
+    static const PartitionConfig config = [] {
+        PartitionConfig c;
+
+        const char* env_partition = getenv(EV_DBSTORE_PARTITION);
+        if (env_partition) {
+            std::string value(env_partition);
+            if (value == "day") {
+                c.interval = SECONDS_PER_DAY;
+            } else if (value == "week") {
+                c.interval = 7 * SECONDS_PER_DAY;
+            } else {
+                log_error("%s: unsupported value '%s' (day or week expected)", EV_DBSTORE_PARTITION, env_partition);
+            }
+        }
+
+        const char* env_ahead = getenv(EV_DBSTORE_PARTITION_AHEAD);
+        if (env_ahead) {
+            int ahead = atoi(env_ahead);
+            if (ahead > 0)
+                c.ahead = ahead;
+        }
+
+        if (c.interval != 0) {
+            log_info("use %s %s partitions, %d created ahead", EV_DBSTORE_PARTITION, env_partition, c.ahead);
+        }
+        return c;
+    }();
+    return config;
+}
+
+// set when the initial layout can't be applied, do not retry an expensive ALTER every hour.
+// Set by the maintenance on a DB I/O thread, read by the server actor
+static std::atomic<bool> s_layout_failed(false);
+
+bool partition_enabled()
+{
+    return s_config().interval != 0 && !s_layout_failed.load(std::memory_order_relaxed);
+}
+
+int64_t partition_lower_bound(int64_t timestamp, int64_t interval)
+{
+    assert(interval > 0);
+    int64_t lower = timestamp - (timestamp % interval);
+    if (timestamp < 0 && (timestamp % interval) != 0) {
+        lower -= interval;
+    }
+    return lower;
+}
+
+std::string partition_name(int64_t lower_bound)
+{
+    time_t    t = time_t(lower_bound);
+    struct tm tm_info;
+    gmtime_r(&t, &tm_info);
+
+    char name[16];
+    strftime(name, sizeof(name), "p%Y%m%d", &tm_info);
+    return name;
+}
+
+static std::vector<Partition> s_list_partitions(tntdb::Connection& conn)
+{
+    tntdb::Statement st = conn.prepareCached(
+        " SELECT "
+        "   partition_name, partition_description "
+        " FROM information_schema.partitions "
+        " WHERE "
+        "   table_schema = DATABASE() AND "
+        "   table_name = 't_bios_measurement' AND "
+        "   partition_name IS NOT NULL "
+        " ORDER BY partition_ordinal_position ");
+
+    std::vector<Partition> partitions;
+    for (const auto& row : st.select()) {
+        Partition   p;
+        std::string description;
+        row["partition_name"].get(p.name);
+        row["partition_description"].get(description);
+        p.is_max      = (description == "MAXVALUE");
+        p.upper_bound = p.is_max ? 0 : std::stoll(description);
+        partitions.push_back(p);
+    }
+    return partitions;
+}
+
+// definition of the partitions covering [from, to), comma separated
+static std::string s_partitions_definition(int64_t from, int64_t to, int64_t interval)
+{
+    std::string definition;
+    for (int64_t lower = from; lower < to;) {
+        int64_t upper = partition_lower_bound(lower, interval) + interval;
+        if (!definition.empty()) {
+            definition += ", ";
+        }
+        definition += "PARTITION " + partition_name(lower) + " VALUES LESS THAN (" + std::to_string(upper) + ")";
+        lower = upper;
+    }
+    return definition;
+}
+
+std::vector<std::string> partition_plan(
+    const std::vector<Partition>& partitions, int64_t now, int64_t interval, int ahead, int max_age)
+{
+    const int64_t current = partition_lower_bound(now, interval);
+    const int64_t horizon = current + (ahead + 1) * interval;
+
+    // initial layout, rows already stored end up in the current partition
+    if (partitions.empty()) {
+        return {"ALTER TABLE t_bios_measurement PARTITION BY RANGE (timestamp) (" +
+                s_partitions_definition(current, horizon, interval) + ", PARTITION pmax VALUES LESS THAN MAXVALUE)"};
+    }
+
+    std::vector<std::string> statements;
+
+    // create partitions ahead
+    int64_t     last_upper = current;
+    std::string max_name;
+    for (const auto& p : partitions) {
+        if (p.is_max) {
+            max_name = p.name;
+        } else if (p.upper_bound > last_upper) {
+            last_upper = p.upper_bound;
+        }
+    }
+    if (last_upper < horizon) {
+        std::string definition = s_partitions_definition(last_upper, horizon, interval);
+        if (max_name.empty()) {
+            statements.push_back("ALTER TABLE t_bios_measurement ADD PARTITION (" + definition + ")");
+        } else {
+            statements.push_back("ALTER TABLE t_bios_measurement REORGANIZE PARTITION " + max_name + " INTO (" +
+                                 definition + ", PARTITION " + max_name + " VALUES LESS THAN MAXVALUE)");
+        }
+    }
+
+    // drop partitions fully out of the biggest storage age
+    if (max_age <= 0) {
+        return statements;
+    }
+    const int64_t limit = now - int64_t(max_age) * SECONDS_PER_DAY;
+    std::string   expired;
+    for (const auto& p : partitions) {
+        if (!p.is_max && p.upper_bound <= limit) {
+            if (!expired.empty()) {
+                expired += ",";
+            }
+            expired += p.name;
+        }
+    }
+    if (!expired.empty()) {
+        statements.push_back("ALTER TABLE t_bios_measurement DROP PARTITION " + expired);
+    }
+    return statements;
+}
+
+int partition_maintenance(const std::string& url, int64_t now)
+{
+    if (!partition_enabled()) {
+        return 0;
+    }
+
+    const PartitionConfig& config = s_config();
+
+    tntdb::Connection conn;
+    try {
+        conn = tntdb::connectCached(url);
+        conn.ping();
+    } catch (const std::exception& e) {
+        log_error("Can't connect to the database");
+        return -1;
+    }
+
+    try {
+        std::vector<Partition>   partitions = s_list_partitions(conn);
+        std::vector<std::string> statements =
+            partition_plan(partitions, now, config.interval, config.ahead, retention_max_age());
+
+        if (partitions.empty()) {
+            log_info("[t_bios_measurement]: partition table by %" PRIi64 "s ranges of timestamp", config.interval);
+            try {
+                conn.execute(statements.front());
+            } catch (const std::exception& e) {
+                // typically foreign keys or unique keys not including timestamp
+                log_error("[t_bios_measurement]: can't be partitioned (%s), partitioned layout disabled", e.what());
+                s_layout_failed.store(true, std::memory_order_relaxed);
+                return -1;
+            }
+            return 0;
+        }
+
+        for (const auto& statement : statements) {
+            conn.execute(statement);
+            log_info("[t_bios_measurement]: %s", statement.c_str());
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        log_error("Partition maintenance failed: %s", e.what());
+        return -1;
+    }
+}
@@ -0,0 +1,68 @@
+/*  =========================================================================
+    partition - Time partitioned layout of the measurement table
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Optional layout, where t_bios_measurement is RANGE partitioned on timestamp.
+// Partitions are created ahead of time and whole partitions are dropped once
+// they are older than the biggest configured storage age, so retention of
+// the oldest data is a metadata operation instead of a row by row DELETE.
+//
+// Value is "day" or "week", layout is disabled if unset.
+#define EV_DBSTORE_PARTITION "BIOS_DBSTORE_PARTITION"
+// Number of partitions created ahead of the current one
+#define EV_DBSTORE_PARTITION_AHEAD "BIOS_DBSTORE_PARTITION_AHEAD"
+
+#define PARTITION_AHEAD_DEFAULT  3
+#define PARTITION_CHECK_INTERVAL (3600 * 1000) // ms
+
+// Returns true if the partitioned layout is enabled
+bool partition_enabled();
+
+// Returns the lower bound (unix timestamp) of the partition containing 'timestamp'
+int64_t partition_lower_bound(int64_t timestamp, int64_t interval);
+
+// Returns the partition name for the partition starting at 'lower_bound'
+std::string partition_name(int64_t lower_bound);
+
+// Partition of t_bios_measurement
+struct Partition
+{
+    std::string name;
+    int64_t     upper_bound; // exclusive, meaningless when is_max
+    bool        is_max;
+};
+
+// Returns the ALTER TABLE statements to run on the partitions (ordered as listed by the
+// database) at 'now': partitions the table when there is none, creates the partitions of
+// 'interval' seconds up to 'ahead' partitions after the current one (out of the MAXVALUE
+// partition if any) and drops the partitions fully older than 'max_age' days (none if
+// 'max_age' <= 0). Empty if there is nothing to do.
+std::vector<std::string> partition_plan(
+    const std::vector<Partition>& partitions, int64_t now, int64_t interval, int ahead, int max_age);
+
+// Partitions t_bios_measurement if not yet done, creates partitions ahead
+// of 'now' and drops partitions older than the biggest storage age.
+// Returns 0 on success (or when the layout is disabled), -1 otherwise.
+int partition_maintenance(const std::string& url, int64_t now);
@@ -22,282 +22,245 @@
 /// persistance - Some helper functions for persistance layer
 
 #include "persistance.h"
-#include "multi_row.h"
+#include "freshness.h"
+#include "retention.h"
+#include "stats.h"
+#include "storage_memory.h"
+#include "storage_mysql.h"
+#include "tsdb.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <fty_log.h>
-#include <tntdb.h>
-#include <stdexcept>
+#include <map>
+#include <memory>
+#include <sstream>
 
-static MultiRowCache g_RowCache;
+std::mutex g_row_mutex;
 
-int select_topic(const std::string& connurl, const std::string& topic, const std::function<void(const tntdb::Row&)>& cb)
+int persistance_shards()
 {
-    try {
-        tntdb::Connection conn = tntdb::connectCached(connurl);
-
-        tntdb::Statement st = conn.prepareCached(
-            " SELECT "
-            "   * "
-            " FROM v_bios_measurement_topic "
-            " WHERE "
-            "   topic = :topic ");
+    static const int shards = [] {
+        const char* env = getenv(EV_DBSTORE_WRITERS);
+        if (!env) {
+            return 1;
+        }
+        log_info("use %s %s", EV_DBSTORE_WRITERS, env);
+        return std::min(std::max(atoi(env), 1), WRITERS_MAX);
+    }();
+    return shards;
+}
 
-        tntdb::Row row = st.set("topic", topic).selectRow();
+int persistance_shard(const std::string& topic)
+{
+    static const int shards = persistance_shards();
+    return shards == 1 ? 0 : int(std::hash<std::string>()(topic) % size_t(shards));
+}
 
-        cb(row);
-        return 0;
-    } catch (const tntdb::NotFound& e) {
-        log_info("Topic '%s' not found.", topic.c_str());
-		//return -2;
-        return 0; // this is not an error (no data instead)
-    } catch (const std::exception& e) {
-        log_error("Exception caught: %s", e.what());
-        return -1;
-    } catch (...) {
-        log_error("Unknown exception caught!");
-        return -1;
-    }
+std::mutex& persistance_shard_mutex(int shard)
+{
+    static std::mutex others[WRITERS_MAX - 1];
+    return shard == 0 ? g_row_mutex : others[shard - 1];
 }
 
-//
-int select_measurements(const std::string& connurl, const std::string& topic, int64_t start_timestamp,
-    int64_t end_timestamp, const std::function<void(const tntdb::Row&)>& cb, bool is_ordered)
+PersistanceShardsLock::PersistanceShardsLock()
 {
-    try {
-        tntdb::Connection conn = tntdb::connectCached(connurl);
-        std::string       query =
-            " SELECT "
-            "   topic, value, scale, timestamp, units "
-            " FROM v_bios_measurement "
-            " WHERE "
-            "   topic = :topic AND "
-            "   timestamp >= :time_st AND "
-            "   timestamp <= :time_end ";
-        if (is_ordered) {
-            query += " ORDER BY timestamp ASC";
-        }
-        tntdb::Statement st = conn.prepareCached(query);
-        // ACE: I know, that topic_id would have better performance, but
-        // for first iteration lets stay with this approach
-        tntdb::Result result =
-            st.set("topic", topic).set("time_st", start_timestamp).set("time_end", end_timestamp).select();
-
-        for (const auto& row : result) {
-            cb(row);
-        }
-        return 0;
-    } catch (const std::exception& e) {
-        log_error("Exception caught: %s", e.what());
-        return -1;
-    } catch (...) {
-        log_error("Unknown exception caught!");
-        return -1;
+    for (int shard = 0; shard < persistance_shards(); shard++) {
+        persistance_shard_mutex(shard).lock();
     }
 }
 
-m_dvc_id_t insert_as_not_classified_device(tntdb::Connection& conn, const char* device_name)
+PersistanceShardsLock::~PersistanceShardsLock()
 {
-    if (device_name == NULL || device_name[0] == 0) {
-        log_error("[t_bios_discovered_device] can't insert a device with NULL or non device name");
-        return 0;
+    for (int shard = persistance_shards() - 1; shard >= 0; shard--) {
+        persistance_shard_mutex(shard).unlock();
     }
-    m_dvc_id_t       id_discovered_device = 0;
-    tntdb::Statement st;
-    st = conn.prepareCached(
-        " INSERT INTO"
-        "   t_bios_discovered_device"
-        "     (name, id_device_type)"
-        " SELECT"
-        "   :name,"
-        "   (SELECT T.id_device_type FROM t_bios_device_type T WHERE T.name = 'not_classified')"
-        " FROM"
-        "   ( SELECT NULL name, 0 id_device_type ) tbl"
-        " WHERE :name NOT IN (SELECT name FROM t_bios_discovered_device )");
-    uint32_t n = st.set("name", device_name).execute();
-
-    id_discovered_device = m_dvc_id_t(conn.lastInsertId());
-
-    log_debug("[t_discovered_device]: device '%s' inserted %d rows ", device_name, n);
-    if (n == 1) {
-        // try to update  relation table
-        st = conn.prepareCached(
-            " INSERT INTO"
-            "   t_bios_monitor_asset_relation (id_discovered_device, id_asset_element)"
-            " SELECT"
-            "   DD.id_discovered_device, AE.id_asset_element"
-            " FROM"
-            "   t_bios_discovered_device DD INNER JOIN t_bios_asset_element AE on DD.name = AE.name"
-            " WHERE"
-            "   DD.name = :name AND"
-            "   DD.id_discovered_device NOT IN ( SELECT id_discovered_device FROM t_bios_monitor_asset_relation )");
-        n = st.set("name", device_name).execute();
-        log_debug("[t_bios_monitor_asset_relation]: inserted %d rows about %s", n, device_name);
-    } else {
-        log_error("[t_discovered_device]:  device %s not inserted", device_name);
-    }
-    return id_discovered_device;
 }
 
-// return id_discovered_device or 0 in case of issue
-m_dvc_id_t prepare_discovered_device(tntdb::Connection& conn, const char* device_name)
+static StatsCounter&   g_rows_inserted   = stats_counter("rows.inserted");
+static StatsCounter&   g_insert_errors   = stats_counter("rows.errors");
+static StatsHistogram& g_delete_duration = stats_histogram("delete.duration_us");
+
+struct RoutingConfig
 {
-    assert(device_name);
+    bool        tsdb_steps[RETENTION_STEPS_SIZE] = {};
+    bool        tsdb_enabled                     = false;
+    std::string tsdb_dir                         = TSDB_DIR_DEFAULT;
+};
 
-    // verify if the device name exists in t_bios_discovered_device
-    // if not create it as not_classified device type
-    tntdb::Statement st = conn.prepareCached(
-        " SELECT id_discovered_device "
-        " FROM "
-        "    t_bios_discovered_device v"
-        " WHERE "
-        "   v.name = :name");
-    st.set("name", device_name);
-    try {
-        m_dvc_id_t id_discovered_device = 0;
-        tntdb::Row row                  = st.selectRow();
-        row["id_discovered_device"].get(id_discovered_device);
-        return id_discovered_device;
-    } catch (const tntdb::NotFound& e) {
-        log_debug("[t_bios_discovered_device] device %s not found => try to create it as not classified", device_name);
-        // add the device as 'not_classified' type
-        // probably device doesn't exist in t_bios_discovered_device. Let's fill it.
-        return insert_as_not_classified_device(conn, device_name);
-    } catch (...) {
-        log_error("Unknown exception caught!");
-        return 0;
-    }
+static const RoutingConfig& s_config()
+{
+    static const RoutingConfig config = [] {
+        RoutingConfig c;
+
+        const char* env_dir = getenv(EV_DBSTORE_TSDB_DIR);
+        if (env_dir && *env_dir) {
+            c.tsdb_dir = env_dir;
+        }
+
+        const char* env_steps = getenv(EV_DBSTORE_TSDB_STEPS);
+        if (env_steps) {
+            std::istringstream steps(env_steps);
+            std::string        step;
+            while (std::getline(steps, step, ',')) {
+                int index = retention_step_index(step);
+                if (index < 0) {
+                    log_error("%s: unknown step '%s'", EV_DBSTORE_TSDB_STEPS, step.c_str());
+                    continue;
+                }
+                c.tsdb_steps[index] = true;
+                c.tsdb_enabled      = true;
+            }
+            log_info("use %s %s stored in %s", EV_DBSTORE_TSDB_STEPS, env_steps, c.tsdb_dir.c_str());
+        }
+        return c;
+    }();
+    return config;
 }
 
-// return topic_id or 0 in case of issue
-m_msrmnt_tpc_id_t prepare_topic(tntdb::Connection& conn, const char* topic, const char* units, const char* device_name)
+static commit_cb_t g_commit_cb;
+
+void persistance_set_commit_cb(const commit_cb_t& cb)
 {
-    assert(topic);
-    assert(units);
-    assert(device_name);
+    g_commit_cb = cb;
+}
 
-    m_dvc_id_t id_discovered_device = prepare_discovered_device(conn, device_name);
-    if (id_discovered_device == 0) {
-        return 0;
-    }
+const commit_cb_t& persistance_commit_cb()
+{
+    return g_commit_cb;
+}
 
-    try {
-        tntdb::Statement st = conn.prepareCached(
-            " INSERT INTO "
-            "   t_bios_measurement_topic "
-            "    (topic, units, device_id) "
-            " VALUES (:topic, :units, :device_id) "
-            " ON DUPLICATE KEY "
-            "   UPDATE "
-            "      id = LAST_INSERT_ID(id) ");
-
-        uint32_t n = st.set("topic", topic).set("units", units).set("device_id", id_discovered_device).execute();
-
-        m_msrmnt_tpc_id_t topic_id = m_msrmnt_tpc_id_t(conn.lastInsertId());
-        if (topic_id != 0) {
-            log_debug("[t_bios_measurement_topic]: inserted topic %s, #%d rows , topic_id %u", topic, n, topic_id);
+// backends by url, embedded engine as "tsdb:<dir>"
+static std::mutex                                      g_storage_mutex;
+static std::map<std::string, std::unique_ptr<Storage>> g_storages;
+
+static Storage* s_storage(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(g_storage_mutex);
+    auto                        it = g_storages.find(key);
+    if (it == g_storages.end()) {
+        std::unique_ptr<Storage> storage;
+        if (key.compare(0, 5, "tsdb:") == 0) {
+            storage.reset(new TsdbStorage(key.substr(5)));
+        } else if (key.compare(0, strlen(STORAGE_MEMORY_SCHEME), STORAGE_MEMORY_SCHEME) == 0) {
+            storage.reset(new MemoryStorage());
         } else {
-            log_error("[t_bios_measurement_topic]:  topic %s not inserted", topic);
+            storage.reset(new MysqlStorage(key));
         }
-        return topic_id;
-    } catch (const std::exception& e) {
-        log_error("Topic '%s' was not inserted with error: %s", topic, e.what());
-        return 0;
+        it = g_storages.emplace(key, std::move(storage)).first;
     }
+    return it->second.get();
 }
 
-//
-void flush_measurement(tntdb::Connection& conn)
+static Storage* s_step_storage(const std::string& url, int step)
 {
-    log_debug("Performing periodic flush");
-    try {
-        std::string query = g_RowCache.get_insert_query();
-        if (query.length() == 0) {
-            g_RowCache.reset_clock();
-            return;
-        }
-        tntdb::Statement st            = conn.prepare(query.c_str());
-        uint32_t         affected_rows = st.execute();
-        log_debug("[t_bios_measurement]: flush measurements from cache, inserted %d rows ", affected_rows);
-        g_RowCache.clear();
-    } catch (const std::exception& e) {
-        log_error("Abnormal flush termination");
+    // topics of unknown steps are stored in DB
+    const RoutingConfig& config = s_config();
+    if (step >= 0 && config.tsdb_steps[step]) {
+        return s_storage("tsdb:" + config.tsdb_dir);
     }
+    return s_storage(url);
 }
 
-//
-void flush_measurement(std::string& url)
+// backends used for the url
+static std::vector<Storage*> s_url_storages(const std::string& url)
 {
-    tntdb::Connection conn;
-    try {
-        conn = tntdb::connectCached(url);
-        conn.ping();
-    } catch (const std::exception& e) {
-        log_error("Can't connect to the database");
-        return;
+    std::vector<Storage*> storages{s_storage(url)};
+    if (s_config().tsdb_enabled) {
+        storages.push_back(s_storage("tsdb:" + s_config().tsdb_dir));
     }
-    flush_measurement(conn);
+    return storages;
 }
 
-// Do a flush only if cache is full or enough time elapsed since the last flush
-void flush_measurement_when_needed(tntdb::Connection& conn)
+void persistance_committed(const std::string& topic, int64_t timestamp, int step)
 {
-    if (g_RowCache.is_ready_for_insert()) {
-        flush_measurement(conn);
+    freshness_record(FRESHNESS_COMMITTED, step, timestamp);
+    if (g_commit_cb) {
+        g_commit_cb(topic, timestamp);
     }
 }
 
-void flush_measurement_when_needed(std::string& url)
+bool is_raw_measurement_stored()
 {
-    if (g_RowCache.is_ready_for_insert()) {
-        flush_measurement(url);
-    }
+    return s_config().tsdb_steps[0] && retention_is_stored(0);
 }
 
-//
-int insert_into_measurement(tntdb::Connection& conn, const char* topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale,
-    int64_t time, const char* units, const char* device_name)
+int insert_into_measurement(const std::string& connurl, const std::string& topic, m_msrmnt_value_t value,
+    m_msrmnt_scale_t scale, int64_t time, const char* units, const char* device_name)
+{
+    return insert_into_measurement(
+        connurl, topic, value, scale, time, units, device_name, retention_topic_step(topic.c_str()));
+}
+
+int insert_into_measurement(const std::string& connurl, const std::string& topic, m_msrmnt_value_t value,
+    m_msrmnt_scale_t scale, int64_t time, const char* units, const char* device_name, int step)
 {
     assert(units);
     assert(device_name);
-    assert(topic);
 
-    if (topic[0] == '@') {
-        log_error("malformed value of topic '%s' is not allowed", topic);
+    if (topic.empty() || topic[0] == '@') {
+        log_error("malformed value of topic '%s' is not allowed", topic.c_str());
         return 1;
     }
 
-    try {
-        m_msrmnt_tpc_id_t topic_id = prepare_topic(conn, topic, units, device_name);
-        if (topic_id == 0) {
-            log_error("topic '%s' was not inserted -> cannot insert metric", topic);
-            return 1;
-        }
-        g_RowCache.push_back(time, value, scale, topic_id);
-        flush_measurement_when_needed(conn);
+    if (!retention_is_stored(step)) {
+        log_trace("storage age of step %s is 0 -> metric '%s' is not stored", RETENTION_STEPS[step], topic.c_str());
         return 0;
-    } catch (const std::exception& e) {
-        log_error("Metric with topic '%s' was not inserted with error: %s", topic, e.what());
-        return 1;
     }
+    int rv = s_step_storage(connurl, step)->insert(topic, value, scale, time, units, device_name);
+    if (rv == 0) {
+        g_rows_inserted.add();
+        freshness_record(FRESHNESS_BUFFERED, step, time);
+    } else {
+        g_insert_errors.add();
+    }
+    return rv;
 }
 
-int delete_measurements(tntdb::Connection& conn, const char* asset_name)
+int select_measurements(const std::string& connurl, const std::string& topic, int64_t start_timestamp,
+    int64_t end_timestamp, const msrmnt_cb_t& cb, bool is_ordered)
 {
-    assert(asset_name);
-
-    try {
-        tntdb::Statement st = conn.prepareCached(
-            " DELETE m, mt "
-            " FROM "
-            "   t_bios_measurement m "
-            "   INNER JOIN t_bios_measurement_topic mt "
-            " WHERE "
-            "   m.topic_id = mt.id AND "
-            "   mt.topic like :name ");
-        auto r = st.set("name", "%@" + std::string(asset_name)).execute();
-        log_info("deleted: %d", r);
-        return 0;
-    } catch (const std::exception& e) {
-        log_error("Cannot delete measurements and topics: '%s'", e.what());
-        return 1;
+    return s_step_storage(connurl, retention_topic_step(topic.c_str()))
+        ->select(topic, start_timestamp, end_timestamp, cb, is_ordered);
+}
+
+int select_topic(const std::string& connurl, const std::string& topic, std::string& units)
+{
+    return s_step_storage(connurl, retention_topic_step(topic.c_str()))->select_topic(topic, units);
+}
+
+int delete_measurements(const std::string& connurl, const std::vector<std::string>& asset_names,
+    const std::function<bool()>& keep_going)
+{
+    StatsTimer timer(g_delete_duration);
+
+    int rv = 0;
+    for (auto storage : s_url_storages(connurl)) {
+        if (storage->delete_assets(asset_names, keep_going) != 0) {
+            rv = 1;
+        }
+    }
+
+    return rv;
+}
+
+void flush_measurement_when_needed(const std::string& url, int shard)
+{
+    for (auto storage : s_url_storages(url)) {
+        storage->flush(false, shard);
+    }
+}
+
+void flush_measurement(const std::string& url, int shard)
+{
+    for (auto storage : s_url_storages(url)) {
+        storage->flush(true, shard);
+    }
+}
+
+void flush_measurement(const std::string& url)
+{
+    for (int shard = 0; shard < persistance_shards(); shard++) {
+        flush_measurement(url, shard);
     }
 }
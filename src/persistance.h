@@ -22,12 +22,9 @@
 
 #pragma once
 #include <functional>
+#include <mutex>
 #include <string>
-
-namespace tntdb {
-class Connection;
-class Row;
-} // namespace tntdb
+#include <vector>
 
 // ----- table:  t_bios_measurement -------------------
 // ----- column: value --------------------------------
@@ -45,21 +42,99 @@ typedef uint16_t m_msrmnt_tpc_id_t;
 // ----- column: id_discovered_device -----------------
 typedef uint16_t m_dvc_id_t;
 
-int insert_into_measurement(tntdb::Connection& conn, const char* topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale,
-    int64_t time, const char* units, const char* device_name);
-
+// Called for each selected measurement
+typedef std::function<void(int64_t timestamp, m_msrmnt_value_t value, m_msrmnt_scale_t scale)> msrmnt_cb_t;
+
+// maximum number of measurements removed by one DELETE statement
+#define DELETE_CHUNK_DEFAULT 10000
+
+// The url of the functions below is a tntdb url of the MySQL database, or
+// "memory:<name>" for the in-memory backend (see storage_memory.h).
+//
+// Measurements are stored by a storage backend chosen by the step of the topic:
+// steps listed (comma separated, e.g. "RT") in this variable are stored by the
+// embedded time-series engine (see tsdb.h), the other ones in the url backend.
+// Everything is stored in the url backend if unset.
+#define EV_DBSTORE_TSDB_STEPS "BIOS_DBSTORE_TSDB_STEPS"
+// Directory of the embedded time-series engine
+#define EV_DBSTORE_TSDB_DIR "BIOS_DBSTORE_TSDB_DIR"
+
+// Number of writer shards [1]: measurements are written by one ingest writer per shard
+// (see ingest_queue.h), the shard of a measurement is given by the hash of its topic
+#define EV_DBSTORE_WRITERS "BIOS_DBSTORE_WRITERS"
+#define WRITERS_MAX        16
+
+// Serializes the writes to the storage backends of the first shard between the actors
+// (its ingest writer and the asset deletes), the only one by default
+extern std::mutex g_row_mutex;
+
+// Returns the number of writer shards
+int persistance_shards();
+
+// Returns the shard of the topic, in [0, persistance_shards())
+int persistance_shard(const std::string& topic);
+
+// Serializes the writes of the shard, g_row_mutex for the first one
+std::mutex& persistance_shard_mutex(int shard);
+
+// Holds the mutex of every shard (locked in order)
+class PersistanceShardsLock
+{
+public:
+    PersistanceShardsLock();
+    ~PersistanceShardsLock();
+    PersistanceShardsLock(const PersistanceShardsLock&) = delete;
+    PersistanceShardsLock& operator=(const PersistanceShardsLock&) = delete;
+};
+
+// Returns true if raw metrics (not coming from computation module) are stored,
+// which is the case when RT step is stored by the embedded time-series engine
+bool is_raw_measurement_stored();
+
+// Stores the measurement into the backend of the step of the topic. Caller must hold
+// the mutex of the shard of the topic
+int insert_into_measurement(const std::string& connurl, const std::string& topic, m_msrmnt_value_t value,
+    m_msrmnt_scale_t scale, int64_t time, const char* units, const char* device_name);
+
+// Same with the step of the topic already parsed (see retention_topic_step())
+int insert_into_measurement(const std::string& connurl, const std::string& topic, m_msrmnt_value_t value,
+    m_msrmnt_scale_t scale, int64_t time, const char* units, const char* device_name, int step);
+
+// Selects measurements of the topic from the backend of its step
 int select_measurements(const std::string& connurl, const std::string& topic, int64_t start_timestamp,
-    int64_t end_timestamp, const std::function<void(const tntdb::Row&)>& cb, bool is_ordered);
+    int64_t end_timestamp, const msrmnt_cb_t& cb, bool is_ordered);
+
+// Gets units of the topic, returns 0 on success (units are empty for unknown topic), -1 on error
+int select_topic(const std::string& connurl, const std::string& topic, std::string& units);
 
-int select_topic(
-    const std::string& connurl, const std::string& topic, const std::function<void(const tntdb::Row&)>& cb);
+// Deletes all topics and measurements of the assets from all backends, long deletes
+// are interrupted when 'keep_going' returns false. Returns 0 on success
+int delete_measurements(const std::string& connurl, const std::vector<std::string>& asset_names,
+    const std::function<bool()>& keep_going);
 
-int delete_measurements(tntdb::Connection& conn, const char* asset_name);
+// Called for each measurement once it is stored (e.g. written to DB by a flush),
+// used by tools measuring the ingest lag, called by the writer of each shard. Set it
+// before the actors are started.
+typedef std::function<void(const std::string& topic, int64_t timestamp)> commit_cb_t;
+void               persistance_set_commit_cb(const commit_cb_t& cb);
+const commit_cb_t& persistance_commit_cb();
+
+// Called by the storage backends for each measurement once it is stored: records its
+// committed lag (see freshness.h) and calls the commit callback. 'topic' is only used
+// by the callback and may be empty if there is none
+void persistance_committed(const std::string& topic, int64_t timestamp, int step);
 
 //  Self test of this class
 //  Note: Keep this definition in sync with fty_metric_store_classes.h
 void persistance_test(bool verbose);
 
-void flush_measurement_when_needed(std::string& url);
+// Writes buffered measurements of the shard of all backends if needed. Caller must
+// hold the mutex of the shard
+void flush_measurement_when_needed(const std::string& url, int shard);
+
+// Writes buffered measurements of the shard of all backends. Caller must hold the mutex of the shard
+void flush_measurement(const std::string& url, int shard);
 
-void flush_measurement(std::string& url);
+// Writes buffered measurements of all shards of all backends. Caller must hold the mutex
+// of every shard (g_row_mutex with one shard)
+void flush_measurement(const std::string& url);
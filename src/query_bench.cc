@@ -0,0 +1,429 @@
+/*  =========================================================================
+    query_bench - Benchmark of the aggregated data requests
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    query_bench - Benchmark of the aggregated data requests
+@discuss
+    Seeds a dataset (assets x quantities x days at the given step), runs the
+    metric store server and a malamute broker in process over inproc, then
+    fires GET requests from concurrent mailbox clients with random ranges and
+    ordering flags. Reports end to end latency percentiles, bytes per reply
+    and CPU time of the server side (process CPU minus the clients threads,
+    so the broker is included).
+@end
+*/
+
+#include "bench_util.h"
+#include "fty_metric_store_server.h"
+#include "persistance.h"
+#include <atomic>
+#include <fty_log.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <malamute.h>
+#include <mutex>
+#include <sstream>
+#include <sys/resource.h>
+#include <thread>
+#include <time.h>
+
+#define BENCH_ENDPOINT "inproc://fty-metric-store-query-bench"
+#define BENCH_AGENT    "fty-metric-store"
+#define BENCH_TIMEOUT  5000 // ms
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct QueryWorkload
+{
+    std::string          url          = "memory:query-bench";
+    int                  assets       = 10;
+    int                  quantities   = 5;
+    int                  days         = 30;
+    std::string          step         = "15m";
+    std::string          aggr_type    = "avg";
+    std::vector<int64_t> ranges       = {3600, 24 * 3600, 7 * 24 * 3600}; // s
+    double               ordered      = 0.5;                              // ratio of ordered requests
+    int                  requests     = 1000;
+    int                  concurrency  = 1;
+    uint64_t             seed         = 1;
+    int64_t              start        = 1600000000;
+    bool                 seed_dataset = true;
+};
+
+struct ClientResult
+{
+    BenchLatency latency;
+    int64_t      bytes  = 0;
+    int64_t      points = 0;
+    int64_t      errors = 0;
+    double       cpu_s  = 0;
+};
+
+static int64_t s_step_seconds(const std::string& step)
+{
+    int64_t n    = atoll(step.c_str());
+    char    unit = step.empty() ? 'm' : step.back();
+    switch (unit) {
+        case 'm':
+            return n * 60;
+        case 'h':
+            return n * 3600;
+        case 'd':
+            return n * 24 * 3600;
+        default:
+            return n;
+    }
+}
+
+static std::string s_asset(int a)
+{
+    return "bench.asset" + std::to_string(a);
+}
+
+static std::string s_quantity(int q)
+{
+    return "bench.quantity" + std::to_string(q);
+}
+
+static double s_thread_cpu()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+}
+
+static double s_process_cpu()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// inserts the dataset through the storage of the url, returns number of points
+static int64_t s_seed(const QueryWorkload& w)
+{
+    const int64_t interval = s_step_seconds(w.step);
+    const int64_t end      = w.start + int64_t(w.days) * 24 * 3600;
+    BenchRandom   random(w.seed);
+    int64_t       points = 0;
+
+    PersistanceShardsLock lock;
+    for (int a = 0; a < w.assets; a++) {
+        for (int q = 0; q < w.quantities; q++) {
+            std::string topic = s_quantity(q) + "_" + w.aggr_type + "_" + w.step + "@" + s_asset(a);
+            double      value = 100;
+            for (int64_t ts = w.start; ts < end; ts += interval) {
+                value += (random.uniform() - 0.5) * 2;
+                insert_into_measurement(
+                    w.url, topic.c_str(), m_msrmnt_value_t(value * 100), -2, ts, "W", s_asset(a).c_str());
+                points++;
+            }
+        }
+    }
+    flush_measurement(w.url);
+    return points;
+}
+
+static void s_client(const QueryWorkload& w, int id, int requests, std::atomic<int>& ready, ClientResult& result)
+{
+    mlm_client_t* client = mlm_client_new();
+    std::string   name   = "query-bench-" + std::to_string(id);
+    if (mlm_client_connect(client, BENCH_ENDPOINT, 5000, name.c_str()) < 0) {
+        log_error("%s can't connect to %s", name.c_str(), BENCH_ENDPOINT);
+        mlm_client_destroy(&client);
+        result.errors += requests;
+        ready++;
+        return;
+    }
+    zpoller_t*    poller      = zpoller_new(mlm_client_msgpipe(client), nullptr);
+    const int64_t dataset_end = w.start + int64_t(w.days) * 24 * 3600;
+    BenchRandom   random(w.seed + uint64_t(id) + 1);
+
+    // start all clients together
+    ready++;
+    while (ready.load() >= 0 && !zsys_interrupted) {
+        zclock_sleep(1);
+    }
+
+    double cpu = s_thread_cpu();
+    for (int i = 0; i < requests && !zsys_interrupted; i++) {
+        int64_t     range   = w.ranges[random.below(w.ranges.size())];
+        int64_t     start   = w.start + int64_t(random.below(uint64_t(std::max(dataset_end - range - w.start, int64_t(1)))));
+        bool        ordered = random.uniform() < w.ordered;
+        std::string uuid    = std::to_string(id) + "-" + std::to_string(i);
+
+        zmsg_t* msg = zmsg_new();
+        zmsg_addstr(msg, uuid.c_str());
+        zmsg_addstr(msg, "GET");
+        zmsg_addstr(msg, s_asset(int(random.below(uint64_t(w.assets)))).c_str());
+        zmsg_addstr(msg, s_quantity(int(random.below(uint64_t(w.quantities)))).c_str());
+        zmsg_addstr(msg, w.step.c_str());
+        zmsg_addstr(msg, w.aggr_type.c_str());
+        zmsg_addstr(msg, std::to_string(start).c_str());
+        zmsg_addstr(msg, std::to_string(start + range).c_str());
+        zmsg_addstr(msg, ordered ? "1" : "0");
+
+        auto t0 = bench_clock::now();
+        if (mlm_client_sendto(client, BENCH_AGENT, AVG_GRAPH, nullptr, 1000, &msg) < 0) {
+            zmsg_destroy(&msg);
+            result.errors++;
+            continue;
+        }
+        if (!zpoller_wait(poller, BENCH_TIMEOUT)) {
+            log_error("%s: no reply for request %s", name.c_str(), uuid.c_str());
+            result.errors++;
+            continue;
+        }
+        zmsg_t* reply = mlm_client_recv(client);
+        result.latency.add(bench_clock::now() - t0);
+        if (!reply) {
+            result.errors++;
+            continue;
+        }
+        result.bytes += int64_t(zmsg_content_size(reply));
+
+        char* reply_uuid = zmsg_popstr(reply);
+        char* status     = zmsg_popstr(reply);
+        if (!reply_uuid || !status || !streq(reply_uuid, uuid.c_str()) || !streq(status, "OK")) {
+            result.errors++;
+        } else if (zmsg_size(reply) >= 8) {
+            // asset, quantity, step, aggr_type, start, end, ordered, units, then time/value pairs
+            result.points += int64_t(zmsg_size(reply) - 8) / 2;
+        }
+        zstr_free(&status);
+        zstr_free(&reply_uuid);
+        zmsg_destroy(&reply);
+    }
+    result.cpu_s = s_thread_cpu() - cpu;
+
+    zpoller_destroy(&poller);
+    mlm_client_destroy(&client);
+}
+
+static std::string s_workload_json(const QueryWorkload& w)
+{
+    std::string ranges;
+    for (auto range : w.ranges) {
+        ranges += (ranges.empty() ? "" : ",") + std::to_string(range);
+    }
+    std::ostringstream json;
+    json << "{\"assets\":" << w.assets << ",\"quantities\":" << w.quantities << ",\"days\":" << w.days
+         << ",\"step\":" << bench_json_string(w.step) << ",\"ranges_s\":[" << ranges << "],\"ordered\":" << w.ordered
+         << ",\"requests\":" << w.requests << ",\"concurrency\":" << w.concurrency << ",\"seed\":" << w.seed << "}";
+    return json.str();
+}
+
+static int s_bench(const QueryWorkload& w, bool json)
+{
+    if (w.seed_dataset) {
+        auto    t0     = bench_clock::now();
+        int64_t points = s_seed(w);
+        log_info("dataset of %" PRIi64 " points seeded in %.2f s", points,
+            std::chrono::duration<double>(bench_clock::now() - t0).count());
+    }
+
+    zactor_t* broker = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+    zstr_sendx(broker, "BIND", BENCH_ENDPOINT, nullptr);
+
+    zactor_t* server = zactor_new(fty_metric_store_server, const_cast<char*>(w.url.c_str()));
+    zstr_sendx(server, "CONNECT", BENCH_ENDPOINT, BENCH_AGENT, nullptr);
+
+    std::vector<ClientResult> results(size_t(w.concurrency));
+    std::vector<std::thread>  clients;
+    std::atomic<int>          ready(0);
+    for (int i = 0; i < w.concurrency; i++) {
+        int requests = w.requests / w.concurrency + (i < w.requests % w.concurrency ? 1 : 0);
+        clients.emplace_back(s_client, std::cref(w), i, requests, std::ref(ready), std::ref(results[size_t(i)]));
+    }
+    while (ready.load() < w.concurrency && !zsys_interrupted) {
+        zclock_sleep(1);
+    }
+
+    double cpu   = s_process_cpu();
+    auto   begin = bench_clock::now();
+    ready        = -1;
+    for (auto& client : clients) {
+        client.join();
+    }
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - begin).count();
+    cpu            = s_process_cpu() - cpu;
+
+    zactor_destroy(&server);
+    zactor_destroy(&broker);
+
+    // merge the clients
+    BenchLatency latency;
+    int64_t      bytes = 0, points = 0, errors = 0;
+    double       clients_cpu = 0;
+    for (auto& r : results) {
+        latency.merge(r.latency);
+        bytes += r.bytes;
+        points += r.points;
+        errors += r.errors;
+        clients_cpu += r.cpu_s;
+    }
+    const size_t replies     = latency.count();
+    double       server_cpu  = std::max(cpu - clients_cpu, 0.0);
+    double       per_request = replies ? server_cpu * 1e6 / double(replies) : 0;
+
+    log_info("%zu replies in %.2f s (%.1f req/s), %" PRIi64 " errors", replies, elapsed,
+        elapsed > 0 ? double(replies) / elapsed : 0, errors);
+    log_info("latency (us): p50=%.1f p99=%.1f p999=%.1f", latency.percentile(0.5), latency.percentile(0.99),
+        latency.percentile(0.999));
+    log_info("bytes per reply: %.1f, points per reply: %.1f, server cpu: %.3f s (%.1f us/request)",
+        replies ? double(bytes) / double(replies) : 0, replies ? double(points) / double(replies) : 0, server_cpu,
+        per_request);
+
+    if (json) {
+        printf("{\"bench\":\"query\",\"url\":%s,\"workload\":%s,\"replies\":%zu,\"errors\":%" PRIi64
+               ",\"elapsed_s\":%.3f,\"requests_per_s\":%.1f,\"latency_us\":%s,\"bytes_per_reply\":%.1f,"
+               "\"points_per_reply\":%.1f,\"server_cpu_s\":%.3f,\"server_cpu_us_per_request\":%.1f}\n",
+            bench_json_string(w.url).c_str(), s_workload_json(w).c_str(), replies, errors, elapsed,
+            elapsed > 0 ? double(replies) / elapsed : 0, latency.json().c_str(),
+            replies ? double(bytes) / double(replies) : 0, replies ? double(points) / double(replies) : 0,
+            server_cpu, per_request);
+    }
+    return errors == 0 ? 0 : 1;
+}
+
+static void s_usage()
+{
+    puts("fty-metric-store-query-bench [options]\n"
+         "  -u|--url              storage url, memory:<name> or mysql:... [memory:query-bench]\n"
+         "  -e|--element          number of assets [10]\n"
+         "  -q|--quantities       number of quantities per asset [5]\n"
+         "  -d|--days             days of data per topic [30]\n"
+         "  -s|--step             step of the topics [15m]\n"
+         "  -R|--ranges           comma separated range lengths of requests in seconds [3600,86400,604800]\n"
+         "  -o|--ordered          ratio of requests with ordering flag [0.5]\n"
+         "  -n|--requests         number of requests [1000]\n"
+         "  -c|--concurrency      number of concurrent clients [1]\n"
+         "  -S|--seed             seed of the workload [1]\n"
+         "  -N|--no-seed          do not insert the dataset (already stored)\n"
+         "  -j|--json             print results as JSON on stdout\n"
+         "  -h|--help             print this information");
+}
+
+int main(int argc, char** argv)
+{
+    QueryWorkload w;
+    int           help    = 0;
+    int           json    = 0;
+    int           no_seed = 0;
+
+// Some systems define struct option with non-"const" "char *"
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wwrite-strings"
+#endif
+    static const char*   short_options  = "hjNu:e:q:d:s:R:o:n:c:S:";
+    static struct option long_options[] = {
+        {"help", no_argument, &help, 1},
+        {"json", no_argument, &json, 1},
+        {"no-seed", no_argument, &no_seed, 1},
+        {"url", required_argument, 0, 'u'},
+        {"element", required_argument, 0, 'e'},
+        {"quantities", required_argument, 0, 'q'},
+        {"days", required_argument, 0, 'd'},
+        {"step", required_argument, 0, 's'},
+        {"ranges", required_argument, 0, 'R'},
+        {"ordered", required_argument, 0, 'o'},
+        {"requests", required_argument, 0, 'n'},
+        {"concurrency", required_argument, 0, 'c'},
+        {"seed", required_argument, 0, 'S'},
+        {NULL, 0, 0, 0}};
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic pop
+#endif
+
+    while (true) {
+        int option_index = 0;
+        int c            = getopt_long(argc, argv, short_options, long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'u':
+                w.url = optarg;
+                break;
+            case 'e':
+                w.assets = std::max(atoi(optarg), 1);
+                break;
+            case 'q':
+                w.quantities = std::max(atoi(optarg), 1);
+                break;
+            case 'd':
+                w.days = std::max(atoi(optarg), 1);
+                break;
+            case 's':
+                w.step = optarg;
+                break;
+            case 'R': {
+                w.ranges.clear();
+                std::istringstream ranges(optarg);
+                std::string        range;
+                while (std::getline(ranges, range, ',')) {
+                    if (atoll(range.c_str()) > 0)
+                        w.ranges.push_back(atoll(range.c_str()));
+                }
+                if (w.ranges.empty())
+                    help = 1;
+                break;
+            }
+            case 'o':
+                w.ordered = atof(optarg);
+                break;
+            case 'n':
+                w.requests = std::max(atoi(optarg), 1);
+                break;
+            case 'c':
+                w.concurrency = std::max(atoi(optarg), 1);
+                break;
+            case 'S':
+                w.seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'j':
+                json = 1;
+                break;
+            case 'N':
+                no_seed = 1;
+                break;
+            case 0:
+                // just now walking trough some long opt
+                break;
+            case 'h':
+            default:
+                help = 1;
+                break;
+        }
+    }
+    if (help) {
+        s_usage();
+        return 1;
+    }
+    w.seed_dataset = !no_seed;
+
+    ManageFtyLog::setInstanceFtylog("query_bench", FTY_COMMON_LOGGING_DEFAULT_CFG);
+    zsys_catch_interrupts();
+
+    return s_bench(w, json);
+}
@@ -0,0 +1,301 @@
+/*  =========================================================================
+    replay - Replay of a captured traffic
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    replay - Replay of a captured traffic
+@discuss
+    Feeds a capture (see capture.h, BIOS_DBSTORE_CAPTURE and the CAPTURE actor
+    command) to the metric store server running in process with a malamute
+    broker over inproc. Stream messages are published on their original
+    stream, metrics read from shm are published on the METRICS stream (the
+    server consumes it) and mailbox requests are sent to the server from
+    one client.
+
+    With --speed N, records are sent N times faster than captured (1 by
+    default), 0 sends them as fast as possible.
+@end
+*/
+
+#include "bench_util.h"
+#include "capture.h"
+#include "fty_metric_store_server.h"
+#include <fty_log.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <malamute.h>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+#define REPLAY_ENDPOINT "inproc://fty-metric-store-replay"
+#define REPLAY_AGENT    "fty-metric-store"
+#define REPLAY_TIMEOUT  5000 // ms
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct ReplayResult
+{
+    int64_t      streams  = 0;
+    int64_t      requests = 0;
+    int64_t      replies  = 0;
+    int64_t      errors   = 0;
+    double       seconds  = 0;
+    BenchLatency lateness; // behind the schedule
+    BenchLatency reply_latency;
+};
+
+static zmsg_t* s_decode(const CaptureRecord& record)
+{
+    zframe_t* frame = zframe_new(record.payload.data(), record.payload.size());
+    zmsg_t*   msg   = zmsg_decode(frame);
+    zframe_destroy(&frame);
+    return msg;
+}
+
+// receives the available replies, the first frame is the uuid of the request
+static void s_recv_replies(mlm_client_t* client,
+    std::unordered_map<std::string, bench_clock::time_point>& pending, ReplayResult& result)
+{
+    while (zsock_events(mlm_client_msgpipe(client)) & ZMQ_POLLIN) {
+        zmsg_t* reply = mlm_client_recv(client);
+        if (!reply) {
+            break;
+        }
+        char* uuid = zmsg_popstr(reply);
+        auto  it   = uuid ? pending.find(uuid) : pending.end();
+        if (it != pending.end()) {
+            result.reply_latency.add(bench_clock::now() - it->second);
+            pending.erase(it);
+        }
+        result.replies++;
+        zstr_free(&uuid);
+        zmsg_destroy(&reply);
+    }
+}
+
+// stream of a captured record, nullptr for the mailbox requests
+static const char* s_stream(const CaptureRecord& record)
+{
+    if (record.kind == CAPTURE_STREAM) {
+        return record.address.c_str();
+    }
+    return record.kind == CAPTURE_SHM ? FTY_PROTO_STREAM_METRICS : nullptr;
+}
+
+// streams of the capture, the server consumes them before the replay
+static int s_scan_streams(const std::string& file, std::set<std::string>& streams)
+{
+    CaptureReader reader;
+    if (reader.open(file) != 0) {
+        return -1;
+    }
+    CaptureRecord record;
+    while (reader.next(record)) {
+        if (s_stream(record)) {
+            streams.insert(s_stream(record));
+        }
+    }
+    return 0;
+}
+
+static int s_replay(const std::string& url, const std::string& file, double speed, ReplayResult& result)
+{
+    std::set<std::string> streams;
+    if (s_scan_streams(file, streams) != 0) {
+        return -1;
+    }
+
+    zactor_t* broker = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+    zstr_sendx(broker, "BIND", REPLAY_ENDPOINT, nullptr);
+
+    zactor_t* server = zactor_new(fty_metric_store_server, const_cast<char*>(url.c_str()));
+    zstr_sendx(server, "CONNECT", REPLAY_ENDPOINT, REPLAY_AGENT, nullptr);
+    for (const auto& stream : streams) {
+        zstr_sendx(server, "CONSUMER", stream.c_str(), ".*", nullptr);
+    }
+
+    std::map<std::string, mlm_client_t*> producers;
+    for (const auto& stream : streams) {
+        mlm_client_t* producer = mlm_client_new();
+        mlm_client_connect(producer, REPLAY_ENDPOINT, 5000, ("replay-" + stream).c_str());
+        mlm_client_set_producer(producer, stream.c_str());
+        producers[stream] = producer;
+    }
+    mlm_client_t* client = mlm_client_new();
+    mlm_client_connect(client, REPLAY_ENDPOINT, 5000, "replay");
+    // let the server subscribe
+    zclock_sleep(500);
+
+    std::unordered_map<std::string, bench_clock::time_point> pending;
+
+    CaptureReader reader;
+    reader.open(file);
+    CaptureRecord record;
+    int64_t       first = INT64_MIN;
+    auto          begin = bench_clock::now();
+    while (!zsys_interrupted && reader.next(record)) {
+        if (first == INT64_MIN) {
+            first = record.time_us;
+        }
+        if (speed > 0) {
+            auto due = begin + std::chrono::microseconds(int64_t(double(record.time_us - first) / speed));
+            while (bench_clock::now() < due && !zsys_interrupted) {
+                s_recv_replies(client, pending, result);
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(due - bench_clock::now());
+                zclock_sleep(int(std::min<int64_t>(std::max<int64_t>(wait.count(), 0), 10)));
+            }
+            auto now = bench_clock::now();
+            result.lateness.add(now > due ? now - due : bench_clock::duration::zero());
+        }
+
+        zmsg_t* msg = s_decode(record);
+        if (!msg) {
+            log_error("can't decode the captured message '%s', skip it", record.subject.c_str());
+            result.errors++;
+            continue;
+        }
+        int rv = -1;
+        if (s_stream(record)) {
+            rv = mlm_client_send(producers[s_stream(record)], record.subject.c_str(), &msg);
+            result.streams++;
+        } else if (record.kind == CAPTURE_MAILBOX) {
+            char* uuid = zmsg_popstr(msg);
+            if (uuid) {
+                pending[uuid] = bench_clock::now();
+                zmsg_pushstr(msg, uuid);
+            }
+            zstr_free(&uuid);
+            rv = mlm_client_sendto(client, REPLAY_AGENT, record.subject.c_str(), nullptr, 1000, &msg);
+            result.requests++;
+        }
+        if (rv != 0) {
+            result.errors++;
+        }
+        zmsg_destroy(&msg);
+        s_recv_replies(client, pending, result);
+    }
+
+    // wait for the remaining replies
+    auto reply_end = bench_clock::now() + std::chrono::milliseconds(REPLAY_TIMEOUT);
+    while (result.replies < result.requests && bench_clock::now() < reply_end && !zsys_interrupted) {
+        s_recv_replies(client, pending, result);
+        zclock_sleep(1);
+    }
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - begin).count();
+
+    mlm_client_destroy(&client);
+    for (auto& it : producers) {
+        mlm_client_destroy(&it.second);
+    }
+    // flushes the measurements
+    zactor_destroy(&server);
+    zactor_destroy(&broker);
+    return 0;
+}
+
+static void s_usage()
+{
+    puts("fty-metric-store-replay [options] <capture file>\n"
+         "  -u|--url              storage url, memory:<name> or mysql:... [memory:replay]\n"
+         "  -s|--speed            replay speed factor, 0 means as fast as possible [1]\n"
+         "  -j|--json             print results as JSON on stdout\n"
+         "  -h|--help             print this information");
+}
+
+int main(int argc, char** argv)
+{
+    std::string url   = "memory:replay";
+    double      speed = 1;
+    int         help  = 0;
+    int         json  = 0;
+
+// Some systems define struct option with non-"const" "char *"
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wwrite-strings"
+#endif
+    static const char*   short_options  = "hju:s:";
+    static struct option long_options[] = {
+        {"help", no_argument, &help, 1},
+        {"json", no_argument, &json, 1},
+        {"url", required_argument, 0, 'u'},
+        {"speed", required_argument, 0, 's'},
+        {NULL, 0, 0, 0}};
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic pop
+#endif
+
+    while (true) {
+        int option_index = 0;
+        int c            = getopt_long(argc, argv, short_options, long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'u':
+                url = optarg;
+                break;
+            case 's':
+                speed = std::max(atof(optarg), 0.0);
+                break;
+            case 'j':
+                json = 1;
+                break;
+            case 0:
+                // just now walking trough some long opt
+                break;
+            case 'h':
+            default:
+                help = 1;
+                break;
+        }
+    }
+    if (help || optind >= argc) {
+        s_usage();
+        return 1;
+    }
+    std::string file = argv[optind];
+
+    ManageFtyLog::setInstanceFtylog("replay", FTY_COMMON_LOGGING_DEFAULT_CFG);
+    zsys_catch_interrupts();
+
+    ReplayResult result;
+    if (s_replay(url, file, speed, result) != 0) {
+        return 1;
+    }
+
+    double rate = result.seconds > 0 ? double(result.streams + result.requests) / result.seconds : 0;
+    log_info("replayed %" PRIi64 " stream messages and %" PRIi64 " requests (%" PRIi64 " replies, %" PRIi64
+             " errors) in %.2f s, %.0f msgs/s",
+        result.streams, result.requests, result.replies, result.errors, result.seconds, rate);
+    log_info("reply latency (us) p50=%.1f p99=%.1f, behind schedule (us) p99=%.1f",
+        result.reply_latency.percentile(0.5), result.reply_latency.percentile(0.99), result.lateness.percentile(0.99));
+
+    if (json) {
+        printf("{\"bench\":\"replay\",\"url\":%s,\"file\":%s,\"speed\":%g,\"streams\":%" PRIi64 ",\"requests\":%" PRIi64
+               ",\"replies\":%" PRIi64 ",\"errors\":%" PRIi64 ",\"seconds\":%.3f,\"msgs_per_s\":%.1f,"
+               "\"reply_latency_us\":%s,\"lateness_us\":%s}\n",
+            bench_json_string(url).c_str(), bench_json_string(file).c_str(), speed, result.streams, result.requests,
+            result.replies, result.errors, result.seconds, rate, result.reply_latency.json().c_str(),
+            result.lateness.json().c_str());
+    }
+    return 0;
+}
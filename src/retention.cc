@@ -0,0 +1,116 @@
+/*  =========================================================================
+    retention - Storage age (retention) of the metrics per step
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// retention - Storage age (retention) of the metrics per step
+
+#include "retention.h"
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <fty_log.h>
+
+const char* RETENTION_STEPS[RETENTION_STEPS_SIZE] = {"RT", "15m", "30m", "1h", "8h", "24h", "7d", "30d"};
+
+// ages are set by the server actor and read on the ingest path, -1 means not configured
+static std::atomic<int> g_ages[RETENTION_STEPS_SIZE] = {{-1}, {-1}, {-1}, {-1}, {-1}, {-1}, {-1}, {-1}};
+
+int retention_step_index(const std::string& step)
+{
+    for (int i = 0; i != RETENTION_STEPS_SIZE; i++) {
+        if (step == RETENTION_STEPS[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int retention_topic_step(const char* topic)
+{
+    assert(topic);
+
+    // the step is the last '_' separated part of the quantity
+    const char* at = strchr(topic, '@');
+    if (!at) {
+        at = topic + strlen(topic);
+    }
+    const char* underscore = nullptr;
+    for (const char* p = topic; p != at; p++) {
+        if (*p == '_') {
+            underscore = p;
+        }
+    }
+    if (!underscore) {
+        return 0;
+    }
+    return retention_step_index(std::string(underscore + 1, at));
+}
+
+void retention_set_age(const std::string& step, int days)
+{
+    int index = retention_step_index(step);
+    if (index == -1) {
+        log_warning("storage age of unknown step '%s' is ignored", step.c_str());
+        return;
+    }
+    g_ages[index] = days;
+    log_debug("storage age of step '%s' set to %d days", step.c_str(), days);
+}
+
+int retention_get_age(const std::string& step)
+{
+    return retention_get_age(retention_step_index(step));
+}
+
+int retention_get_age(int step_index)
+{
+    if (step_index < 0 || step_index >= RETENTION_STEPS_SIZE) {
+        return -1;
+    }
+    return g_ages[step_index];
+}
+
+bool retention_is_stored(int step_index)
+{
+    return retention_get_age(step_index) != 0;
+}
+
+int retention_max_age()
+{
+    int max_age = -1;
+    for (const auto& age : g_ages) {
+        if (age > max_age) {
+            max_age = age;
+        }
+    }
+    return max_age;
+}
+
+std::string retention_stored_types_regex()
+{
+    std::string steps;
+    for (int i = 1; i != RETENTION_STEPS_SIZE; i++) {
+        if (!retention_is_stored(i)) {
+            steps += (steps.empty() ? "" : "|") + std::string(RETENTION_STEPS[i]);
+        }
+    }
+    // types with a suffix, unless it is a step not stored
+    return steps.empty() ? "^.*_[^_]*$" : "^.*_(?!(" + steps + ")$)[^_]*$";
+}
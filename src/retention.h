@@ -0,0 +1,55 @@
+/*  =========================================================================
+    retention - Storage age (retention) of the metrics per step
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <string>
+
+// Storage age is set by the FTY_METRIC_STORE_AGE/step/days actor command.
+// Age is expressed in days, 0 means do not save at all, -1 means unknown.
+
+// Steps known by the metric store, index of RT is 0
+#define RETENTION_STEPS_SIZE 8
+extern const char* RETENTION_STEPS[RETENTION_STEPS_SIZE];
+
+// Returns the index of the step (RT, 15m, 24h, ...), -1 if the step is unknown
+int retention_step_index(const std::string& step);
+
+// Returns the index of the step of a topic (quantity_type_step@asset), topics without
+// step suffix are real time (index 0), -1 if the suffix is not a known step (stored,
+// without storage age)
+int retention_topic_step(const char* topic);
+
+// Set the storage age (in days) of the given step
+void retention_set_age(const std::string& step, int days);
+
+// Returns the storage age (in days) of the given step, -1 if not configured
+int retention_get_age(const std::string& step);
+int retention_get_age(int step_index);
+
+// Returns true if metrics of the step have to be stored (age is not 0)
+bool retention_is_stored(int step_index);
+
+// Returns the biggest configured storage age (in days), -1 if none is configured
+int retention_max_age();
+
+// Returns the regex of the metric types with a step suffix (_<step>), except the ones
+// of the aggregated steps not stored, e.g. "^.*_(?!(8h|7d)$)[^_]*$"
+std::string retention_stored_types_regex();
@@ -0,0 +1,163 @@
+/*  =========================================================================
+    shm_scan - Parallel read of the metrics of shm
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// shm_scan - Parallel read of the metrics of shm
+
+#include "shm_scan.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <fty_log.h>
+#include <fty_shm.h>
+
+static StatsHistogram& g_scan_duration       = stats_histogram("shm.scan_us");
+static StatsHistogram& g_write_back_duration = stats_histogram("shm.write_back_us");
+static StatsCounter&   g_write_backs         = stats_counter("shm.write_backs");
+
+// last digits of the asset names of the partition, digits are dealt round robin
+static std::string s_digits(int partition, int partitions)
+{
+    std::string digits;
+    for (int digit = partition; digit < 10; digit += partitions) {
+        digits += char('0' + digit);
+    }
+    return digits;
+}
+
+std::string shm_scan_asset_regex(int partition, int partitions)
+{
+    if (partitions <= 1) {
+        return ".*";
+    }
+    // anchored, whether the names are matched or searched
+    if (partition > 0) {
+        return "^.*[" + s_digits(partition, partitions) + "]$";
+    }
+    return "^(.*[^0-9]|.*[" + s_digits(partition, partitions) + "])?$";
+}
+
+// reads and filters the metrics of the partition
+static void s_scan(
+    int partition, int partitions, const std::string& types, const shm_filter_t& filter, ShmBatch& batch)
+{
+    fty::shm::shmMetrics metrics;
+    {
+        StatsTimer timer(g_scan_duration);
+        TraceSpan  span("shm.read");
+        fty::shm::read_metrics(shm_scan_asset_regex(partition, partitions), types, metrics);
+    }
+    TraceSpan span("shm.filter");
+    batch.metrics.reserve(metrics.size());
+    for (auto& m : metrics) {
+        ShmFilter result = filter(m);
+        if (result == SHM_DROP) {
+            continue;
+        }
+        if (result == SHM_KEEP_WRITE_BACK) {
+            // the metric is handed over before the write-back
+            batch.write_backs.push_back(fty_proto_dup(m));
+        }
+        // takes the metric over, 'metrics' destroys the remaining ones
+        batch.metrics.push_back(m);
+        m = nullptr;
+    }
+}
+
+ShmScanner::ShmScanner(int partitions)
+    : _partitions(std::min(std::max(partitions, 1), SHM_SCANNERS_MAX))
+{
+    for (int p = 1; p < _partitions; p++) {
+        _threads.emplace_back(&ShmScanner::run, this, p);
+    }
+}
+
+ShmScanner::~ShmScanner()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _start.notify_all();
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+void ShmScanner::run(int partition)
+{
+    trace_thread_name("shm_scanner");
+    uint64_t generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _start.wait(lock, [this, generation]() {
+                return _stopping || _generation != generation;
+            });
+            if (_stopping) {
+                return;
+            }
+            generation = _generation;
+        }
+        // the batch of the partition is only written by this thread during the scan
+        s_scan(partition, _partitions, *_types, *_filter, _batches[size_t(partition)]);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running--;
+        }
+        _done.notify_one();
+    }
+}
+
+std::vector<ShmBatch> ShmScanner::scan(const std::string& types, const shm_filter_t& filter)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _types   = &types;
+        _filter  = &filter;
+        _batches = std::vector<ShmBatch>(static_cast<size_t>(_partitions));
+        _running = _partitions - 1;
+        _generation++;
+    }
+    _start.notify_all();
+    s_scan(0, _partitions, types, filter, _batches[0]);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this]() {
+        return _running == 0;
+    });
+    _types  = nullptr;
+    _filter = nullptr;
+    return std::move(_batches);
+}
+
+void shm_write_back(std::vector<ShmBatch>& batches)
+{
+    StatsTimer timer(g_write_back_duration);
+    TraceSpan  span("shm.write_back");
+    for (auto& batch : batches) {
+        for (auto& m : batch.write_backs) {
+            fty::shm::write_metric(m);
+            fty_proto_destroy(&m);
+        }
+        g_write_backs.add(batch.write_backs.size());
+        batch.write_backs.clear();
+    }
+}
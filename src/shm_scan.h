@@ -0,0 +1,101 @@
+/*  =========================================================================
+    shm_scan - Parallel read of the metrics of shm
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <condition_variable>
+#include <fty_proto.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Number of threads reading shm [1], each one reads and filters the metrics of a partition
+// of the assets
+#define EV_DBSTORE_SHM_SCANNERS "BIOS_DBSTORE_SHM_SCANNERS"
+#define SHM_SCANNERS_MAX        10 // one per last digit of the asset names
+
+// Returns the regex of the asset names of the partition (in [0, partitions)). Partitions
+// split the assets by the last digit of their name (asset names end with their id), dealt
+// round robin over all partitions, the first one also has the names not ending with a digit
+std::string shm_scan_asset_regex(int partition, int partitions);
+
+// Metrics of a partition kept by the filter, owned by the caller
+struct ShmBatch
+{
+    std::vector<fty_proto_t*> metrics;
+    // copies of the metrics modified by the filter, to write back to shm
+    std::vector<fty_proto_t*> write_backs;
+};
+
+// Result of the filter of a metric
+enum ShmFilter
+{
+    SHM_DROP,
+    SHM_KEEP,
+    SHM_KEEP_WRITE_BACK // kept, and modified by the filter (e.g. flagged)
+};
+
+// Filter of the metrics read, called by the scanner threads
+typedef std::function<ShmFilter(fty_proto_t* metric)> shm_filter_t;
+
+// Threads reading shm by partitions of the assets, created once by the pull actor and
+// reused by each scan (the trace rings of the threads are kept until exit)
+class ShmScanner
+{
+public:
+    // Starts 'partitions' - 1 threads, the caller of scan() reads the first partition
+    explicit ShmScanner(int partitions);
+    // Joins the threads
+    ~ShmScanner();
+    ShmScanner(const ShmScanner&) = delete;
+    ShmScanner& operator=(const ShmScanner&) = delete;
+
+    // Reads the metrics of shm of the types matching 'types', returns the metrics kept by
+    // the filter by partition. Only the metrics of the types are decoded. The metrics of
+    // an asset are in one batch. Each read is timed in the histogram shm.scan_us
+    std::vector<ShmBatch> scan(const std::string& types, const shm_filter_t& filter);
+
+    int partitions() const
+    {
+        return _partitions;
+    }
+
+private:
+    void run(int partition);
+
+    int                      _partitions;
+    std::vector<std::thread> _threads;
+    std::mutex               _mutex;
+    std::condition_variable  _start;
+    std::condition_variable  _done;
+    uint64_t                 _generation = 0; // of the current scan
+    int                      _running    = 0; // threads scanning
+    bool                     _stopping   = false;
+    // current scan
+    const std::string*    _types   = nullptr;
+    const shm_filter_t*   _filter  = nullptr;
+    std::vector<ShmBatch> _batches;
+};
+
+// Writes the write-backs of the batches to shm and destroys them, once the metrics are handed
+// over: the file writes are out of the scan. Timed in the histogram shm.write_back_us
+void shm_write_back(std::vector<ShmBatch>& batches);
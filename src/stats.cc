@@ -0,0 +1,171 @@
+/*  =========================================================================
+    stats - Runtime statistics of the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// stats - Runtime statistics of the agent
+
+#include "stats.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// values below 8 have their own bucket, then 8 sub-buckets per power of two
+static int s_bucket(uint64_t value)
+{
+    if (value < STATS_SUB_BUCKETS) {
+        return int(value);
+    }
+    int exponent = 63 - __builtin_clzll(value); // >= 3
+    int sub      = int((value >> (exponent - 3)) & (STATS_SUB_BUCKETS - 1));
+    return (exponent - 2) * STATS_SUB_BUCKETS + sub;
+}
+
+static uint64_t s_bucket_upper(int bucket)
+{
+    if (bucket < STATS_SUB_BUCKETS) {
+        return uint64_t(bucket);
+    }
+    int      exponent = bucket / STATS_SUB_BUCKETS + 2;
+    uint64_t sub      = uint64_t(bucket % STATS_SUB_BUCKETS);
+    uint64_t lower    = (STATS_SUB_BUCKETS + sub) << (exponent - 3);
+    return lower + ((uint64_t(1) << (exponent - 3)) - 1);
+}
+
+// upper bound of the bucket of rank p in 'counts'
+static uint64_t s_percentile(const uint64_t* counts, double p)
+{
+    uint64_t count = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        count += counts[i];
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = std::max(uint64_t(p * double(count) + 0.5), uint64_t(1));
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return s_bucket_upper(i);
+        }
+    }
+    return s_bucket_upper(STATS_BUCKETS - 1);
+}
+
+void StatsHistogram::add(uint64_t value)
+{
+    _buckets[s_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t StatsHistogram::percentile(double p) const
+{
+    uint64_t counts[STATS_BUCKETS];
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+    }
+    // the bound of the bucket may exceed the largest value seen
+    return std::min(s_percentile(counts, p), max());
+}
+
+uint64_t StatsHistogram::percentile_since(std::vector<uint64_t>& last, double p) const
+{
+    last.resize(STATS_BUCKETS, 0);
+    uint64_t counts[STATS_BUCKETS];
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        uint64_t current = _buckets[i].load(std::memory_order_relaxed);
+        counts[i]        = current - last[size_t(i)];
+        last[size_t(i)]  = current;
+    }
+    return std::min(s_percentile(counts, p), max());
+}
+
+struct StatsRegistry
+{
+    std::mutex                                             mutex;
+    std::map<std::string, std::unique_ptr<StatsCounter>>   counters;
+    std::map<std::string, std::unique_ptr<StatsGauge>>     gauges;
+    std::map<std::string, std::unique_ptr<StatsHistogram>> histograms;
+};
+
+static StatsRegistry& s_registry()
+{
+    static StatsRegistry registry;
+    return registry;
+}
+
+template <typename T>
+static T& s_register(std::map<std::string, std::unique_ptr<T>>& stats, const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(s_registry().mutex);
+    auto&                       stat = stats[name];
+    if (!stat) {
+        stat.reset(new T());
+    }
+    return *stat;
+}
+
+StatsCounter& stats_counter(const std::string& name)
+{
+    return s_register(s_registry().counters, name);
+}
+
+StatsGauge& stats_gauge(const std::string& name)
+{
+    return s_register(s_registry().gauges, name);
+}
+
+StatsHistogram& stats_histogram(const std::string& name)
+{
+    return s_register(s_registry().histograms, name);
+}
+
+void stats_foreach(const std::function<void(const std::string& name, int64_t value)>& cb)
+{
+    std::map<std::string, int64_t> values;
+    {
+        StatsRegistry&              registry = s_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const auto& it : registry.counters) {
+            values[it.first] = int64_t(it.second->value());
+        }
+        for (const auto& it : registry.gauges) {
+            values[it.first] = it.second->value();
+        }
+        for (const auto& it : registry.histograms) {
+            const StatsHistogram& histogram = *it.second;
+            values[it.first + ".count"]     = int64_t(histogram.count());
+            values[it.first + ".sum"]       = int64_t(histogram.sum());
+            values[it.first + ".p50"]       = int64_t(histogram.percentile(0.5));
+            values[it.first + ".p99"]       = int64_t(histogram.percentile(0.99));
+            values[it.first + ".max"]       = int64_t(histogram.max());
+        }
+    }
+    for (const auto& it : values) {
+        cb(it.first, it.second);
+    }
+}
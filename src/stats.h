@@ -0,0 +1,139 @@
+/*  =========================================================================
+    stats - Runtime statistics of the agent
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Period (in seconds) of the publication of the statistics as metrics, disabled if unset or 0
+#define EV_DBSTORE_STATS_INTERVAL "BIOS_DBSTORE_STATS_INTERVAL"
+
+// Mailbox subject of the statistics request
+#define STATS_SUBJECT "STATS"
+// Element of the published statistics
+#define STATS_ASSET "fty-metric-store"
+
+// 8 linear sub-buckets per power of two, values up to 2^64
+#define STATS_SUB_BUCKETS 8
+#define STATS_BUCKETS     ((64 - 2) * STATS_SUB_BUCKETS)
+
+// Monotonic counter, updated without lock
+class StatsCounter
+{
+public:
+    void add(uint64_t n = 1)
+    {
+        _value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> _value{0};
+};
+
+// Current value (e.g. rows buffered), updated without lock
+class StatsGauge
+{
+public:
+    void set(int64_t value)
+    {
+        _value.store(value, std::memory_order_relaxed);
+    }
+    void add(int64_t delta)
+    {
+        _value.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int64_t value() const
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> _value{0};
+};
+
+// Distribution of values in log-linear buckets (HDR-like, 12.5% precision),
+// updated without lock. Percentiles are the upper bound of their bucket.
+class StatsHistogram
+{
+public:
+    void     add(uint64_t value);
+    uint64_t count() const
+    {
+        return _count.load(std::memory_order_relaxed);
+    }
+    uint64_t sum() const
+    {
+        return _sum.load(std::memory_order_relaxed);
+    }
+    uint64_t max() const
+    {
+        return _max.load(std::memory_order_relaxed);
+    }
+    // p in [0, 1]
+    uint64_t percentile(double p) const;
+    // Percentile of the values added since the previous call with the same 'last'
+    // (bucket counts, empty at first call), 0 if there is none
+    uint64_t percentile_since(std::vector<uint64_t>& last, double p) const;
+
+private:
+    std::atomic<uint64_t> _buckets[STATS_BUCKETS] = {};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _max{0};
+};
+
+// Adds the elapsed time (us) since its creation to the histogram when destroyed
+class StatsTimer
+{
+public:
+    explicit StatsTimer(StatsHistogram& histogram)
+        : _histogram(histogram)
+        , _start(std::chrono::steady_clock::now())
+    {
+    }
+    ~StatsTimer()
+    {
+        _histogram.add(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _start).count()));
+    }
+
+private:
+    StatsHistogram&                       _histogram;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// Registry of the statistics by name. Registration takes a lock, callers keep
+// the returned reference (valid until exit), e.g.
+//     static StatsCounter& received = stats_counter("metrics.received");
+StatsCounter&   stats_counter(const std::string& name);
+StatsGauge&     stats_gauge(const std::string& name);
+StatsHistogram& stats_histogram(const std::string& name);
+
+// Calls 'cb' for each value of the snapshot ordered by name, histograms are flattened
+// to <name>.count, <name>.sum, <name>.p50, <name>.p99 and <name>.max
+void stats_foreach(const std::function<void(const std::string& name, int64_t value)>& cb);
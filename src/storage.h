@@ -0,0 +1,51 @@
+/*  =========================================================================
+    storage - Interface of the storage backends of the measurements
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "persistance.h"
+
+// Storage backend of the measurements, see persistance.h for the routing.
+// Writes (insert, flush) of a shard are serialized by the caller holding the mutex
+// of the shard, backends shared by the shards serialize them internally.
+class Storage
+{
+public:
+    virtual ~Storage() = default;
+
+    // Buffers a measurement of the topic, returns 0 on success
+    virtual int insert(const std::string& topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale, int64_t time,
+        const char* units, const char* device_name) = 0;
+
+    // Writes buffered measurements of the shard, only if needed unless 'force' is set
+    virtual void flush(bool force, int shard) = 0;
+
+    // Gets units of the topic, returns 0 on success (units are empty for unknown topic), -1 on error
+    virtual int select_topic(const std::string& topic, std::string& units) = 0;
+
+    // Calls 'cb' on measurements of the topic within [start, end], returns 0 on success, -1 on error
+    virtual int select(
+        const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, bool is_ordered) = 0;
+
+    // Deletes topics and measurements of the assets, long deletes are interrupted
+    // when 'keep_going' returns false. Returns 0 on success
+    virtual int delete_assets(
+        const std::vector<std::string>& asset_names, const std::function<bool()>& keep_going) = 0;
+};
@@ -0,0 +1,143 @@
+/*  =========================================================================
+    storage_memory - In-memory storage backend of the measurements
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// storage_memory - In-memory storage backend of the measurements
+
+#include "storage_memory.h"
+#include "memory_account.h"
+#include "retention.h"
+#include <algorithm>
+#include <fty_log.h>
+
+static MemoryAccount& g_memory = memory_account("storage_memory");
+
+static const size_t POINT_BYTES =
+    MEMORY_TREE_NODE + sizeof(std::pair<const int64_t, std::pair<m_msrmnt_value_t, m_msrmnt_scale_t>>);
+
+size_t MemoryStorage::topic_bytes(const std::string& name, const Topic& topic)
+{
+    return MEMORY_HASH_NODE + sizeof(std::pair<const std::string, Topic>) + memory_string(name) +
+           memory_string(topic.units) + memory_string(topic.device_name) + topic.points.size() * POINT_BYTES;
+}
+
+MemoryStorage::~MemoryStorage()
+{
+    for (const auto& it : _topics) {
+        g_memory.sub(topic_bytes(it.first, it.second));
+    }
+}
+
+int MemoryStorage::insert(const std::string& topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale, int64_t time,
+    const char* units, const char* device_name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // stored measurements are never evicted, new ones are rejected over the cap
+    auto it = _topics.find(topic);
+    if (g_memory.over_cap() && (it == _topics.end() || it->second.points.count(time) == 0)) {
+        log_error("memory of the storage is over the cap -> metric '%s' is not inserted", topic.c_str());
+        g_memory.evicted();
+        return 1;
+    }
+    if (it == _topics.end()) {
+        // same limit as the id column of t_bios_measurement_topic
+        if (_last_id == UINT16_MAX) {
+            log_error("topic '%s' was not inserted -> cannot insert metric", topic.c_str());
+            return 1;
+        }
+        Topic t;
+        t.id          = ++_last_id;
+        t.step        = retention_topic_step(topic.c_str());
+        t.units       = units;
+        t.device_name = device_name;
+        it            = _topics.emplace(topic, std::move(t)).first;
+        g_memory.add(topic_bytes(it->first, it->second));
+    }
+    auto& points = it->second.points;
+    if (points.insert_or_assign(time, std::make_pair(value, scale)).second) {
+        g_memory.add(POINT_BYTES);
+    }
+    persistance_committed(topic, time, it->second.step);
+    return 0;
+}
+
+void MemoryStorage::flush(bool /* force */, int /* shard */)
+{
+}
+
+int MemoryStorage::select_topic(const std::string& topic, std::string& units)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _topics.find(topic);
+    if (it == _topics.end()) {
+        log_info("Topic '%s' not found.", topic.c_str());
+        units.clear();
+        return 0;
+    }
+    units = it->second.units;
+    return 0;
+}
+
+int MemoryStorage::select(
+    const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, bool /* is_ordered */)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _topics.find(topic);
+    if (it == _topics.end() || start > end) {
+        return 0;
+    }
+    const auto& points = it->second.points;
+    for (auto p = points.lower_bound(start); p != points.end() && p->first <= end; ++p) {
+        cb(p->first, p->second.first, p->second.second);
+    }
+    return 0;
+}
+
+int MemoryStorage::delete_assets(const std::vector<std::string>& asset_names, const std::function<bool()>& /* keep_going */)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    size_t deleted = 0;
+    for (auto it = _topics.begin(); it != _topics.end();) {
+        if (std::find(asset_names.begin(), asset_names.end(), it->second.device_name) != asset_names.end()) {
+            g_memory.sub(topic_bytes(it->first, it->second));
+            it = _topics.erase(it);
+            deleted++;
+        } else {
+            ++it;
+        }
+    }
+    log_info("deleted %zu asset(s): %zu topics", asset_names.size(), deleted);
+    return 0;
+}
+
+size_t MemoryStorage::size()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    size_t size = 0;
+    for (const auto& it : _topics) {
+        size += it.second.points.size();
+    }
+    return size;
+}
@@ -0,0 +1,67 @@
+/*  =========================================================================
+    storage_memory - In-memory storage backend of the measurements
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "storage.h"
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+// Url scheme of the in-memory backend, "memory:<name>", same name is the same store
+#define STORAGE_MEMORY_SCHEME "memory:"
+
+// Measurements kept in memory with the semantics of the MySQL tables: topics are
+// created once (first units are kept), a measurement with the same topic and
+// timestamp overrides the previous one, asset delete removes the topics of the
+// device. Used by tests and benchmarks, nothing is persisted. Accounted to "storage_memory",
+// over the cap new measurements are rejected, stored ones are never evicted.
+class MemoryStorage : public Storage
+{
+public:
+    ~MemoryStorage() override;
+
+    int insert(const std::string& topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale, int64_t time,
+        const char* units, const char* device_name) override;
+    void flush(bool force, int shard) override;
+    int  select_topic(const std::string& topic, std::string& units) override;
+    int  select(const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, bool is_ordered) override;
+    int  delete_assets(const std::vector<std::string>& asset_names, const std::function<bool()>& keep_going) override;
+
+    // Returns the number of stored measurements
+    size_t size();
+
+private:
+    struct Topic
+    {
+        m_msrmnt_tpc_id_t                                                   id;
+        int                                                                 step;
+        std::string                                                         units;
+        std::string                                                         device_name;
+        std::map<int64_t, std::pair<m_msrmnt_value_t, m_msrmnt_scale_t>> points;
+    };
+
+    // accounted bytes of the topic and its measurements
+    static size_t topic_bytes(const std::string& name, const Topic& topic);
+
+    std::mutex                             _mutex;
+    std::unordered_map<std::string, Topic> _topics;
+    m_msrmnt_tpc_id_t                      _last_id = 0;
+};
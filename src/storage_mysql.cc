@@ -0,0 +1,504 @@
+/*  =========================================================================
+    storage_mysql - MySQL storage backend of the measurements
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// storage_mysql - MySQL storage backend of the measurements
+
+#include "storage_mysql.h"
+#include "archive.h"
+#include "freshness.h"
+#include "memory_account.h"
+#include "retention.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <fty_log.h>
+#include <inttypes.h>
+#include <set>
+#include <stdexcept>
+#include <tntdb.h>
+
+static StatsCounter&   g_topics_resolved = stats_counter("topics.resolved");
+static StatsGauge&     g_rows_buffered   = stats_gauge("rows.buffered");
+static StatsHistogram& g_flush_rows      = stats_histogram("flush.rows");
+static StatsHistogram& g_flush_duration  = stats_histogram("flush.duration_us");
+static MemoryAccount&  g_topic_ids_memory = memory_account("topic_ids");
+static MemoryAccount&  g_row_cache_memory = memory_account("row_cache");
+
+size_t MysqlStorage::Shard::topic_id_bytes(const std::string& topic)
+{
+    return MEMORY_HASH_NODE + sizeof(std::pair<const std::string, TopicId>) + memory_string(topic);
+}
+
+static m_dvc_id_t s_insert_as_not_classified_device(tntdb::Connection& conn, const char* device_name)
+{
+    if (device_name == NULL || device_name[0] == 0) {
+        log_error("[t_bios_discovered_device] can't insert a device with NULL or non device name");
+        return 0;
+    }
+    m_dvc_id_t       id_discovered_device = 0;
+    tntdb::Statement st;
+    st = conn.prepareCached(
+        " INSERT INTO"
+        "   t_bios_discovered_device"
+        "     (name, id_device_type)"
+        " SELECT"
+        "   :name,"
+        "   (SELECT T.id_device_type FROM t_bios_device_type T WHERE T.name = 'not_classified')"
+        " FROM"
+        "   ( SELECT NULL name, 0 id_device_type ) tbl"
+        " WHERE :name NOT IN (SELECT name FROM t_bios_discovered_device )");
+    uint32_t n = st.set("name", device_name).execute();
+
+    id_discovered_device = m_dvc_id_t(conn.lastInsertId());
+
+    log_debug("[t_discovered_device]: device '%s' inserted %d rows ", device_name, n);
+    if (n == 1) {
+        // try to update  relation table
+        st = conn.prepareCached(
+            " INSERT INTO"
+            "   t_bios_monitor_asset_relation (id_discovered_device, id_asset_element)"
+            " SELECT"
+            "   DD.id_discovered_device, AE.id_asset_element"
+            " FROM"
+            "   t_bios_discovered_device DD INNER JOIN t_bios_asset_element AE on DD.name = AE.name"
+            " WHERE"
+            "   DD.name = :name AND"
+            "   DD.id_discovered_device NOT IN ( SELECT id_discovered_device FROM t_bios_monitor_asset_relation )");
+        n = st.set("name", device_name).execute();
+        log_debug("[t_bios_monitor_asset_relation]: inserted %d rows about %s", n, device_name);
+    } else {
+        log_error("[t_discovered_device]:  device %s not inserted", device_name);
+    }
+    return id_discovered_device;
+}
+
+// return id_discovered_device or 0 in case of issue
+m_dvc_id_t prepare_discovered_device(tntdb::Connection& conn, const char* device_name)
+{
+    assert(device_name);
+
+    // verify if the device name exists in t_bios_discovered_device
+    // if not create it as not_classified device type
+    tntdb::Statement st = conn.prepareCached(
+        " SELECT id_discovered_device "
+        " FROM "
+        "    t_bios_discovered_device v"
+        " WHERE "
+        "   v.name = :name");
+    st.set("name", device_name);
+    try {
+        m_dvc_id_t id_discovered_device = 0;
+        tntdb::Row row                  = st.selectRow();
+        row["id_discovered_device"].get(id_discovered_device);
+        return id_discovered_device;
+    } catch (const tntdb::NotFound& e) {
+        log_debug("[t_bios_discovered_device] device %s not found => try to create it as not classified", device_name);
+        // add the device as 'not_classified' type
+        // probably device doesn't exist in t_bios_discovered_device. Let's fill it.
+        return s_insert_as_not_classified_device(conn, device_name);
+    } catch (...) {
+        log_error("Unknown exception caught!");
+        return 0;
+    }
+}
+
+// return topic_id or 0 in case of issue
+m_msrmnt_tpc_id_t prepare_topic(tntdb::Connection& conn, const char* topic, const char* units, const char* device_name)
+{
+    assert(topic);
+    assert(units);
+    assert(device_name);
+
+    m_dvc_id_t id_discovered_device = prepare_discovered_device(conn, device_name);
+    if (id_discovered_device == 0) {
+        return 0;
+    }
+
+    try {
+        tntdb::Statement st = conn.prepareCached(
+            " INSERT INTO "
+            "   t_bios_measurement_topic "
+            "    (topic, units, device_id) "
+            " VALUES (:topic, :units, :device_id) "
+            " ON DUPLICATE KEY "
+            "   UPDATE "
+            "      id = LAST_INSERT_ID(id) ");
+
+        uint32_t n = st.set("topic", topic).set("units", units).set("device_id", id_discovered_device).execute();
+
+        m_msrmnt_tpc_id_t topic_id = m_msrmnt_tpc_id_t(conn.lastInsertId());
+        if (topic_id != 0) {
+            log_debug("[t_bios_measurement_topic]: inserted topic %s, #%d rows , topic_id %u", topic, n, topic_id);
+        } else {
+            log_error("[t_bios_measurement_topic]:  topic %s not inserted", topic);
+        }
+        return topic_id;
+    } catch (const std::exception& e) {
+        log_error("Topic '%s' was not inserted with error: %s", topic, e.what());
+        return 0;
+    }
+}
+
+int select_asset_topics(
+    tntdb::Connection& conn, const std::vector<std::string>& asset_names, std::vector<m_msrmnt_tpc_id_t>& topic_ids)
+{
+    static const size_t MAX_NAMES = 100;
+
+    try {
+        for (size_t first = 0; first < asset_names.size(); first += MAX_NAMES) {
+            size_t last = std::min(first + MAX_NAMES, asset_names.size());
+
+            // topics are owned by the discovered device of the asset, use the device_id index
+            std::string query =
+                " SELECT mt.id "
+                " FROM "
+                "   t_bios_measurement_topic mt "
+                "   INNER JOIN t_bios_discovered_device dd ON mt.device_id = dd.id_discovered_device "
+                " WHERE dd.name IN (";
+            for (size_t i = first; i != last; i++) {
+                query += (i == first ? ":name" : ", :name") + std::to_string(i - first);
+            }
+            query += ")";
+
+            tntdb::Statement st = conn.prepare(query);
+            for (size_t i = first; i != last; i++) {
+                st.set("name" + std::to_string(i - first), asset_names[i]);
+            }
+            for (const auto& row : st.select()) {
+                m_msrmnt_tpc_id_t id = 0;
+                row["id"].get(id);
+                topic_ids.push_back(id);
+            }
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        log_error("Cannot select topics of assets: '%s'", e.what());
+        return -1;
+    }
+}
+
+int64_t delete_topic_measurements(tntdb::Connection& conn, m_msrmnt_tpc_id_t topic_id, uint32_t chunk)
+{
+    try {
+        tntdb::Statement st = conn.prepareCached(
+            " DELETE FROM t_bios_measurement "
+            " WHERE topic_id = :topic_id "
+            " LIMIT :chunk ");
+        return int64_t(st.set("topic_id", topic_id).set("chunk", chunk).execute());
+    } catch (const std::exception& e) {
+        log_error("Cannot delete measurements of topic %u: '%s'", topic_id, e.what());
+        return -1;
+    }
+}
+
+MysqlStorage::MysqlStorage(const std::string& url)
+    : _url(url)
+    , _delete_chunk(DELETE_CHUNK_DEFAULT)
+{
+    char* env_chunk = getenv(EV_DBSTORE_DELETE_CHUNK);
+    if (env_chunk) {
+        int chunk = atoi(env_chunk);
+        if (chunk > 0)
+            _delete_chunk = uint32_t(chunk);
+        log_info("use %s %u as max rows deleted at once", EV_DBSTORE_DELETE_CHUNK, _delete_chunk);
+    }
+    for (int i = 0; i < persistance_shards(); i++) {
+        _shards.emplace_back(new Shard());
+    }
+}
+
+MysqlStorage::~MysqlStorage()
+{
+    for (const auto& shard : _shards) {
+        for (const auto& it : shard->topic_ids) {
+            g_topic_ids_memory.sub(Shard::topic_id_bytes(it.first));
+        }
+        g_row_cache_memory.sub(shard->uncommitted_bytes);
+    }
+}
+
+void MysqlStorage::Shard::forget_topic(std::unordered_map<std::string, TopicId>::iterator it)
+{
+    g_topic_ids_memory.sub(topic_id_bytes(it->first));
+    topic_ids.erase(it);
+}
+
+// caller must hold the mutex of the shard of the topic
+int MysqlStorage::insert(const std::string& topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale, int64_t time,
+    const char* units, const char* device_name)
+{
+    Shard& shard = *_shards[size_t(persistance_shard(topic))];
+    try {
+        tntdb::Connection conn = tntdb::connectCached(_url);
+
+        auto it = shard.topic_ids.find(topic);
+        if (it == shard.topic_ids.end()) {
+            TraceSpan span("mysql.prepare_topic");
+            conn.ping();
+            m_msrmnt_tpc_id_t topic_id = prepare_topic(conn, topic.c_str(), units, device_name);
+            if (topic_id == 0) {
+                log_error("topic '%s' was not inserted -> cannot insert metric", topic.c_str());
+                return 1;
+            }
+            it = shard.topic_ids.emplace(topic, Shard::TopicId{topic_id, retention_topic_step(topic.c_str())}).first;
+            g_topics_resolved.add();
+            g_topic_ids_memory.add(Shard::topic_id_bytes(topic));
+            // evict other topics of the shard, the ids stay in DB
+            while (g_topic_ids_memory.over_cap() && shard.topic_ids.size() > 1) {
+                auto victim = shard.topic_ids.begin();
+                shard.forget_topic(victim != it ? victim : std::next(victim));
+                g_topic_ids_memory.evicted();
+            }
+        }
+        int step = it->second.step;
+        freshness_record(FRESHNESS_RESOLVED, step, time);
+
+        shard.row_cache.push_back(time, value, scale, it->second.id);
+        shard.uncommitted.push_back({persistance_commit_cb() ? topic : std::string(), time, step});
+        size_t bytes = sizeof(Shard::Uncommitted) + memory_string(shard.uncommitted.back().topic);
+        shard.uncommitted_bytes += bytes;
+        g_row_cache_memory.add(bytes);
+        g_rows_buffered.add(1);
+        if (shard.row_cache.is_ready_for_insert()) {
+            shard.flush(conn);
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        log_error("Metric with topic '%s' was not inserted with error: %s", topic.c_str(), e.what());
+        return 1;
+    }
+}
+
+void MysqlStorage::Shard::flush(tntdb::Connection& conn)
+{
+    log_debug("Performing periodic flush");
+    try {
+        std::string query = row_cache.get_insert_query();
+        if (query.length() == 0) {
+            row_cache.reset_clock();
+            return;
+        }
+        StatsTimer       timer(g_flush_duration);
+        TraceSpan        span("mysql.flush");
+        tntdb::Statement st            = conn.prepare(query.c_str());
+        uint32_t         affected_rows = st.execute();
+        log_debug("[t_bios_measurement]: flush measurements from cache, inserted %d rows ", affected_rows);
+        g_flush_rows.add(row_cache.size());
+        g_rows_buffered.add(-int64_t(row_cache.size()));
+        row_cache.clear();
+        for (const auto& row : uncommitted) {
+            persistance_committed(row.topic, row.time, row.step);
+        }
+        uncommitted.clear();
+        g_row_cache_memory.sub(uncommitted_bytes);
+        uncommitted_bytes = 0;
+    } catch (const std::exception& e) {
+        log_error("Abnormal flush termination");
+    }
+}
+
+// Do a flush only if cache is full or enough time elapsed since the last flush,
+// the caller holds the mutex of the shard and the connection is the one of its thread
+void MysqlStorage::flush(bool force, int shard)
+{
+    Shard& s = *_shards[size_t(shard)];
+    if (!force && !s.row_cache.is_ready_for_insert()) {
+        return;
+    }
+
+    tntdb::Connection conn;
+    try {
+        conn = tntdb::connectCached(_url);
+        conn.ping();
+    } catch (const std::exception& e) {
+        log_error("Can't connect to the database");
+        return;
+    }
+    s.flush(conn);
+}
+
+int MysqlStorage::select_topic(const std::string& topic, std::string& units)
+{
+    try {
+        tntdb::Connection conn = tntdb::connectCached(_url);
+
+        tntdb::Statement st = conn.prepareCached(
+            " SELECT "
+            "   * "
+            " FROM v_bios_measurement_topic "
+            " WHERE "
+            "   topic = :topic ");
+
+        tntdb::Row row = st.set("topic", topic).selectRow();
+
+        row["units"].get(units);
+        return 0;
+    } catch (const tntdb::NotFound& e) {
+        log_info("Topic '%s' not found.", topic.c_str());
+		//return -2;
+        return 0; // this is not an error (no data instead)
+    } catch (const std::exception& e) {
+        log_error("Exception caught: %s", e.what());
+        return -1;
+    } catch (...) {
+        log_error("Unknown exception caught!");
+        return -1;
+    }
+}
+
+int MysqlStorage::select(
+    const std::string& topic, int64_t start_timestamp, int64_t end_timestamp, const msrmnt_cb_t& cb, bool is_ordered)
+{
+    // archived measurements are the oldest ones
+    int64_t last_archived = INT64_MIN;
+    if (archive_select(topic, start_timestamp, end_timestamp, cb, last_archived) != 0) {
+        return -1;
+    }
+    if (last_archived != INT64_MIN) {
+        // skip rows being moved to the archive
+        start_timestamp = std::max(start_timestamp, last_archived + 1);
+    }
+
+    try {
+        tntdb::Connection conn = tntdb::connectCached(_url);
+        std::string       query =
+            " SELECT "
+            "   topic, value, scale, timestamp, units "
+            " FROM v_bios_measurement "
+            " WHERE "
+            "   topic = :topic AND "
+            "   timestamp >= :time_st AND "
+            "   timestamp <= :time_end ";
+        if (is_ordered) {
+            query += " ORDER BY timestamp ASC";
+        }
+        tntdb::Statement st = conn.prepareCached(query);
+        // ACE: I know, that topic_id would have better performance, but
+        // for first iteration lets stay with this approach
+        tntdb::Result result =
+            st.set("topic", topic).set("time_st", start_timestamp).set("time_end", end_timestamp).select();
+
+        for (const auto& row : result) {
+            m_msrmnt_value_t value = 0;
+            row["value"].get(value);
+
+            m_msrmnt_scale_t scale = 0;
+            row["scale"].get(scale);
+
+            int64_t timestamp = 0;
+            row["timestamp"].get(timestamp);
+
+            cb(timestamp, value, scale);
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        log_error("Exception caught: %s", e.what());
+        return -1;
+    } catch (...) {
+        log_error("Unknown exception caught!");
+        return -1;
+    }
+}
+
+// caller must hold the mutexes of all shards
+int MysqlStorage::delete_topics(tntdb::Connection& conn, const std::vector<m_msrmnt_tpc_id_t>& topic_ids)
+{
+    // pending rows of any shard may reference the topics
+    for (auto& shard : _shards) {
+        shard->flush(conn);
+    }
+
+    try {
+        tntdb::Statement st_measurement = conn.prepareCached(
+            " DELETE FROM t_bios_measurement "
+            " WHERE topic_id = :topic_id ");
+        tntdb::Statement st_topic = conn.prepareCached(
+            " DELETE FROM t_bios_measurement_topic "
+            " WHERE id = :topic_id ");
+        for (const auto topic_id : topic_ids) {
+            st_measurement.set("topic_id", topic_id).execute();
+            st_topic.set("topic_id", topic_id).execute();
+        }
+    } catch (const std::exception& e) {
+        log_error("Cannot delete topics: '%s'", e.what());
+        return 1;
+    }
+
+    // forget the deleted topics
+    std::set<m_msrmnt_tpc_id_t> deleted(topic_ids.begin(), topic_ids.end());
+    for (auto& shard : _shards) {
+        for (auto it = shard->topic_ids.begin(); it != shard->topic_ids.end();) {
+            if (deleted.count(it->second.id)) {
+                shard->forget_topic(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return 0;
+}
+
+int MysqlStorage::delete_assets(const std::vector<std::string>& asset_names, const std::function<bool()>& keep_going)
+{
+    tntdb::Connection conn;
+    try {
+        conn = tntdb::connectCached(_url);
+        conn.ping();
+    } catch (const std::exception& e) {
+        log_error("Can't connect to the database, %zu asset(s) not deleted", asset_names.size());
+        return 1;
+    }
+
+    std::vector<m_msrmnt_tpc_id_t> topic_ids;
+    if (select_asset_topics(conn, asset_names, topic_ids) != 0) {
+        return 1;
+    }
+    log_debug("delete %zu asset(s) -> %zu topic(s)", asset_names.size(), topic_ids.size());
+
+    // the long part, without holding the shard mutexes
+    int64_t deleted = 0;
+    for (const auto topic_id : topic_ids) {
+        int64_t r = 0;
+        do {
+            r = delete_topic_measurements(conn, topic_id, _delete_chunk);
+            if (r > 0) {
+                deleted += r;
+            }
+            if (!keep_going()) {
+                log_warning("interrupted while deleting measurements of %zu asset(s)", asset_names.size());
+                return 1;
+            }
+        } while (r == int64_t(_delete_chunk));
+    }
+
+    int rv;
+    {
+        PersistanceShardsLock lock;
+        rv = delete_topics(conn, topic_ids);
+    }
+
+    for (const auto& asset : asset_names) {
+        archive_delete_asset(asset);
+    }
+
+    log_info("deleted %zu asset(s): %zu topics, %" PRIi64 " measurements", asset_names.size(), topic_ids.size(), deleted);
+    return rv;
+}
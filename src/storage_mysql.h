@@ -0,0 +1,99 @@
+/*  =========================================================================
+    storage_mysql - MySQL storage backend of the measurements
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "multi_row.h"
+#include "storage.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace tntdb {
+class Connection;
+} // namespace tntdb
+
+// maximum number of measurements removed by one DELETE statement
+#define EV_DBSTORE_DELETE_CHUNK "BIOS_DBSTORE_DELETE_CHUNK"
+
+// Measurements in t_bios_measurement, inserted by multi row INSERTs,
+// measurements older than the archive age are read from the archive.
+// Each writer shard has its own row cache and topic ids, written with its own connection.
+class MysqlStorage : public Storage
+{
+public:
+    explicit MysqlStorage(const std::string& url);
+    ~MysqlStorage() override;
+
+    int insert(const std::string& topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale, int64_t time,
+        const char* units, const char* device_name) override;
+    void flush(bool force, int shard) override;
+    int  select_topic(const std::string& topic, std::string& units) override;
+    int  select(const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, bool is_ordered) override;
+    int  delete_assets(const std::vector<std::string>& asset_names, const std::function<bool()>& keep_going) override;
+
+private:
+    struct Shard
+    {
+        MultiRowCache row_cache;
+        // topic -> topic id and step, filled by the first metric of the topic, accounted to
+        // "topic_ids", evicted topics are resolved again by their next metric
+        struct TopicId
+        {
+            m_msrmnt_tpc_id_t id;
+            int               step;
+        };
+        std::unordered_map<std::string, TopicId> topic_ids;
+        // rows of the cache, topic only when a commit callback is set
+        struct Uncommitted
+        {
+            std::string topic;
+            int64_t     time;
+            int         step;
+        };
+        std::vector<Uncommitted> uncommitted;
+        size_t                   uncommitted_bytes = 0; // accounted to "row_cache"
+
+        void flush(tntdb::Connection& conn);
+        void forget_topic(std::unordered_map<std::string, TopicId>::iterator it);
+
+        // accounted bytes of a topic id
+        static size_t topic_id_bytes(const std::string& topic);
+    };
+
+    int delete_topics(tntdb::Connection& conn, const std::vector<m_msrmnt_tpc_id_t>& topic_ids);
+
+    std::string                         _url;
+    uint32_t                            _delete_chunk;
+    std::vector<std::unique_ptr<Shard>> _shards;
+};
+
+// return id_discovered_device or 0 in case of issue
+m_dvc_id_t prepare_discovered_device(tntdb::Connection& conn, const char* device_name);
+
+// return topic_id or 0 in case of issue
+m_msrmnt_tpc_id_t prepare_topic(tntdb::Connection& conn, const char* topic, const char* units, const char* device_name);
+
+// Appends ids of the topics of the assets to 'topic_ids', returns 0 on success
+int select_asset_topics(
+    tntdb::Connection& conn, const std::vector<std::string>& asset_names, std::vector<m_msrmnt_tpc_id_t>& topic_ids);
+
+// Deletes at most 'chunk' measurements of the topic, returns number of deleted rows or -1 on error
+int64_t delete_topic_measurements(tntdb::Connection& conn, m_msrmnt_tpc_id_t topic_id, uint32_t chunk);
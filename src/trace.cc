@@ -0,0 +1,179 @@
+/*  =========================================================================
+    trace - Trace spans of the hot paths
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/// trace - Trace spans of the hot paths
+
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <fty_log.h>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> g_trace_enabled(false);
+
+// Spans of one thread: written by the thread only, read by trace_dump().
+// A span is published by incrementing 'head', the reader drops the spans
+// which may have been overwritten while it copied them.
+struct TraceRing
+{
+    struct Span
+    {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<int64_t>     start_ns{0};
+        std::atomic<int64_t>     duration_ns{0};
+    };
+
+    int                      tid;
+    std::atomic<const char*> thread_name{nullptr};
+    std::atomic<uint64_t>    head{0};
+    std::atomic<uint64_t>    cleared{0}; // spans before are dropped
+    Span                     spans[TRACE_RING_SIZE];
+};
+
+// rings of all threads, kept after the thread exits
+static std::mutex                              g_rings_mutex;
+static std::vector<std::unique_ptr<TraceRing>> g_rings;
+
+static thread_local TraceRing*  t_ring        = nullptr;
+static thread_local const char* t_thread_name = nullptr;
+
+static TraceRing* s_ring()
+{
+    if (!t_ring) {
+        std::unique_ptr<TraceRing>  ring(new TraceRing());
+        std::lock_guard<std::mutex> lock(g_rings_mutex);
+        ring->tid = int(g_rings.size()) + 1;
+        ring->thread_name.store(t_thread_name, std::memory_order_relaxed);
+        t_ring = ring.get();
+        g_rings.push_back(std::move(ring));
+    }
+    return t_ring;
+}
+
+void trace_enable(bool enable)
+{
+    g_trace_enabled.store(enable, std::memory_order_relaxed);
+    log_info("tracing %s", enable ? "enabled" : "disabled");
+}
+
+void trace_thread_name(const char* name)
+{
+    t_thread_name = name;
+    if (t_ring) {
+        t_ring->thread_name.store(name, std::memory_order_relaxed);
+    }
+}
+
+void trace_record(const char* name, int64_t start_ns, int64_t duration_ns)
+{
+    TraceRing*       ring = s_ring();
+    uint64_t         head = ring->head.load(std::memory_order_relaxed);
+    TraceRing::Span& span = ring->spans[head % TRACE_RING_SIZE];
+    span.name.store(name, std::memory_order_relaxed);
+    span.start_ns.store(start_ns, std::memory_order_relaxed);
+    span.duration_ns.store(duration_ns, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void trace_clear()
+{
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    for (auto& ring : g_rings) {
+        ring->cleared.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+struct DumpedSpan
+{
+    const char* name;
+    int64_t     start_ns;
+    int64_t     duration_ns;
+};
+
+// copies the spans of the ring still valid after the copy
+static std::vector<DumpedSpan> s_copy(const TraceRing& ring)
+{
+    uint64_t head  = ring.head.load(std::memory_order_acquire);
+    uint64_t first = std::max(ring.cleared.load(std::memory_order_relaxed),
+        head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : uint64_t(0));
+
+    std::vector<DumpedSpan> spans;
+    spans.reserve(head - first);
+    for (uint64_t i = first; i < head; i++) {
+        const TraceRing::Span& span = ring.spans[i % TRACE_RING_SIZE];
+        spans.push_back({span.name.load(std::memory_order_relaxed), span.start_ns.load(std::memory_order_relaxed),
+            span.duration_ns.load(std::memory_order_relaxed)});
+    }
+
+    // spans overwritten by the writer meanwhile, or being overwritten
+    uint64_t now   = ring.head.load(std::memory_order_acquire);
+    uint64_t valid = now + 1 > TRACE_RING_SIZE ? now + 1 - TRACE_RING_SIZE : 0;
+    if (valid > first) {
+        spans.erase(spans.begin(), spans.begin() + int64_t(std::min(valid - first, uint64_t(spans.size()))));
+    }
+    return spans;
+}
+
+int trace_dump(const std::string& path)
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        log_error("can't create trace file '%s': %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    int    pid    = int(getpid());
+    size_t count  = 0;
+    bool   first  = true;
+    auto   prefix = [&first]() {
+        const char* p = first ? "\n" : ",\n";
+        first         = false;
+        return p;
+    };
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    std::lock_guard<std::mutex> lock(g_rings_mutex);
+    for (const auto& ring : g_rings) {
+        const char* thread_name = ring->thread_name.load(std::memory_order_relaxed);
+        if (thread_name) {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                prefix(), pid, ring->tid, thread_name);
+        }
+        for (const auto& span : s_copy(*ring)) {
+            // name is a literal without quotes
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", prefix(),
+                span.name ? span.name : "?", pid, ring->tid, double(span.start_ns) / 1000,
+                double(span.duration_ns) / 1000);
+            count++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0) {
+        log_error("can't write trace file '%s': %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+    log_info("%zu spans of %zu threads dumped to %s", count, g_rings.size(), path.c_str());
+    return 0;
+}
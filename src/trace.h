@@ -0,0 +1,84 @@
+/*  =========================================================================
+    trace - Trace spans of the hot paths
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// The agent records spans from its start and dumps them to this file at exit when set
+#define EV_DBSTORE_TRACE "BIOS_DBSTORE_TRACE"
+
+// Number of spans kept per thread, the oldest ones are overwritten
+#define TRACE_RING_SIZE 16384
+
+extern std::atomic<bool> g_trace_enabled;
+
+// Starts/stops recording of the spans, recorded spans are kept
+void trace_enable(bool enable);
+
+inline bool trace_enabled()
+{
+    return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+// Names the calling thread in the dump (e.g. the actor name), 'name' must be a literal
+void trace_thread_name(const char* name);
+
+// Records a span of the calling thread to its ring, 'name' must be a literal
+void trace_record(const char* name, int64_t start_ns, int64_t duration_ns);
+
+// Writes the recorded spans of all threads to 'path' in the Chrome trace event format
+// (chrome://tracing, Perfetto), returns 0 on success, -1 otherwise
+int trace_dump(const std::string& path);
+
+// Drops the recorded spans
+void trace_clear();
+
+inline int64_t trace_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records the scope as a span when tracing is enabled, costs one relaxed load otherwise
+//     TraceSpan span("mysql.flush");
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name)
+        : _name(name)
+        , _start(trace_enabled() ? trace_now_ns() : 0)
+    {
+    }
+    ~TraceSpan()
+    {
+        if (_start) {
+            trace_record(_name, _start, trace_now_ns() - _start);
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* _name;
+    int64_t     _start;
+};
@@ -0,0 +1,773 @@
+/*  =========================================================================
+    tsdb - Embedded time-series storage backend
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+/*
+@header
+    tsdb - Embedded time-series storage backend
+@discuss
+    Chunk layout (host byte order), TSDB_CHUNK_SIZE bytes:
+
+        header (64 bytes) | bit stream of the points
+
+    The header holds the state of the encoder (last timestamp, delta, value
+    and XOR window), so appending continues after a restart. The first point
+    stores the value only (timestamp is in the header), then for each point:
+
+        timestamp: zigzag delta-of-delta, '0' | '10' 7 bits | '110' 9 bits
+                   | '1110' 12 bits | '1111' 64 bits
+        value:     XOR of (value << 16 | scale) with the previous one, '0' if
+                   equal | '10' meaningful bits within the previous window
+                   | '11' 6 bits leading zeros, 6 bits length - 1, bits
+
+    Chunks are preallocated and mapped shared, an append is a few bit writes
+    into the page cache, readers map the same file and decode 'count' points.
+@end
+*/
+
+#include "tsdb.h"
+#include "converter.h"
+#include "memory_account.h"
+#include "retention.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <czmq.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fty_log.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SECONDS_PER_DAY (24 * 3600)
+#define CHUNK_MAGIC     "FMST"
+#define CHUNK_VERSION   1
+#define NO_WINDOW       0xff
+#define FIRST_WORD_BITS 48
+// worst case size of a point: '1111' + 64 bits timestamp, '11' + 12 + 64 bits value
+#define POINT_MAX_BITS (4 + 64 + 2 + 12 + 64)
+
+struct ChunkHeader
+{
+    char     magic[4];
+    uint8_t  version;
+    uint8_t  leading; // XOR window of the last value, NO_WINDOW if none
+    uint8_t  trailing;
+    uint8_t  reserved;
+    uint32_t count;
+    uint32_t bits; // used bits of the stream
+    int64_t  first_ts;
+    int64_t  last_ts;
+    int64_t  last_delta;
+    uint64_t last_word;
+    char     units[16];
+};
+static_assert(sizeof(ChunkHeader) == 64, "chunk header must be 64 bytes");
+
+#define STREAM_BITS (uint32_t(TSDB_CHUNK_SIZE - sizeof(ChunkHeader)) * 8)
+
+static ChunkHeader* s_header(uint8_t* chunk)
+{
+    return reinterpret_cast<ChunkHeader*>(chunk);
+}
+
+static uint64_t s_word(m_msrmnt_value_t value, m_msrmnt_scale_t scale)
+{
+    return (uint64_t(uint32_t(value)) << 16) | uint16_t(scale);
+}
+
+static uint64_t s_zigzag(int64_t v)
+{
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+static int64_t s_unzigzag(uint64_t v)
+{
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+//
+// bit stream
+//
+
+static void s_put_bits(uint8_t* stream, uint32_t& pos, uint64_t value, int nbits)
+{
+    for (int i = nbits - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            stream[pos >> 3] |= uint8_t(0x80 >> (pos & 7));
+        }
+        pos++;
+    }
+}
+
+struct BitReader
+{
+    const uint8_t* stream;
+    uint32_t       size; // bits
+    uint32_t       pos;
+
+    bool get(int nbits, uint64_t& value)
+    {
+        if (pos + uint32_t(nbits) > size) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < nbits; i++, pos++) {
+            value = (value << 1) | ((stream[pos >> 3] >> (7 - (pos & 7))) & 1);
+        }
+        return true;
+    }
+
+    // number of leading 1 bits, at most 'max'
+    bool ones(int max, int& n)
+    {
+        for (n = 0; n < max; n++) {
+            uint64_t bit;
+            if (!get(1, bit)) {
+                return false;
+            }
+            if (bit == 0) {
+                break;
+            }
+        }
+        return true;
+    }
+};
+
+//
+// encoding
+//
+
+// returns false if the chunk is full
+static bool s_append(uint8_t* chunk, int64_t timestamp, uint64_t word)
+{
+    ChunkHeader* h = s_header(chunk);
+    if (h->bits + POINT_MAX_BITS > STREAM_BITS) {
+        return false;
+    }
+    uint8_t* stream = chunk + sizeof(ChunkHeader);
+    uint32_t pos    = h->bits;
+
+    if (h->count == 0) {
+        h->first_ts   = timestamp;
+        h->last_delta = 0;
+        s_put_bits(stream, pos, word, FIRST_WORD_BITS);
+    } else {
+        int64_t  delta = timestamp - h->last_ts;
+        uint64_t dod   = s_zigzag(delta - h->last_delta);
+        if (dod == 0) {
+            s_put_bits(stream, pos, 0, 1);
+        } else if (dod < (1 << 7)) {
+            s_put_bits(stream, pos, 0x2, 2);
+            s_put_bits(stream, pos, dod, 7);
+        } else if (dod < (1 << 9)) {
+            s_put_bits(stream, pos, 0x6, 3);
+            s_put_bits(stream, pos, dod, 9);
+        } else if (dod < (1 << 12)) {
+            s_put_bits(stream, pos, 0xe, 4);
+            s_put_bits(stream, pos, dod, 12);
+        } else {
+            s_put_bits(stream, pos, 0xf, 4);
+            s_put_bits(stream, pos, dod, 64);
+        }
+        h->last_delta = delta;
+
+        uint64_t x = word ^ h->last_word;
+        if (x == 0) {
+            s_put_bits(stream, pos, 0, 1);
+        } else {
+            int leading  = __builtin_clzll(x);
+            int trailing = __builtin_ctzll(x);
+            if (h->leading != NO_WINDOW && leading >= h->leading && trailing >= h->trailing) {
+                s_put_bits(stream, pos, 0x2, 2);
+                s_put_bits(stream, pos, x >> h->trailing, 64 - h->leading - h->trailing);
+            } else {
+                int length = 64 - leading - trailing;
+                s_put_bits(stream, pos, 0x3, 2);
+                s_put_bits(stream, pos, uint64_t(leading), 6);
+                s_put_bits(stream, pos, uint64_t(length - 1), 6);
+                s_put_bits(stream, pos, x >> trailing, length);
+                h->leading  = uint8_t(leading);
+                h->trailing = uint8_t(trailing);
+            }
+        }
+    }
+
+    h->last_ts   = timestamp;
+    h->last_word = word;
+    h->bits      = pos;
+    h->count++;
+    return true;
+}
+
+static bool s_valid(const ChunkHeader* h)
+{
+    return memcmp(h->magic, CHUNK_MAGIC, 4) == 0 && h->version == CHUNK_VERSION && h->bits <= STREAM_BITS;
+}
+
+// calls 'cb' on points within [start, end], returns false on corrupted chunk
+static bool s_decode(const uint8_t* chunk, int64_t start, int64_t end, const msrmnt_cb_t& cb)
+{
+    const ChunkHeader* h = reinterpret_cast<const ChunkHeader*>(chunk);
+    if (!s_valid(h)) {
+        return false;
+    }
+    uint32_t  count = h->count;
+    BitReader reader{chunk + sizeof(ChunkHeader), h->bits, 0};
+
+    int64_t  timestamp = h->first_ts;
+    int64_t  delta     = 0;
+    uint64_t word      = 0;
+    int      leading   = 0;
+    int      trailing  = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i == 0) {
+            if (!reader.get(FIRST_WORD_BITS, word)) {
+                return false;
+            }
+        } else {
+            int      n;
+            uint64_t dod = 0;
+            if (!reader.ones(4, n)) {
+                return false;
+            }
+            static const int DOD_BITS[] = {0, 7, 9, 12, 64};
+            if (n > 0 && !reader.get(DOD_BITS[n], dod)) {
+                return false;
+            }
+            delta += s_unzigzag(dod);
+            timestamp += delta;
+
+            uint64_t control;
+            if (!reader.ones(2, n)) {
+                return false;
+            }
+            if (n == 2) {
+                if (!reader.get(6, control)) {
+                    return false;
+                }
+                leading = int(control);
+                if (!reader.get(6, control)) {
+                    return false;
+                }
+                trailing = 64 - leading - int(control + 1);
+                if (trailing < 0) {
+                    return false;
+                }
+            }
+            if (n > 0) {
+                uint64_t x;
+                if (!reader.get(64 - leading - trailing, x)) {
+                    return false;
+                }
+                word ^= x << trailing;
+            }
+        }
+        if (timestamp > end) {
+            break;
+        }
+        if (timestamp >= start) {
+            cb(timestamp, m_msrmnt_value_t(uint32_t(word >> 16)), m_msrmnt_scale_t(uint16_t(word & 0xffff)));
+        }
+    }
+    return true;
+}
+
+//
+// files
+//
+
+// YYYYMMDD of the day (UTC)
+static std::string s_day_name(int64_t day)
+{
+    time_t    t = time_t(day * SECONDS_PER_DAY);
+    struct tm tm_info;
+    gmtime_r(&t, &tm_info);
+
+    char name[16];
+    strftime(name, sizeof(name), "%Y%m%d", &tm_info);
+    return name;
+}
+
+// days of the day directories in the step directory, sorted
+static std::vector<int64_t> s_list_days(const std::string& step_dir)
+{
+    std::vector<int64_t> days;
+    DIR*                 dir = opendir(step_dir.c_str());
+    if (!dir) {
+        return days;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        struct tm tm_info = {};
+        char      rest;
+        if (strlen(entry->d_name) == 8 &&
+            sscanf(entry->d_name, "%4d%2d%2d%c", &tm_info.tm_year, &tm_info.tm_mon, &tm_info.tm_mday, &rest) == 3) {
+            tm_info.tm_year -= 1900;
+            tm_info.tm_mon -= 1;
+            days.push_back(int64_t(timegm(&tm_info)) / SECONDS_PER_DAY);
+        }
+    }
+    closedir(dir);
+    std::sort(days.begin(), days.end());
+    return days;
+}
+
+// empty for topics of unknown steps, not stored by the engine
+static std::string s_step_dir(const std::string& dir, const std::string& topic)
+{
+    int step = retention_topic_step(topic.c_str());
+    return step < 0 ? std::string() : dir + "/" + RETENTION_STEPS[step];
+}
+
+static std::string s_chunk_prefix(const std::string& step_dir, int64_t day, const std::string& topic)
+{
+    return step_dir + "/" + s_day_name(day) + "/" + topic_to_filename(topic) + ".";
+}
+
+// path of the newest chunk of the topic in the days of the step directory, empty if none
+static std::string s_last_chunk(
+    const std::string& step_dir, const std::vector<int64_t>& days, const std::string& topic, int64_t& last_day)
+{
+    for (auto day = days.rbegin(); day != days.rend(); ++day) {
+        std::string prefix = s_chunk_prefix(step_dir, *day, topic);
+        int         seq    = 0;
+        while (access((prefix + std::to_string(seq)).c_str(), F_OK) == 0) {
+            seq++;
+        }
+        if (seq > 0) {
+            last_day = *day;
+            return prefix + std::to_string(seq - 1);
+        }
+    }
+    return std::string();
+}
+
+static uint8_t* s_map_chunk(const std::string& path, bool writable)
+{
+    int fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != TSDB_CHUNK_SIZE) {
+        close(fd);
+        errno = EINVAL;
+        return nullptr;
+    }
+    void* data = mmap(nullptr, TSDB_CHUNK_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return data == MAP_FAILED ? nullptr : static_cast<uint8_t*>(data);
+}
+
+static uint8_t* s_create_chunk(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (ftruncate(fd, TSDB_CHUNK_SIZE) != 0) {
+        close(fd);
+        unlink(path.c_str());
+        return nullptr;
+    }
+    void* data = mmap(nullptr, TSDB_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        unlink(path.c_str());
+        return nullptr;
+    }
+    ChunkHeader* h = s_header(static_cast<uint8_t*>(data));
+    memcpy(h->magic, CHUNK_MAGIC, 4);
+    h->version = CHUNK_VERSION;
+    h->leading = NO_WINDOW;
+    return static_cast<uint8_t*>(data);
+}
+
+static void s_remove_dir(const std::string& path)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (!streq(entry->d_name, ".") && !streq(entry->d_name, "..")) {
+                unlink((path + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+}
+
+//
+// storage
+//
+
+// open writers with their mapped chunk, over the cap the other writers are closed
+// (reopened on their next point)
+static MemoryAccount& g_memory = memory_account("tsdb_writers");
+
+static size_t s_writer_bytes(const std::string& topic, const std::string& prefix)
+{
+    return MEMORY_TREE_NODE + 2 * sizeof(std::string) + 3 * sizeof(int64_t) + memory_string(topic) +
+           memory_string(prefix) + TSDB_CHUNK_SIZE;
+}
+
+TsdbStorage::TsdbStorage(const std::string& dir)
+    : _dir(dir)
+    , _last_expire(0)
+{
+}
+
+TsdbStorage::~TsdbStorage()
+{
+    close_writers([](const std::string&, const Writer&) {
+        return true;
+    });
+}
+
+int TsdbStorage::open_writer(const std::string& topic, int64_t day, Writer& writer)
+{
+    std::string step_dir = s_step_dir(_dir, topic);
+    if (step_dir.empty()) {
+        log_error("topic '%s' of unknown step is not stored by tsdb", topic.c_str());
+        return -1;
+    }
+    if (zsys_dir_create("%s/%s", step_dir.c_str(), s_day_name(day).c_str()) != 0) {
+        log_error("can't create tsdb directory of day %s in '%s'", s_day_name(day).c_str(), step_dir.c_str());
+        return -1;
+    }
+    writer.prefix = s_chunk_prefix(step_dir, day, topic);
+    writer.day    = day;
+    writer.step   = retention_topic_step(topic.c_str());
+
+    // continue the last chunk of the day if any
+    int seq = 0;
+    while (access((writer.prefix + std::to_string(seq)).c_str(), F_OK) == 0) {
+        seq++;
+    }
+    if (seq > 0) {
+        writer.seq   = seq - 1;
+        writer.chunk = s_map_chunk(writer.prefix + std::to_string(writer.seq), true);
+        if (writer.chunk && s_valid(s_header(writer.chunk))) {
+            return 0;
+        }
+        log_warning("tsdb chunk '%s%d' is corrupted, start a new one", writer.prefix.c_str(), writer.seq);
+        if (writer.chunk) {
+            munmap(writer.chunk, TSDB_CHUNK_SIZE);
+        }
+    }
+    writer.seq   = seq;
+    writer.chunk = s_create_chunk(writer.prefix + std::to_string(writer.seq));
+    if (!writer.chunk) {
+        log_error("can't create tsdb chunk '%s%d': %s", writer.prefix.c_str(), writer.seq, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void TsdbStorage::close_writers(const std::function<bool(const std::string&, const Writer&)>& pred)
+{
+    for (auto it = _writers.begin(); it != _writers.end();) {
+        if (pred(it->first, it->second)) {
+            msync(it->second.chunk, TSDB_CHUNK_SIZE, MS_ASYNC);
+            munmap(it->second.chunk, TSDB_CHUNK_SIZE);
+            g_memory.sub(s_writer_bytes(it->first, it->second.prefix));
+            it = _writers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int TsdbStorage::insert(const std::string& topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale, int64_t time,
+    const char* units, const char* /* device_name */)
+{
+    if (time < 0) {
+        log_error("negative timestamp of topic '%s' is not allowed", topic.c_str());
+        return 1;
+    }
+    const int64_t               day = time / SECONDS_PER_DAY;
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _writers.find(topic);
+    if (it != _writers.end() && it->second.day != day) {
+        if (day < it->second.day) {
+            log_trace("metric '%s' is older than the last stored one -> dropped", topic.c_str());
+            return 0;
+        }
+        close_writers([&topic](const std::string& t, const Writer&) {
+            return t == topic;
+        });
+        it = _writers.end();
+    }
+    if (it == _writers.end()) {
+        Writer writer;
+        if (open_writer(topic, day, writer) != 0) {
+            return 1;
+        }
+        it = _writers.emplace(topic, writer).first;
+        g_memory.add(s_writer_bytes(it->first, it->second.prefix));
+        close_writers([&topic](const std::string& t, const Writer&) {
+            if (t == topic || !g_memory.over_cap()) {
+                return false;
+            }
+            g_memory.evicted();
+            return true;
+        });
+    }
+
+    Writer&      writer = it->second;
+    ChunkHeader* h      = s_header(writer.chunk);
+    if (h->count > 0 && time <= h->last_ts) {
+        log_trace("metric '%s' is older than the last stored one -> dropped", topic.c_str());
+        return 0;
+    }
+    if (!s_append(writer.chunk, time, s_word(value, scale))) {
+        // chunk is full, roll to the next one
+        msync(writer.chunk, TSDB_CHUNK_SIZE, MS_ASYNC);
+        munmap(writer.chunk, TSDB_CHUNK_SIZE);
+        writer.seq++;
+        writer.chunk = s_create_chunk(writer.prefix + std::to_string(writer.seq));
+        if (!writer.chunk) {
+            log_error("can't create tsdb chunk '%s%d': %s", writer.prefix.c_str(), writer.seq, strerror(errno));
+            g_memory.sub(s_writer_bytes(it->first, writer.prefix));
+            _writers.erase(it);
+            return 1;
+        }
+        h = s_header(writer.chunk);
+        s_append(writer.chunk, time, s_word(value, scale));
+    }
+    if (h->count == 1) {
+        strncpy(h->units, units, sizeof(h->units) - 1);
+    }
+    persistance_committed(topic, time, writer.step);
+    return 0;
+}
+
+void TsdbStorage::flush(bool force, int /* shard */)
+{
+    int64_t now = int64_t(::time(nullptr));
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (force) {
+            for (auto& it : _writers) {
+                msync(it.second.chunk, TSDB_CHUNK_SIZE, MS_SYNC);
+            }
+        }
+        if (now - _last_expire < TSDB_EXPIRE_INTERVAL) {
+            return;
+        }
+        _last_expire = now;
+    }
+    expire(now);
+}
+
+void TsdbStorage::expire(int64_t now)
+{
+    // the writers of the expired days are closed under the lock, the days are removed without it
+    std::vector<std::string> expired;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int i = 0; i < RETENTION_STEPS_SIZE; i++) {
+            int age = retention_get_age(i);
+            if (age <= 0) {
+                continue;
+            }
+            const int64_t limit    = now - int64_t(age) * SECONDS_PER_DAY;
+            std::string   step_dir = _dir + "/" + RETENTION_STEPS[i];
+            for (int64_t day : s_list_days(step_dir)) {
+                if ((day + 1) * SECONDS_PER_DAY > limit) {
+                    break;
+                }
+                std::string day_dir = step_dir + "/" + s_day_name(day);
+                close_writers([&day_dir](const std::string&, const Writer& w) {
+                    return w.prefix.compare(0, day_dir.size() + 1, day_dir + "/") == 0;
+                });
+                expired.push_back(day_dir);
+            }
+        }
+    }
+    for (const auto& day_dir : expired) {
+        s_remove_dir(day_dir);
+        log_debug("tsdb: expired %s", day_dir.c_str());
+    }
+}
+
+int TsdbStorage::select_topic(const std::string& topic, std::string& units)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    units.clear();
+
+    auto it = _writers.find(topic);
+    if (it != _writers.end()) {
+        units = s_header(it->second.chunk)->units;
+        return 0;
+    }
+
+    // first chunk of the newest day with data
+    std::string          step_dir = s_step_dir(_dir, topic);
+    std::vector<int64_t> days     = s_list_days(step_dir);
+    for (auto day = days.rbegin(); day != days.rend(); ++day) {
+        uint8_t* chunk = s_map_chunk(s_chunk_prefix(step_dir, *day, topic) + "0", false);
+        if (!chunk) {
+            continue;
+        }
+        const ChunkHeader* h = s_header(chunk);
+        if (s_valid(h)) {
+            units.assign(h->units, strnlen(h->units, sizeof(h->units)));
+        }
+        munmap(chunk, TSDB_CHUNK_SIZE);
+        return 0;
+    }
+    log_info("Topic '%s' not found.", topic.c_str());
+    return 0;
+}
+
+int TsdbStorage::select(
+    const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, bool /* is_ordered */)
+{
+    // only the newest chunk of the topic is appended to: it is copied under the lock,
+    // the older ones are decoded from their mapping without it
+    std::string          step_dir = s_step_dir(_dir, topic);
+    std::vector<int64_t> days;
+    std::string          last_path;
+    int64_t              last_day = 0;
+    std::vector<uint8_t> last_chunk;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        days    = s_list_days(step_dir);
+        auto it = _writers.find(topic);
+        if (it != _writers.end()) {
+            last_path = it->second.prefix + std::to_string(it->second.seq);
+            last_day  = it->second.day;
+            last_chunk.assign(it->second.chunk, it->second.chunk + TSDB_CHUNK_SIZE);
+        } else {
+            last_path = s_last_chunk(step_dir, days, topic, last_day);
+            if (last_path.empty()) {
+                return 0;
+            }
+            uint8_t* chunk = s_map_chunk(last_path, false);
+            if (!chunk) {
+                log_error("can't read tsdb chunk '%s': %s", last_path.c_str(), strerror(errno));
+                return -1;
+            }
+            last_chunk.assign(chunk, chunk + TSDB_CHUNK_SIZE);
+            munmap(chunk, TSDB_CHUNK_SIZE);
+        }
+    }
+
+    // points are always ordered: days, chunks of a day and points of a chunk are
+    for (int64_t day : days) {
+        if ((day + 1) * SECONDS_PER_DAY <= start) {
+            continue;
+        }
+        if (day * SECONDS_PER_DAY > end || day > last_day) {
+            break;
+        }
+        std::string prefix = s_chunk_prefix(step_dir, day, topic);
+        for (int seq = 0;; seq++) {
+            std::string path = prefix + std::to_string(seq);
+            if (path == last_path) {
+                if (!s_decode(last_chunk.data(), start, end, cb)) {
+                    log_error("tsdb chunk '%s' is corrupted", path.c_str());
+                    return -1;
+                }
+                return 0;
+            }
+            uint8_t* chunk = s_map_chunk(path, false);
+            if (!chunk) {
+                if (errno == ENOENT) {
+                    break;
+                }
+                log_error("can't read tsdb chunk '%s': %s", path.c_str(), strerror(errno));
+                return -1;
+            }
+            bool ok = s_decode(chunk, start, end, cb);
+            munmap(chunk, TSDB_CHUNK_SIZE);
+            if (!ok) {
+                log_error("tsdb chunk '%s' is corrupted", path.c_str());
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int TsdbStorage::delete_assets(const std::vector<std::string>& asset_names, const std::function<bool()>& keep_going)
+{
+    std::vector<std::string> suffixes;
+    for (const auto& asset : asset_names) {
+        suffixes.push_back(topic_to_filename("@" + asset));
+    }
+    auto is_asset_topic = [&suffixes](const std::string& name) {
+        for (const auto& suffix : suffixes) {
+            if (name.size() > suffix.size() &&
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // the chunks are listed under the lock, removed without it
+    std::vector<std::string> paths;
+    bool                     interrupted = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        close_writers([&is_asset_topic](const std::string& topic, const Writer&) {
+            return is_asset_topic(topic_to_filename(topic));
+        });
+
+        for (int i = 0; i < RETENTION_STEPS_SIZE && !interrupted; i++) {
+            std::string step_dir = _dir + "/" + RETENTION_STEPS[i];
+            for (int64_t day : s_list_days(step_dir)) {
+                std::string day_dir = step_dir + "/" + s_day_name(day);
+                DIR*        dir     = opendir(day_dir.c_str());
+                if (!dir) {
+                    continue;
+                }
+                while (struct dirent* entry = readdir(dir)) {
+                    // <topic>.<seq>
+                    std::string name(entry->d_name);
+                    size_t      dot = name.rfind('.');
+                    if (dot != std::string::npos && dot > 0 && is_asset_topic(name.substr(0, dot))) {
+                        paths.push_back(day_dir + "/" + name);
+                    }
+                }
+                closedir(dir);
+                if (!keep_going()) {
+                    interrupted = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (const auto& path : paths) {
+        unlink(path.c_str());
+    }
+    if (interrupted) {
+        log_warning("interrupted while deleting measurements of %zu asset(s)", asset_names.size());
+        return 1;
+    }
+    log_info("tsdb: deleted %zu asset(s): %zu chunks", asset_names.size(), paths.size());
+    return 0;
+}
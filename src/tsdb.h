@@ -0,0 +1,71 @@
+/*  =========================================================================
+    tsdb - Embedded time-series storage backend
+
+    Copyright (C) 2014 - 2020 Eaton
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+    =========================================================================
+*/
+
+#pragma once
+#include "storage.h"
+#include <map>
+#include <mutex>
+
+#define TSDB_DIR_DEFAULT     "/var/lib/fty/fty-metric-store/tsdb"
+#define TSDB_CHUNK_SIZE      (64 * 1024)        // bytes
+#define TSDB_EXPIRE_INTERVAL (3600)             // s
+
+// Append-only store of measurements in memory mapped chunk files
+//   <dir>/<step>/<YYYYMMDD>/<topic>.<n>
+// Each chunk is a fixed size file, a header followed by Gorilla compressed points
+// (delta-of-delta timestamps, XOR of value and scale). Points older than the last
+// point of the topic are dropped. Whole day directories are removed once they are
+// older than the storage age of the step. Only the newest chunk of a topic is written,
+// readers copy it under the lock and decode the older ones without holding it.
+class TsdbStorage : public Storage
+{
+public:
+    explicit TsdbStorage(const std::string& dir);
+    ~TsdbStorage() override;
+
+    int insert(const std::string& topic, m_msrmnt_value_t value, m_msrmnt_scale_t scale, int64_t time,
+        const char* units, const char* device_name) override;
+    void flush(bool force, int shard) override;
+    int  select_topic(const std::string& topic, std::string& units) override;
+    int  select(const std::string& topic, int64_t start, int64_t end, const msrmnt_cb_t& cb, bool is_ordered) override;
+    int  delete_assets(const std::vector<std::string>& asset_names, const std::function<bool()>& keep_going) override;
+
+    // Removes day directories older than the storage age of their step
+    void expire(int64_t now);
+
+private:
+    struct Writer
+    {
+        std::string prefix; // chunk path without the sequence number
+        int64_t     day;
+        int         seq;
+        int         step;
+        uint8_t*    chunk;
+    };
+
+    int  open_writer(const std::string& topic, int64_t day, Writer& writer);
+    void close_writers(const std::function<bool(const std::string&, const Writer&)>& pred);
+
+    std::string                   _dir;
+    std::mutex                    _mutex;
+    std::map<std::string, Writer> _writers;
+    int64_t                       _last_expire;
+};
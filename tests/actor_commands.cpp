@@ -1,4 +1,6 @@
 #include "src/actor_commands.h"
+#include "src/fty_metric_store_server.h"
+#include "src/retention.h"
 #include <catch2/catch.hpp>
 #include <fty_log.h>
 #include <malamute.h>
@@ -243,6 +245,37 @@ TEST_CASE("actor commands test")
 
     STDERR_NON_EMPTY
 
+    // --------------------------------------------------------------
+    fp = freopen(str_stderr_txt.c_str(), "w+", stderr);
+    // FTY_METRIC_STORE_AGE - expected fail
+    message = zmsg_new();
+    REQUIRE(message);
+    zmsg_addstr(message, FTY_METRIC_STORE_CONF_PREFIX);
+    zmsg_addstr(message, "15m");
+    zmsg_addstr(message, "not-a-number");
+    rv = actor_commands(client, &message);
+    REQUIRE(rv == 0);
+    REQUIRE(message == nullptr);
+    CHECK(retention_get_age("15m") == -1);
+
+    STDERR_NON_EMPTY
+
+    // --------------------------------------------------------------
+    fp = freopen(str_stderr_txt.c_str(), "w+", stderr);
+    // FTY_METRIC_STORE_AGE
+    message = zmsg_new();
+    REQUIRE(message);
+    zmsg_addstr(message, FTY_METRIC_STORE_CONF_PREFIX);
+    zmsg_addstr(message, "15m");
+    zmsg_addstr(message, "7");
+    rv = actor_commands(client, &message);
+    REQUIRE(rv == 0);
+    REQUIRE(message == nullptr);
+    CHECK(retention_get_age("15m") == 7);
+    CHECK(retention_max_age() >= 7);
+
+    STDERR_EMPTY
+
     zmsg_destroy(&message);
     mlm_client_destroy(&client);
     zactor_destroy(&malamute);
@@ -0,0 +1,52 @@
+#include "src/archive.h"
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+
+TEST_CASE("archive test")
+{
+    ManageFtyLog::setInstanceFtylog("archive");
+
+    std::vector<ArchivePoint> points = {
+        {1606089600, 1234, -1},
+        {1606090500, 1235, -1},
+        {1606091400, -80000, 0},
+        {1606092300, 2147483647, 0},
+        {1606094100, -2147483647 - 1, -3},
+        {1606095000, 0, 0},
+    };
+
+    std::string segment = archive_encode(points);
+    // header + few bytes per point
+    CHECK(segment.size() < 24 + points.size() * 12);
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(segment.data());
+
+    std::vector<ArchivePoint> decoded;
+    REQUIRE(archive_decode(data, segment.size(), INT64_MIN, INT64_MAX, decoded));
+    REQUIRE(decoded.size() == points.size());
+    for (size_t i = 0; i != points.size(); i++) {
+        CHECK(decoded[i].timestamp == points[i].timestamp);
+        CHECK(decoded[i].value == points[i].value);
+        CHECK(decoded[i].scale == points[i].scale);
+    }
+
+    // range
+    decoded.clear();
+    REQUIRE(archive_decode(data, segment.size(), 1606090500, 1606092300, decoded));
+    REQUIRE(decoded.size() == 3);
+    CHECK(decoded[0].timestamp == 1606090500);
+    CHECK(decoded[2].value == 2147483647);
+
+    // empty
+    std::string empty = archive_encode({});
+    decoded.clear();
+    CHECK(archive_decode(reinterpret_cast<const uint8_t*>(empty.data()), empty.size(), 0, INT64_MAX, decoded));
+    CHECK(decoded.empty());
+
+    // corrupted
+    CHECK(!archive_decode(data, segment.size() - 1, INT64_MIN, INT64_MAX, decoded));
+    CHECK(!archive_decode(data + 1, segment.size() - 1, INT64_MIN, INT64_MAX, decoded));
+
+    // disabled by default
+    CHECK(!archive_enabled());
+}
@@ -0,0 +1,102 @@
+#include "src/capture.h"
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+#include <unistd.h>
+
+struct TempDir
+{
+    std::string path;
+    ~TempDir()
+    {
+        // removed even when a REQUIRE fails
+        int rv = system(("rm -rf " + path).c_str());
+        (void)rv;
+    }
+};
+
+TEST_CASE("capture test")
+{
+    ManageFtyLog::setInstanceFtylog("capture");
+
+    char tmpl[] = "/tmp/fty-metric-store-capture-XXXXXX";
+    REQUIRE(mkdtemp(tmpl));
+    TempDir           dir{tmpl};
+    const std::string file = dir.path + "/capture.bin";
+
+    std::vector<CaptureRecord> records(3);
+    records[0].kind    = CAPTURE_STREAM;
+    records[0].time_us = 1606089600000001;
+    records[0].address = "METRICS";
+    records[0].subject = "realpower.default_avg_15m@ups-1";
+    records[0].payload = std::string("\x01\x02\x00\x03", 4);
+    records[1].kind    = CAPTURE_MAILBOX;
+    records[1].time_us = 1606089600500000;
+    records[1].address = "fty-metric-store-ui";
+    records[1].subject = "aggregated data";
+    records[1].payload = std::string(100000, 'x');
+    records[2].kind    = CAPTURE_STREAM;
+    records[2].time_us = 1606089601000000;
+    records[2].address = "ASSETS";
+
+    {
+        CaptureWriter writer;
+        REQUIRE(writer.open(file) == 0);
+        for (const auto& record : records) {
+            CHECK(writer.write(record) == 0);
+        }
+    }
+
+    CaptureReader reader;
+    REQUIRE(reader.open(file) == 0);
+    CaptureRecord record;
+    for (const auto& expected : records) {
+        REQUIRE(reader.next(record));
+        CHECK(record.kind == expected.kind);
+        CHECK(record.time_us == expected.time_us);
+        CHECK(record.address == expected.address);
+        CHECK(record.subject == expected.subject);
+        CHECK(record.payload == expected.payload);
+    }
+    CHECK(!reader.next(record));
+    reader.close();
+
+    // truncated record
+    REQUIRE(truncate(file.c_str(), 4 + 4 + 10) == 0);
+    REQUIRE(reader.open(file) == 0);
+    CHECK(!reader.next(record));
+    reader.close();
+
+    // not a capture
+    FILE* f = fopen(file.c_str(), "wb");
+    fputs("not a capture", f);
+    fclose(f);
+    CHECK(reader.open(file) != 0);
+
+    // not started
+    capture_stop();
+
+    // metrics read from shm
+    zmsg_t*      msg    = fty_proto_encode_metric(nullptr, 1606089600, 0, "realpower.default_avg_15m", "ups-1", "42", "W");
+    fty_proto_t* metric = fty_proto_decode(&msg);
+    REQUIRE(metric);
+    REQUIRE(capture_start(file.c_str()) == 0);
+    capture_shm_metrics({metric});
+    capture_stop();
+    CHECK(streq(fty_proto_value(metric), "42"));
+    fty_proto_destroy(&metric);
+
+    REQUIRE(reader.open(file) == 0);
+    REQUIRE(reader.next(record));
+    CHECK(record.kind == CAPTURE_SHM);
+    CHECK(record.subject == "realpower.default_avg_15m@ups-1");
+    zframe_t* frame = zframe_new(record.payload.data(), record.payload.size());
+    msg             = zmsg_decode(frame);
+    zframe_destroy(&frame);
+    metric = fty_proto_decode(&msg);
+    REQUIRE(metric);
+    CHECK(streq(fty_proto_type(metric), "realpower.default_avg_15m"));
+    CHECK(streq(fty_proto_value(metric), "42"));
+    fty_proto_destroy(&metric);
+    CHECK(!reader.next(record));
+    reader.close();
+}
@@ -78,4 +78,17 @@ TEST_CASE("converter test")
     CHECK(stobiosf("sdfsd", integer, scale) == false);
 
     CHECK(string_to_int64("1234") == 1234);
+
+    int16_t scale16 = 0;
+    CHECK(string_to_measurement("1234", integer, scale16));
+    CHECK(integer == 1234);
+    CHECK(scale16 == 0);
+    CHECK(string_to_measurement("-12.5", integer, scale16));
+    CHECK(integer == -125);
+    CHECK(scale16 == -1);
+    CHECK(string_to_measurement("2.532132356545624522452456", integer, scale16));
+    CHECK(integer == 253);
+    CHECK(scale16 == -2);
+    CHECK(!string_to_measurement("12x43", integer, scale16));
+    CHECK(errno == 0);
 }
@@ -0,0 +1,73 @@
+#include "src/db_io.h"
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+#include <thread>
+
+TEST_CASE("db io test")
+{
+    ManageFtyLog::setInstanceFtylog("db_io");
+
+    DbIo       db_io(2);
+    zpoller_t* poller = zpoller_new(nullptr);
+    REQUIRE(poller);
+    db_io.add_to(poller);
+
+    // several requests in flight, completed by the owner thread
+    std::thread::id  owner = std::this_thread::get_id();
+    std::atomic<int> worked{0};
+    std::atomic<bool> other{true};
+    int               done = 0;
+    for (int i = 0; i < 10; i++) {
+        db_io.submit("test",
+            [&worked, owner, &other]() {
+                if (std::this_thread::get_id() == owner) {
+                    other = false;
+                }
+                worked++;
+            },
+            [&done](bool timed_out) {
+                CHECK(!timed_out);
+                done++;
+            },
+            1000);
+    }
+    CHECK(db_io.in_flight() == 10);
+    while (done < 10) {
+        void* which = zpoller_wait(poller, db_io.expire(1000));
+        REQUIRE(which);
+        CHECK(db_io.dispatch(which));
+    }
+    CHECK(worked == 10);
+    CHECK(other);
+    CHECK(db_io.in_flight() == 0);
+    CHECK(!db_io.dispatch(poller));
+
+    // timeout, the late completion is dropped
+    std::atomic<bool> release{false};
+    int               timed_out = 0;
+    db_io.submit("slow",
+        [&release]() {
+            while (!release) {
+                zclock_sleep(10);
+            }
+        },
+        [&timed_out](bool t) {
+            CHECK(t);
+            timed_out++;
+        },
+        50);
+    CHECK(db_io.expire(1000) <= 50);
+    zclock_sleep(100);
+    db_io.expire(1000);
+    CHECK(timed_out == 1);
+    CHECK(db_io.in_flight() == 1);
+    release = true;
+    void* which = zpoller_wait(poller, 1000);
+    REQUIRE(which);
+    CHECK(db_io.dispatch(which));
+    CHECK(timed_out == 1);
+    CHECK(db_io.in_flight() == 0);
+
+    zpoller_destroy(&poller);
+}
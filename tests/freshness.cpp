@@ -0,0 +1,49 @@
+#include "src/freshness.h"
+#include "src/persistance.h"
+#include "src/retention.h"
+#include "src/stats.h"
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+#include <map>
+
+static std::map<std::string, int64_t> s_snapshot()
+{
+    std::map<std::string, int64_t> snapshot;
+    stats_foreach([&snapshot](const std::string& name, int64_t value) {
+        snapshot[name] = value;
+    });
+    return snapshot;
+}
+
+TEST_CASE("freshness test")
+{
+    ManageFtyLog::setInstanceFtylog("freshness");
+
+    int64_t now = int64_t(time(nullptr));
+
+    auto before = s_snapshot();
+    freshness_record(FRESHNESS_PARSED, 0, now - 10);
+    freshness_record(FRESHNESS_PARSED, 1, now - 900);
+    // from the future
+    freshness_record(FRESHNESS_PARSED, 0, now + 100);
+    auto after = s_snapshot();
+
+    CHECK(after["lag.parsed.rt_ms.count"] - before["lag.parsed.rt_ms.count"] == 2);
+    CHECK(after["lag.parsed.aggr_ms.count"] - before["lag.parsed.aggr_ms.count"] == 1);
+    CHECK(after["lag.parsed.aggr_ms.max"] >= 900000);
+    CHECK(after["lag.parsed.rt_ms.max"] < 20000);
+
+    // stored measurements are committed
+    retention_set_age("15m", 1);
+    {
+        std::lock_guard<std::mutex> lock(g_row_mutex);
+        REQUIRE(insert_into_measurement(
+                    "memory:freshness", "realpower.default_avg_15m@ups-1", 1234, -1, now - 60, "W", "ups-1") == 0);
+    }
+    auto committed = s_snapshot();
+    CHECK(committed["lag.buffered.aggr_ms.count"] - after["lag.buffered.aggr_ms.count"] == 1);
+    CHECK(committed["lag.committed.aggr_ms.count"] - after["lag.committed.aggr_ms.count"] == 1);
+    CHECK(committed["lag.committed.aggr_ms.p50"] >= 60000);
+
+    freshness_check();
+}
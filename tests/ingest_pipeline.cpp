@@ -0,0 +1,120 @@
+#include "src/ingest_pipeline.h"
+#include "src/retention.h"
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+#include <map>
+#include <thread>
+
+static zmsg_t* s_metric(const std::string& type, const std::string& name, int value, uint64_t time, bool cm = true)
+{
+    zhash_t* aux = zhash_new();
+    if (cm) {
+        zhash_insert(aux, "x-cm-type", const_cast<char*>("avg"));
+    }
+    zmsg_t* msg = fty_proto_encode_metric(aux, time, 0, type.c_str(), name.c_str(), std::to_string(value).c_str(), "W");
+    zhash_destroy(&aux);
+    return msg;
+}
+
+TEST_CASE("ingest spsc queue test")
+{
+    IngestSignal    signal;
+    IngestSpscQueue queue(4, signal);
+
+    IngestItem item;
+    CHECK(queue.empty());
+    CHECK(!queue.pop(item));
+
+    std::thread producer([&queue]() {
+        for (uintptr_t i = 1; i <= 100000; i++) {
+            IngestItem it;
+            it.message = reinterpret_cast<zmsg_t*>(i);
+            while (!queue.push(it)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uintptr_t next  = 1;
+    bool      order = true;
+    while (next <= 100000) {
+        signal.wait(100, [&queue]() {
+            return !queue.empty();
+        });
+        while (queue.pop(item)) {
+            order = order && reinterpret_cast<uintptr_t>(item.message) == next;
+            next++;
+        }
+    }
+    producer.join();
+    CHECK(order);
+    CHECK(queue.empty());
+}
+
+TEST_CASE("ingest pipeline test")
+{
+    ManageFtyLog::setInstanceFtylog("ingest_pipeline");
+
+    for (int parsers : {0, 3}) {
+        IngestQueues queues(1024);
+        REQUIRE(queues.size() == 1);
+        IngestQueue& queue = queues[0];
+        {
+            IngestPipeline pipeline(queues, parsers);
+            CHECK(pipeline.parsers() == parsers);
+            for (int i = 0; i < 100; i++) {
+                std::string name = "ups-" + std::to_string(i % 5);
+                zmsg_t*     msg  = s_metric("realpower.default_avg_15m", name, i, uint64_t(900 * (i + 1)));
+                pipeline.push(&msg, ("realpower.default_avg_15m@" + name).c_str());
+                CHECK(!msg);
+            }
+            // parses the queued metrics
+        }
+
+        std::map<std::string, int64_t> last;
+        int                            count = 0;
+        bool                           order = true;
+        IngestRecord                   record;
+        while (queue.pop(record)) {
+            order               = order && record.time > last[*record.topic];
+            last[*record.topic] = record.time;
+            CHECK(*record.units == "W");
+            count++;
+        }
+        CHECK(order);
+        CHECK(count == 100);
+        CHECK(last.size() == 5);
+    }
+
+    // once stopped, the metrics are dropped
+    IngestQueues queues(1024);
+    {
+        IngestPipeline pipeline(queues, 1);
+        pipeline.stop();
+        zmsg_t* msg = s_metric("realpower.default_avg_15m", "ups-1", 10, 900);
+        pipeline.push(&msg, "realpower.default_avg_15m@ups-1");
+        CHECK(!msg);
+    }
+    IngestRecord record;
+    CHECK(!queues[0].pop(record));
+}
+
+TEST_CASE("ingest stream prefilter test")
+{
+    ManageFtyLog::setInstanceFtylog("ingest_pipeline");
+
+    zmsg_t* msg = s_metric("realpower.default_avg_15m", "ups-1", 10, 900);
+    CHECK(ingest_stream_prefilter(msg, "realpower.default_avg_15m@ups-1"));
+    zmsg_destroy(&msg);
+
+    // raw metric
+    msg = s_metric("realpower.default", "ups-1", 10, 900, false);
+    CHECK(!ingest_stream_prefilter(msg, "realpower.default@ups-1"));
+    zmsg_destroy(&msg);
+
+    // step not stored
+    retention_set_age("8h", 0);
+    msg = s_metric("realpower.default_avg_8h", "ups-1", 10, 900);
+    CHECK(!ingest_stream_prefilter(msg, "realpower.default_avg_8h@ups-1"));
+    zmsg_destroy(&msg);
+    retention_set_age("8h", -1);
+}
@@ -0,0 +1,153 @@
+#include "src/ingest_queue.h"
+#include "src/intern.h"
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <chrono>
+#include <fty_log.h>
+#include <thread>
+#include <vector>
+
+TEST_CASE("ingest queue test")
+{
+    IngestQueue queue(1000);
+    CHECK(queue.capacity() == 1024);
+
+    IngestRecord record;
+    CHECK(!queue.pop(record));
+    // nothing to wait for
+    queue.wait(10);
+
+    // several producers on a small queue, each one in order
+    static const int PRODUCERS = 4;
+    static const int RECORDS   = 20000;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < RECORDS; i++) {
+                IngestRecord r;
+                r.topic = &intern("realpower.default_avg_15m@ups-" + std::to_string(p));
+                r.value = p;
+                r.time  = i;
+                queue.push(std::move(r));
+            }
+        });
+    }
+
+    std::vector<int64_t> next(PRODUCERS, 0);
+    int                  count = 0;
+    bool                 order = true;
+    while (count < PRODUCERS * RECORDS) {
+        queue.wait(100);
+        while (queue.pop(record)) {
+            order = order && record.time == next[size_t(record.value)];
+            next[size_t(record.value)]++;
+            count++;
+        }
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    CHECK(order);
+    CHECK(count == PRODUCERS * RECORDS);
+    CHECK(!queue.pop(record));
+    CHECK(queue.size() == 0);
+}
+
+TEST_CASE("ingest queue stop test")
+{
+    IngestQueue queue(4);
+    for (int i = 0; i < 4; i++) {
+        IngestRecord r;
+        r.time = i;
+        CHECK(queue.push(std::move(r)));
+    }
+
+    // a producer waiting on the full queue gives up once the consumer stopped
+    std::atomic<bool> pushed(false);
+    bool              result = true;
+    std::thread       producer([&queue, &pushed, &result]() {
+        result = queue.push(IngestRecord());
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!pushed);
+    queue.stop();
+    producer.join();
+    CHECK(!result);
+
+    // the records queued before are still popped, new ones are dropped
+    IngestRecord record;
+    int          count = 0;
+    while (queue.pop(record)) {
+        CHECK(record.time == count);
+        count++;
+    }
+    CHECK(count == 4);
+    CHECK(!queue.push(IngestRecord()));
+    CHECK(!queue.pop(record));
+}
+
+TEST_CASE("ingest queues test")
+{
+    IngestQueues queues(16);
+    REQUIRE(queues.size() == persistance_shards());
+
+    for (int i = 0; i < 10; i++) {
+        IngestRecord r;
+        r.topic = &intern("realpower.default@ups-" + std::to_string(i));
+        CHECK(persistance_shard(*r.topic) >= 0);
+        CHECK(persistance_shard(*r.topic) < queues.size());
+        queues.push(std::move(r));
+    }
+    // each record is in the queue of the shard of its topic
+    int          count = 0;
+    IngestRecord record;
+    for (int shard = 0; shard < queues.size(); shard++) {
+        while (queues[shard].pop(record)) {
+            CHECK(persistance_shard(*record.topic) == shard);
+            count++;
+        }
+    }
+    CHECK(count == 10);
+
+    // deletes hold every shard
+    {
+        PersistanceShardsLock lock;
+        CHECK(!g_row_mutex.try_lock());
+    }
+    CHECK(g_row_mutex.try_lock());
+    g_row_mutex.unlock();
+}
+
+TEST_CASE("ingest writer test")
+{
+    ManageFtyLog::setInstanceFtylog("ingest_queue");
+
+    static const std::string url = "memory:ingest-writer-test";
+
+    IngestQueue      queue(16);
+    IngestWriterArgs args{url, queue, 0};
+    zactor_t*        writer = zactor_new(fty_metric_store_ingest_writer, &args);
+    REQUIRE(writer);
+
+    for (int i = 0; i < 100; i++) {
+        IngestRecord r;
+        r.topic       = &intern("realpower.default_avg_15m@ups-1");
+        r.units       = &intern("W");
+        r.device_name = &intern("ups-1");
+        r.value       = i;
+        r.time        = 900 * (i + 1);
+        queue.push(std::move(r));
+    }
+    // the queued measurements are stored before the writer terminates
+    zactor_destroy(&writer);
+
+    int count = 0;
+    CHECK(select_measurements(url, "realpower.default_avg_15m@ups-1", 0, INT64_MAX,
+              [&count](int64_t, m_msrmnt_value_t, m_msrmnt_scale_t) {
+                  count++;
+              },
+              true) == 0);
+    CHECK(count == 100);
+}
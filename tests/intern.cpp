@@ -0,0 +1,56 @@
+#include "src/intern.h"
+#include "src/memory_account.h"
+#include <catch2/catch.hpp>
+#include <thread>
+#include <vector>
+
+TEST_CASE("intern test")
+{
+    size_t             size  = intern_size();
+    const std::string& topic = intern("realpower.default_avg_15m@ups-1");
+    CHECK(topic == "realpower.default_avg_15m@ups-1");
+    CHECK(&intern(std::string("realpower.default_avg_15m@") + "ups-1") == &topic);
+    CHECK(&intern("realpower.default_avg_15m@ups-2") != &topic);
+    CHECK(intern_size() == size + 2);
+
+    // same strings from several threads
+    std::vector<const std::string*> interned(4 * 100);
+    std::vector<std::thread>        threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([t, &interned]() {
+            for (size_t i = 0; i < 100; i++) {
+                interned[t * 100 + i] = &intern("voltage.input_L1@ups-" + std::to_string(i));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < 100; i++) {
+        CHECK(*interned[i] == "voltage.input_L1@ups-" + std::to_string(i));
+        for (size_t t = 1; t < 4; t++) {
+            CHECK(interned[t * 100 + i] == interned[i]);
+        }
+    }
+    CHECK(intern_size() == size + 2 + 100);
+
+    // bounded by the distinct strings: the same assets coming back add nothing
+    MemoryAccount& memory = memory_account("interned");
+    size                  = intern_size();
+    size_t  distinct      = 0;
+    int64_t bytes         = 0;
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = 0; i < 100; i++) {
+            intern("voltage.input_L1@ups-" + std::to_string(i));
+            intern("ups-" + std::to_string(i));
+        }
+        intern("V");
+        if (round == 0) {
+            distinct = intern_size();
+            bytes    = memory.bytes();
+        }
+    }
+    CHECK(distinct <= size + 100 + 1);
+    CHECK(intern_size() == distinct);
+    CHECK(memory.bytes() == bytes);
+}
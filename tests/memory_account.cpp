@@ -0,0 +1,89 @@
+#include "src/memory_account.h"
+#include "src/multi_row.h"
+#include "src/persistance.h"
+#include <catch2/catch.hpp>
+#include <cstdlib>
+#include <fty_log.h>
+#include <map>
+
+static std::map<std::string, int64_t> s_stats()
+{
+    std::map<std::string, int64_t> stats;
+    stats_foreach([&stats](const std::string& name, int64_t value) {
+        stats[name] = value;
+    });
+    return stats;
+}
+
+TEST_CASE("memory account test")
+{
+    ManageFtyLog::setInstanceFtylog("memory_account");
+
+    CHECK(memory_string("short") == 0);
+    CHECK(memory_string(std::string(100, 'x')) > 100);
+
+    setenv("BIOS_DBSTORE_MEMORY_CAP_TEST_CAPPED", "100", 1);
+    MemoryAccount& capped = memory_account("test_capped");
+    CHECK(&capped == &memory_account("test_capped"));
+    CHECK(capped.cap() == 100);
+    capped.add(60);
+    CHECK(!capped.over_cap());
+    capped.add(60);
+    CHECK(capped.over_cap());
+    capped.evicted();
+    capped.sub(60);
+    CHECK(!capped.over_cap());
+
+    MemoryAccount& unlimited = memory_account("test_unlimited");
+    unlimited.add(1000000);
+    CHECK(unlimited.cap() == 0);
+    CHECK(!unlimited.over_cap());
+
+    auto stats = s_stats();
+    CHECK(stats["memory.test_capped.bytes"] == 60);
+    CHECK(stats["memory.test_capped.cap"] == 100);
+    CHECK(stats["memory.test_capped.evictions"] == 1);
+    CHECK(stats["memory.test_unlimited.bytes"] == 1000000);
+}
+
+TEST_CASE("memory account of the caches test")
+{
+    ManageFtyLog::setInstanceFtylog("memory_account");
+
+    // row cache
+    MemoryAccount& row_cache = memory_account("row_cache");
+    int64_t        before    = row_cache.bytes();
+    {
+        MultiRowCache cache(MAX_ROW_DEFAULT, MAX_DELAY_DEFAULT);
+        for (int i = 0; i < 10; i++) {
+            cache.push_back(1606089600 + i * 900, 23012 + i, -2, 1);
+        }
+        CHECK(row_cache.bytes() >= before + 10 * int64_t(sizeof(std::string)));
+        cache.clear();
+        CHECK(row_cache.bytes() == before);
+        cache.push_back(1606089600, 1, 0, 1);
+    }
+    CHECK(row_cache.bytes() == before);
+
+    // in-memory storage
+    static const std::string url     = "memory:memory-account-test";
+    MemoryAccount&           storage = memory_account("storage_memory");
+    before                           = storage.bytes();
+
+    g_row_mutex.lock();
+    CHECK(insert_into_measurement(url, "realpower.default_avg_15m@ups-1", 10, 0, 900, "W", "ups-1") == 0);
+    int64_t one = storage.bytes();
+    CHECK(one > before);
+    CHECK(insert_into_measurement(url, "realpower.default_avg_15m@ups-1", 20, 0, 1800, "W", "ups-1") == 0);
+    int64_t two = storage.bytes();
+    CHECK(two > one);
+    // same timestamp overrides, no new measurement
+    CHECK(insert_into_measurement(url, "realpower.default_avg_15m@ups-1", 30, 0, 1800, "W", "ups-1") == 0);
+    CHECK(storage.bytes() == two);
+    g_row_mutex.unlock();
+
+    CHECK(delete_measurements(url, {"ups-1"}, [] {
+        return true;
+    }) == 0);
+    CHECK(storage.bytes() == before);
+}
@@ -1,7 +1,12 @@
+#include "src/db_io.h"
 #include "src/fty_metric_store_server.h"
+#include <arpa/inet.h>
 #include <catch2/catch.hpp>
 #include <fty_log.h>
 #include <malamute.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 TEST_CASE("metric store server test")
 {
@@ -73,6 +78,96 @@ TEST_CASE("metric store server test")
     zmsg_print(msg);
     zmsg_destroy(&msg);
 
+    // statistics
+    msg = zmsg_new();
+    zmsg_addstr(msg, uuid);
+    REQUIRE(mlm_client_sendto(mbox_client, "fty-metric-store", "STATS", nullptr, 1000, &msg) >= 0);
+    msg = mlm_client_recv(mbox_client);
+    REQUIRE(msg);
+    received_uuid = zmsg_popstr(msg);
+    CHECK(streq(uuid, received_uuid));
+    zstr_free(&received_uuid);
+    result = zmsg_popstr(msg);
+    CHECK(streq(result, "OK"));
+    zstr_free(&result);
+    bool found = false;
+    while (zmsg_size(msg) >= 2) {
+        char* name  = zmsg_popstr(msg);
+        char* value = zmsg_popstr(msg);
+        if (streq(name, "get.requests")) {
+            CHECK(atoi(value) >= 1);
+            found = true;
+        }
+        zstr_free(&value);
+        zstr_free(&name);
+    }
+    CHECK(found);
+    zmsg_destroy(&msg);
+
+    mlm_client_destroy(&mbox_client);
+    zactor_destroy(&self);
+    zactor_destroy(&server);
+}
+
+TEST_CASE("metric store server timeout test")
+{
+    static const char* endpoint = "inproc://malamute-timeout-test";
+
+    ManageFtyLog::setInstanceFtylog("fty_metric_store_server");
+
+    // a database accepting connections (in the backlog) which never answers
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family         = AF_INET;
+    addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+    socklen_t len           = sizeof(addr);
+    REQUIRE(bind(listener, reinterpret_cast<struct sockaddr*>(&addr), len) == 0);
+    REQUIRE(listen(listener, 16) == 0);
+    REQUIRE(getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &len) == 0);
+    std::string url = "mysql:host=127.0.0.1;port=" + std::to_string(ntohs(addr.sin_port)) + ";db=box_utf8;user=root";
+
+    setenv(EV_DBSTORE_DB_IO_TIMEOUT, "200", 1);
+    zactor_t* server = zactor_new(mlm_server, const_cast<char*>("Malamute"));
+    zstr_sendx(server, "BIND", endpoint, nullptr);
+    zactor_t* self = zactor_new(fty_metric_store_server, const_cast<char*>(url.c_str()));
+    zstr_sendx(self, "CONNECT", endpoint, "fty-metric-store", nullptr);
+    unsetenv(EV_DBSTORE_DB_IO_TIMEOUT);
+
+    mlm_client_t* mbox_client = mlm_client_new();
+    REQUIRE(mlm_client_connect(mbox_client, endpoint, 5000, "mbox-query") >= 0);
+
+    static const char* uuid = "012345679";
+    zmsg_t*            msg  = zmsg_new();
+    zmsg_addstr(msg, uuid);
+    zmsg_addstr(msg, "GET");
+    zmsg_addstr(msg, "some-asset");
+    zmsg_addstr(msg, "realpower.default");
+    zmsg_addstr(msg, "15m");
+    zmsg_addstr(msg, "min");
+    zmsg_addstr(msg, "0");
+    zmsg_addstr(msg, "9999");
+    zmsg_addstr(msg, "1");
+    REQUIRE(mlm_client_sendto(mbox_client, "fty-metric-store", AVG_GRAPH, nullptr, 1000, &msg) >= 0);
+    zpoller_t* poller = zpoller_new(mlm_client_msgpipe(mbox_client), nullptr);
+    REQUIRE(zpoller_wait(poller, 5000));
+    zpoller_destroy(&poller);
+    msg = mlm_client_recv(mbox_client);
+    REQUIRE(msg);
+    char* received_uuid = zmsg_popstr(msg);
+    CHECK(streq(uuid, received_uuid));
+    zstr_free(&received_uuid);
+    char* result = zmsg_popstr(msg);
+    CHECK(streq(result, "ERROR"));
+    zstr_free(&result);
+    char* reason = zmsg_popstr(msg);
+    CHECK(streq(reason, "TIMEOUT"));
+    zstr_free(&reason);
+    zmsg_destroy(&msg);
+
+    // resets the pending connection, the I/O thread gives up
+    close(listener);
+
     mlm_client_destroy(&mbox_client);
     zactor_destroy(&self);
     zactor_destroy(&server);
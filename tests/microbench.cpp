@@ -0,0 +1,130 @@
+#include "src/converter.h"
+#include "src/fty_metric_store_server.h"
+#include "src/multi_row.h"
+#include <catch2/catch.hpp>
+#include <deque>
+#include <fty_log.h>
+#include <vector>
+
+// values as published by fty-metric-compute and the agents
+static const std::vector<std::string> INTEGERS = {"0", "1", "42", "230", "-15", "1500", "65535", "-2147483648"};
+static const std::vector<std::string> DECIMALS = {"0.5", "12.5", "-3.75", "230.1", "49.98", "0.01", "1234.56", "99.9"};
+// fractions too long for int32, parsed by the truncation fallback of stobiosf_wrapper()
+static const std::vector<std::string> LONG_FRACTIONS = {
+    "3.14159265358979", "230.123456789", "-12.3456789012", "49.999999999", "0.000000000001", "1234.5678901234"};
+
+template <typename T>
+static int64_t s_parse_all(const std::vector<std::string>& corpus, T parse)
+{
+    int64_t sum = 0;
+    for (const auto& value : corpus) {
+        sum += parse(value);
+    }
+    return sum;
+}
+
+TEST_CASE("converter microbenchmarks", "[benchmark]")
+{
+    ManageFtyLog::setInstanceFtylog("microbench");
+    // the fallback logs each failed attempt
+    ManageFtyLog::getInstanceFtylog()->setLogLevelFatal();
+
+    auto stobiosf_value = [](const std::string& value) {
+        int32_t integer = 0;
+        int8_t  scale   = 0;
+        return stobiosf(value, integer, scale) ? integer + scale : 0;
+    };
+    auto wrapper_value = [](const std::string& value) {
+        int32_t integer = 0;
+        int8_t  scale   = 0;
+        return stobiosf_wrapper(value, integer, scale) ? integer + scale : 0;
+    };
+    auto measurement_value = [](const std::string& value) {
+        int32_t integer = 0;
+        int16_t scale   = 0;
+        return string_to_measurement(value.c_str(), integer, scale) ? integer + scale : 0;
+    };
+
+    BENCHMARK("string_to_int64 integers")
+    {
+        return s_parse_all(INTEGERS, [](const std::string& value) {
+            return string_to_int64(value.c_str());
+        });
+    };
+    BENCHMARK("stobiosf integers")
+    {
+        return s_parse_all(INTEGERS, stobiosf_value);
+    };
+    BENCHMARK("stobiosf short decimals")
+    {
+        return s_parse_all(DECIMALS, stobiosf_value);
+    };
+    BENCHMARK("stobiosf_wrapper short decimals")
+    {
+        return s_parse_all(DECIMALS, wrapper_value);
+    };
+    BENCHMARK("stobiosf_wrapper long fractions")
+    {
+        return s_parse_all(LONG_FRACTIONS, wrapper_value);
+    };
+    BENCHMARK("string_to_measurement integers")
+    {
+        return s_parse_all(INTEGERS, measurement_value);
+    };
+    BENCHMARK("string_to_measurement short decimals")
+    {
+        return s_parse_all(DECIMALS, measurement_value);
+    };
+}
+
+TEST_CASE("row cache microbenchmarks", "[benchmark]")
+{
+    ManageFtyLog::setInstanceFtylog("microbench");
+
+    BENCHMARK_ADVANCED("MultiRowCache::push_back 1000 rows")(Catch::Benchmark::Chronometer meter)
+    {
+        std::deque<MultiRowCache> caches;
+        for (int run = 0; run < meter.runs(); run++) {
+            caches.emplace_back(MAX_ROW_DEFAULT, MAX_DELAY_DEFAULT);
+        }
+        meter.measure([&caches](int run) {
+            MultiRowCache& cache = caches[size_t(run)];
+            for (int i = 0; i < 1000; i++) {
+                cache.push_back(1606089600 + i * 900, 23012 + i, -2, m_msrmnt_tpc_id_t(i % 100));
+            }
+            return cache.is_ready_for_insert();
+        });
+    };
+
+    MultiRowCache cache(MAX_ROW_DEFAULT, MAX_DELAY_DEFAULT);
+    for (int i = 0; i < 1000; i++) {
+        cache.push_back(1606089600 + i * 900, 23012 + i, -2, m_msrmnt_tpc_id_t(i % 100));
+    }
+    BENCHMARK("MultiRowCache::get_insert_query 1000 rows")
+    {
+        return cache.get_insert_query();
+    };
+}
+
+TEST_CASE("reply encoding microbenchmarks", "[benchmark]")
+{
+    ManageFtyLog::setInstanceFtylog("microbench");
+
+    BENCHMARK_ADVANCED("reply_add_measurement 1000 points")(Catch::Benchmark::Chronometer meter)
+    {
+        std::vector<zmsg_t*> replies(size_t(meter.runs()));
+        for (auto& reply : replies) {
+            reply = zmsg_new();
+        }
+        meter.measure([&replies](int run) {
+            zmsg_t* reply = replies[size_t(run)];
+            for (int i = 0; i < 1000; i++) {
+                reply_add_measurement(reply, 1606089600 + i * 900, 23012 + i, m_msrmnt_scale_t(-(i % 3)));
+            }
+            return zmsg_size(reply);
+        });
+        for (auto& reply : replies) {
+            zmsg_destroy(&reply);
+        }
+    };
+}
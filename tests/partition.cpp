@@ -0,0 +1,71 @@
+#include "src/partition.h"
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+
+TEST_CASE("partition test")
+{
+    ManageFtyLog::setInstanceFtylog("partition");
+
+    static const int64_t day  = 24 * 3600;
+    static const int64_t week = 7 * day;
+
+    // 2020-11-23 00:00:00 UTC
+    static const int64_t midnight = 1606089600;
+
+    CHECK(partition_lower_bound(midnight, day) == midnight);
+    CHECK(partition_lower_bound(midnight + 1, day) == midnight);
+    CHECK(partition_lower_bound(midnight + day - 1, day) == midnight);
+    CHECK(partition_lower_bound(midnight + day, day) == midnight + day);
+    CHECK(partition_lower_bound(midnight, week) % week == 0);
+    CHECK(partition_lower_bound(-1, day) == -day);
+
+    CHECK(partition_name(midnight) == "p20201123");
+    CHECK(partition_name(midnight + day) == "p20201124");
+
+    // initial layout: current partition, 'ahead' ones and pmax
+    std::vector<std::string> plan = partition_plan({}, midnight + 3600, day, 2, -1);
+    REQUIRE(plan.size() == 1);
+    CHECK(plan[0] ==
+          "ALTER TABLE t_bios_measurement PARTITION BY RANGE (timestamp) ("
+          "PARTITION p20201123 VALUES LESS THAN (1606176000), "
+          "PARTITION p20201124 VALUES LESS THAN (1606262400), "
+          "PARTITION p20201125 VALUES LESS THAN (1606348800), "
+          "PARTITION pmax VALUES LESS THAN MAXVALUE)");
+
+    // horizon already covered
+    std::vector<Partition> partitions = {{"p20201123", midnight + day, false}, {"p20201124", midnight + 2 * day, false},
+        {"p20201125", midnight + 3 * day, false}, {"pmax", 0, true}};
+    CHECK(partition_plan(partitions, midnight + 3600, day, 2, -1).empty());
+
+    // next day, the partition ahead is created out of pmax
+    plan = partition_plan(partitions, midnight + day, day, 2, -1);
+    REQUIRE(plan.size() == 1);
+    CHECK(plan[0] == "ALTER TABLE t_bios_measurement REORGANIZE PARTITION pmax INTO ("
+                     "PARTITION p20201126 VALUES LESS THAN (1606435200), "
+                     "PARTITION pmax VALUES LESS THAN MAXVALUE)");
+
+    // without pmax, it is added
+    partitions.pop_back();
+    plan = partition_plan(partitions, midnight + day, day, 2, -1);
+    REQUIRE(plan.size() == 1);
+    CHECK(plan[0] == "ALTER TABLE t_bios_measurement ADD PARTITION ("
+                     "PARTITION p20201126 VALUES LESS THAN (1606435200))");
+
+    // only the partitions fully older than the storage age are dropped: the upper bound
+    // of p20201123 is the limit, p20201124 still has rows within the age
+    partitions.push_back({"pmax", 0, true});
+    plan = partition_plan(partitions, midnight + 2 * day, day, 0, 1);
+    REQUIRE(plan.size() == 1);
+    CHECK(plan[0] == "ALTER TABLE t_bios_measurement DROP PARTITION p20201123");
+    plan = partition_plan(partitions, midnight + 2 * day - 1, day, 0, 1);
+    CHECK(plan.empty());
+    // pmax is never dropped
+    plan = partition_plan(partitions, midnight + 100 * day, day, 0, 1);
+    REQUIRE(plan.size() == 2);
+    CHECK(plan[0].find("REORGANIZE PARTITION pmax") != std::string::npos);
+    CHECK(plan[1] == "ALTER TABLE t_bios_measurement DROP PARTITION p20201123,p20201124,p20201125");
+
+    // layout is disabled by default, maintenance is a no-op
+    CHECK(!partition_enabled());
+    CHECK(partition_maintenance("mysql:db=nowhere", midnight) == 0);
+}
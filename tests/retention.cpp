@@ -0,0 +1,55 @@
+#include "src/retention.h"
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+#include <regex>
+
+TEST_CASE("retention test")
+{
+    ManageFtyLog::setInstanceFtylog("retention");
+
+    CHECK(retention_step_index("RT") == 0);
+    CHECK(retention_step_index("24h") != -1);
+    CHECK(retention_step_index("1d") == -1);
+
+    // step is the suffix of the quantity
+    CHECK(retention_topic_step("realpower.default_arithmetic_mean_15m@ups-1") == retention_step_index("15m"));
+    CHECK(retention_topic_step("temperature_max_24h@sensor-3") == retention_step_index("24h"));
+    CHECK(retention_topic_step("average.temperature_30d@datacenter_1") == retention_step_index("30d"));
+    // real time
+    CHECK(retention_topic_step("realpower.default@ups-1") == 0);
+    CHECK(retention_topic_step("voltage.input.L1@rack_15m") == 0);
+    // unknown step is stored without age
+    CHECK(retention_topic_step("foo_bar@x") == -1);
+    CHECK(retention_topic_step("foo_1d@x") == -1);
+    CHECK(retention_topic_step("humidity_input@rack_15m") == -1);
+    CHECK(retention_get_age(-1) == -1);
+    CHECK(retention_is_stored(-1));
+
+    // unknown age means stored
+    CHECK(retention_get_age("8h") == -1);
+    CHECK(retention_is_stored(retention_step_index("8h")));
+    retention_set_age("8h", 0);
+    CHECK(retention_get_age("8h") == 0);
+    CHECK(!retention_is_stored(retention_step_index("8h")));
+    retention_set_age("8h", 30);
+    CHECK(retention_is_stored(retention_step_index("8h")));
+
+    // unknown step is ignored
+    retention_set_age("2h", 10);
+    CHECK(retention_get_age("2h") == -1);
+
+    // types of the stored aggregated steps
+    std::regex types(retention_stored_types_regex());
+    CHECK(std::regex_match("realpower.default_arithmetic_mean_15m", types));
+    CHECK(std::regex_match("temperature_max_7d", types));
+    CHECK(std::regex_match("foo_bar", types));
+    CHECK(std::regex_match("foo_1d", types));
+    CHECK(!std::regex_match("realpower.default", types));
+    retention_set_age("7d", 0);
+    types = std::regex(retention_stored_types_regex());
+    CHECK(!std::regex_match("temperature_max_7d", types));
+    CHECK(std::regex_match("temperature_max_7d_x", types));
+    CHECK(std::regex_match("foo_bar", types));
+    CHECK(std::regex_match("temperature_max_24h", types));
+    retention_set_age("7d", -1);
+}
@@ -0,0 +1,54 @@
+#include "src/shm_scan.h"
+#include <catch2/catch.hpp>
+#include <regex>
+
+TEST_CASE("shm scan regex test")
+{
+    CHECK(shm_scan_asset_regex(0, 1) == ".*");
+
+    const std::vector<std::string> names = {
+        "ups-0", "ups-1", "ups-12", "epdu-25", "sensor-39", "datacenter-4", "rackcontroller-0", "ups", "", "room-7a"};
+    for (int partitions = 2; partitions <= SHM_SCANNERS_MAX; partitions++) {
+        for (const auto& name : names) {
+            // each asset is in exactly one partition, matched or searched
+            int matched = 0;
+            for (int p = 0; p < partitions; p++) {
+                std::regex regex(shm_scan_asset_regex(p, partitions));
+                bool       match = std::regex_match(name, regex);
+                CHECK(match == std::regex_search(name, regex));
+                matched += match ? 1 : 0;
+            }
+            CHECK(matched == 1);
+        }
+        // digits are spread evenly over all partitions
+        for (int p = 0; p < partitions; p++) {
+            std::regex regex(shm_scan_asset_regex(p, partitions));
+            int        digits = 0;
+            for (char digit = '0'; digit <= '9'; digit++) {
+                digits += std::regex_match(std::string("ups-") + digit, regex) ? 1 : 0;
+            }
+            CHECK(digits >= 10 / partitions);
+            CHECK(digits <= (10 + partitions - 1) / partitions);
+        }
+    }
+    // digits are dealt round robin
+    CHECK(std::regex_match("ups-12", std::regex(shm_scan_asset_regex(2, 3))));
+    CHECK(std::regex_match("ups-11", std::regex(shm_scan_asset_regex(1, 3))));
+    CHECK(std::regex_match("ups-30", std::regex(shm_scan_asset_regex(0, 3))));
+    CHECK(std::regex_match("ups", std::regex(shm_scan_asset_regex(0, 3))));
+}
+
+TEST_CASE("shm scanner test")
+{
+    // threads are reused by the scans
+    ShmScanner scanner(4);
+    CHECK(scanner.partitions() == 4);
+    for (int i = 0; i < 10; i++) {
+        std::vector<ShmBatch> batches = scanner.scan(".*", [](fty_proto_t*) {
+            return SHM_KEEP;
+        });
+        CHECK(batches.size() == 4);
+    }
+    CHECK(ShmScanner(SHM_SCANNERS_MAX + 1).partitions() == SHM_SCANNERS_MAX);
+    CHECK(ShmScanner(0).partitions() == 1);
+}
@@ -0,0 +1,71 @@
+#include "src/stats.h"
+#include <catch2/catch.hpp>
+#include <map>
+#include <thread>
+#include <vector>
+
+TEST_CASE("stats test")
+{
+    StatsCounter& counter = stats_counter("test.counter");
+    CHECK(&counter == &stats_counter("test.counter"));
+
+    // concurrent updates
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&counter]() {
+            for (int i = 0; i < 10000; i++) {
+                counter.add();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(counter.value() == 40000);
+
+    stats_gauge("test.gauge").set(-5);
+
+    StatsHistogram& histogram = stats_histogram("test.histogram");
+    CHECK(histogram.percentile(0.5) == 0);
+    for (uint64_t v = 1; v <= 100; v++) {
+        histogram.add(v);
+    }
+    histogram.add(100000);
+    CHECK(histogram.count() == 101);
+    CHECK(histogram.sum() == 5050 + 100000);
+    CHECK(histogram.max() == 100000);
+    // 51 is in the bucket [48, 51], 100 in [96, 103]
+    CHECK(histogram.percentile(0.5) == 51);
+    CHECK(histogram.percentile(0.99) == 103);
+    CHECK(histogram.percentile(1) == 100000);
+
+    std::map<std::string, int64_t> snapshot;
+    stats_foreach([&snapshot](const std::string& name, int64_t value) {
+        snapshot[name] = value;
+    });
+    CHECK(snapshot["test.counter"] == 40000);
+    CHECK(snapshot["test.gauge"] == -5);
+    CHECK(snapshot["test.histogram.count"] == 101);
+    CHECK(snapshot["test.histogram.max"] == 100000);
+    CHECK(snapshot["test.histogram.p50"] == 51);
+
+    // since the previous call
+    std::vector<uint64_t> last;
+    CHECK(histogram.percentile_since(last, 0.5) == 51);
+    CHECK(histogram.percentile_since(last, 0.5) == 0);
+    histogram.add(1000);
+    histogram.add(1001);
+    CHECK(histogram.percentile_since(last, 0.99) == 1023);
+
+    // precision
+    StatsHistogram precise;
+    for (uint64_t v : {uint64_t(7), uint64_t(8), uint64_t(9), uint64_t(1000000), UINT64_MAX}) {
+        precise.add(v);
+    }
+    CHECK(precise.percentile(0.2) == 7);
+    CHECK(precise.percentile(0.4) == 8);
+    CHECK(precise.percentile(0.6) == 9);
+    CHECK(precise.percentile(0.8) >= 1000000);
+    CHECK(precise.percentile(0.8) <= 1000000 * 1.125);
+    CHECK(precise.percentile(1) == UINT64_MAX);
+}
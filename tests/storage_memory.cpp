@@ -0,0 +1,75 @@
+#include "src/memory_account.h"
+#include "src/persistance.h"
+#include <catch2/catch.hpp>
+#include <fty_log.h>
+
+TEST_CASE("storage memory test")
+{
+    ManageFtyLog::setInstanceFtylog("storage_memory");
+
+    static const std::string url = "memory:storage-memory-test";
+
+    std::vector<std::pair<int64_t, m_msrmnt_value_t>> selected;
+    const msrmnt_cb_t add = [&selected](int64_t timestamp, m_msrmnt_value_t value, m_msrmnt_scale_t) {
+        selected.push_back({timestamp, value});
+    };
+    const auto keep_going = [] {
+        return true;
+    };
+
+    g_row_mutex.lock();
+    CHECK(insert_into_measurement(url, "realpower.default_avg_15m@ups-1", 10, 0, 900, "W", "ups-1") == 0);
+    CHECK(insert_into_measurement(url, "realpower.default_avg_15m@ups-1", 30, 0, 2700, "kW", "ups-1") == 0);
+    CHECK(insert_into_measurement(url, "realpower.default_avg_15m@ups-1", 20, 0, 1800, "W", "ups-1") == 0);
+    // same timestamp overrides the value
+    CHECK(insert_into_measurement(url, "realpower.default_avg_15m@ups-1", 11, -1, 900, "W", "ups-1") == 0);
+    CHECK(insert_into_measurement(url, "voltage.input_avg_15m@ups-2", 230, 0, 900, "V", "ups-2") == 0);
+    CHECK(insert_into_measurement(url, "@ups-2", 230, 0, 900, "V", "ups-2") != 0);
+    flush_measurement(url);
+    g_row_mutex.unlock();
+
+    // topic keeps the first units
+    std::string units;
+    CHECK(select_topic(url, "realpower.default_avg_15m@ups-1", units) == 0);
+    CHECK(units == "W");
+    CHECK(select_topic(url, "unknown_avg_15m@ups-1", units) == 0);
+    CHECK(units.empty());
+
+    // range, ordered by timestamp
+    CHECK(select_measurements(url, "realpower.default_avg_15m@ups-1", 900, 1800, add, true) == 0);
+    REQUIRE(selected.size() == 2);
+    CHECK(selected[0] == std::make_pair(int64_t(900), m_msrmnt_value_t(11)));
+    CHECK(selected[1] == std::make_pair(int64_t(1800), m_msrmnt_value_t(20)));
+
+    // asset delete
+    CHECK(delete_measurements(url, {"ups-1"}, keep_going) == 0);
+    selected.clear();
+    CHECK(select_measurements(url, "realpower.default_avg_15m@ups-1", 0, INT64_MAX, add, true) == 0);
+    CHECK(selected.empty());
+    CHECK(select_measurements(url, "voltage.input_avg_15m@ups-2", 0, INT64_MAX, add, true) == 0);
+    CHECK(selected.size() == 1);
+
+    // other name is other store
+    selected.clear();
+    CHECK(select_measurements("memory:other", "voltage.input_avg_15m@ups-2", 0, INT64_MAX, add, true) == 0);
+    CHECK(selected.empty());
+
+    // over the cap new measurements are rejected, the stored ones are kept
+    MemoryAccount& memory = memory_account("storage_memory");
+    memory.set_cap(uint64_t(memory.bytes()));
+    g_row_mutex.lock();
+    CHECK(insert_into_measurement(url, "voltage.input_avg_15m@ups-2", 231, 0, 1800, "V", "ups-2") == 0);
+    CHECK(memory.over_cap());
+    CHECK(insert_into_measurement(url, "voltage.input_avg_15m@ups-2", 232, 0, 2700, "V", "ups-2") != 0);
+    CHECK(insert_into_measurement(url, "voltage.input_avg_15m@ups-3", 232, 0, 2700, "V", "ups-3") != 0);
+    // same timestamp still overrides the value
+    CHECK(insert_into_measurement(url, "voltage.input_avg_15m@ups-2", 233, 0, 1800, "V", "ups-2") == 0);
+    g_row_mutex.unlock();
+    selected.clear();
+    CHECK(select_measurements(url, "voltage.input_avg_15m@ups-2", 0, INT64_MAX, add, true) == 0);
+    REQUIRE(selected.size() == 2);
+    CHECK(selected[0] == std::make_pair(int64_t(900), m_msrmnt_value_t(230)));
+    CHECK(selected[1] == std::make_pair(int64_t(1800), m_msrmnt_value_t(233)));
+    memory.set_cap(0);
+    CHECK(!memory.over_cap());
+}
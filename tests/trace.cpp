@@ -0,0 +1,79 @@
+#include "src/trace.h"
+#include <catch2/catch.hpp>
+#include <fstream>
+#include <fty_log.h>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+struct TempDir
+{
+    std::string path;
+    ~TempDir()
+    {
+        // removed even when a REQUIRE fails
+        int rv = system(("rm -rf " + path).c_str());
+        (void)rv;
+    }
+};
+
+static std::string s_read(const std::string& path)
+{
+    std::ifstream     f(path);
+    std::stringstream content;
+    content << f.rdbuf();
+    return content.str();
+}
+
+static size_t s_count(const std::string& string, const std::string& pattern)
+{
+    size_t count = 0;
+    for (size_t pos = string.find(pattern); pos != std::string::npos; pos = string.find(pattern, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+TEST_CASE("trace test")
+{
+    ManageFtyLog::setInstanceFtylog("trace");
+    char tmpl[] = "/tmp/fty-metric-store-trace-XXXXXX";
+    REQUIRE(mkdtemp(tmpl));
+    TempDir           dir{tmpl};
+    const std::string file = dir.path + "/trace.json";
+
+    // disabled
+    {
+        TraceSpan span("test.disabled");
+    }
+
+    trace_enable(true);
+    trace_thread_name("test-main");
+    {
+        TraceSpan span("test.main");
+    }
+    std::thread thread([]() {
+        trace_thread_name("test-thread");
+        for (int i = 0; i < TRACE_RING_SIZE + 10; i++) {
+            TraceSpan span("test.thread");
+        }
+    });
+    thread.join();
+    trace_enable(false);
+    {
+        TraceSpan span("test.disabled");
+    }
+
+    REQUIRE(trace_dump(file) == 0);
+    std::string json = s_read(file);
+    CHECK(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") == 0);
+    CHECK(s_count(json, "\"name\":\"test.main\"") == 1);
+    // the oldest spans are overwritten (and the next one may be)
+    CHECK(s_count(json, "\"name\":\"test.thread\"") == TRACE_RING_SIZE - 1);
+    CHECK(s_count(json, "test.disabled") == 0);
+    CHECK(s_count(json, "\"args\":{\"name\":\"test-thread\"}") == 1);
+
+    trace_clear();
+    REQUIRE(trace_dump(file) == 0);
+    CHECK(s_count(s_read(file), "\"ph\":\"X\"") == 0);
+}
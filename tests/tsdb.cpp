@@ -0,0 +1,137 @@
+#include "src/retention.h"
+#include "src/tsdb.h"
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <fty_log.h>
+#include <thread>
+#include <unistd.h>
+
+struct Point
+{
+    int64_t          timestamp;
+    m_msrmnt_value_t value;
+    m_msrmnt_scale_t scale;
+};
+
+static std::vector<Point> s_select(TsdbStorage& storage, const std::string& topic, int64_t start, int64_t end)
+{
+    std::vector<Point> points;
+    int rv = storage.select(topic, start, end, [&points](int64_t timestamp, m_msrmnt_value_t value, m_msrmnt_scale_t scale) {
+        points.push_back({timestamp, value, scale});
+    }, true);
+    REQUIRE(rv == 0);
+    return points;
+}
+
+TEST_CASE("tsdb test")
+{
+    ManageFtyLog::setInstanceFtylog("tsdb");
+
+    char tmpl[] = "/tmp/fty-metric-store-tsdb-XXXXXX";
+    REQUIRE(mkdtemp(tmpl));
+    std::string dir(tmpl);
+
+    const int64_t day        = 1606089600; // 2020-11-23
+    const auto    keep_going = [] {
+        return true;
+    };
+
+    {
+        TsdbStorage storage(dir);
+
+        // regular, irregular, negative and extreme values
+        std::vector<Point> points = {
+            {day, 1234, -1},
+            {day + 5, 1235, -1},
+            {day + 10, 1235, -1},
+            {day + 15, -80000, 0},
+            {day + 1000, 2147483647, 0},
+            {day + 1005, -2147483647 - 1, -3},
+            {day + 100000, 0, 0},
+        };
+        for (const auto& p : points) {
+            CHECK(storage.insert("realpower.default@ups-1", p.value, p.scale, p.timestamp, "W", "ups-1") == 0);
+        }
+        // older than the last point is dropped
+        CHECK(storage.insert("realpower.default@ups-1", 1, 0, day + 7, "W", "ups-1") == 0);
+
+        std::vector<Point> selected = s_select(storage, "realpower.default@ups-1", INT64_MIN, INT64_MAX);
+        REQUIRE(selected.size() == points.size());
+        for (size_t i = 0; i != points.size(); i++) {
+            CHECK(selected[i].timestamp == points[i].timestamp);
+            CHECK(selected[i].value == points[i].value);
+            CHECK(selected[i].scale == points[i].scale);
+        }
+
+        // range
+        selected = s_select(storage, "realpower.default@ups-1", day + 5, day + 1000);
+        REQUIRE(selected.size() == 4);
+        CHECK(selected[0].timestamp == day + 5);
+        CHECK(selected[3].value == 2147483647);
+
+        std::string units;
+        CHECK(storage.select_topic("realpower.default@ups-1", units) == 0);
+        CHECK(units == "W");
+        CHECK(storage.select_topic("unknown@ups-1", units) == 0);
+        CHECK(units.empty());
+
+        // several chunks
+        for (int i = 0; i != 20000; i++) {
+            REQUIRE(storage.insert("voltage.input@ups-2", m_msrmnt_value_t(uint32_t(i) * 2654435761u), 0, day + i, "V", "ups-2") == 0);
+        }
+        CHECK(access((dir + "/RT/20201123/voltage.input@ups-2.1").c_str(), F_OK) == 0);
+        selected = s_select(storage, "voltage.input@ups-2", day, day + 86399);
+        REQUIRE(selected.size() == 20000);
+        CHECK(selected[19999].timestamp == day + 19999);
+        CHECK(selected[19999].value == m_msrmnt_value_t(19999u * 2654435761u));
+
+        storage.flush(true, 0);
+    }
+
+    {
+        // continue after restart
+        TsdbStorage storage(dir);
+        CHECK(storage.insert("realpower.default@ups-1", 42, 0, day + 100005, "W", "ups-1") == 0);
+        std::vector<Point> selected = s_select(storage, "realpower.default@ups-1", day + 100000, INT64_MAX);
+        REQUIRE(selected.size() == 2);
+        CHECK(selected[1].value == 42);
+
+        // delete
+        CHECK(storage.delete_assets({"ups-1"}, keep_going) == 0);
+        CHECK(s_select(storage, "realpower.default@ups-1", INT64_MIN, INT64_MAX).empty());
+        CHECK(!s_select(storage, "voltage.input@ups-2", INT64_MIN, INT64_MAX).empty());
+
+        // expiry of whole days
+        retention_set_age("RT", 1);
+        storage.expire(day + 2 * 86400);
+        CHECK(s_select(storage, "voltage.input@ups-2", INT64_MIN, INT64_MAX).empty());
+        retention_set_age("RT", -1);
+    }
+
+    {
+        // selects while inserting see an ordered prefix of the points
+        TsdbStorage       storage(dir);
+        std::atomic<bool> done(false);
+        std::thread       writer([&storage, &done, day]() {
+            for (int i = 0; i < 20000; i++) {
+                storage.insert("voltage.input@ups-3", i, 0, day + i * 10, "V", "ups-3");
+            }
+            done = true;
+        });
+        bool   ordered = true;
+        size_t last    = 0;
+        while (!done) {
+            std::vector<Point> selected = s_select(storage, "voltage.input@ups-3", INT64_MIN, INT64_MAX);
+            for (size_t i = 0; i != selected.size(); i++) {
+                ordered = ordered && selected[i].value == m_msrmnt_value_t(i);
+            }
+            ordered = ordered && selected.size() >= last;
+            last    = selected.size();
+        }
+        writer.join();
+        CHECK(ordered);
+        CHECK(s_select(storage, "voltage.input@ups-3", INT64_MIN, INT64_MAX).size() == 20000);
+    }
+
+    CHECK(system(("rm -rf " + dir).c_str()) == 0);
+}